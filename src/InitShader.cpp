@@ -1,10 +1,12 @@
 
 #include "cube.h"
 
+#include <cstring>
+
 
 
 // Create a NULL-terminated string by reading the provided file
-static char*
+char*
 readShaderSource(const char* shaderFile)
 {
     FILE* fp = fopen(shaderFile, "rb");
@@ -25,6 +27,68 @@ readShaderSource(const char* shaderFile)
 }
 
 
+// The source after its #version line, or all of it if it has none
+const char*
+shaderBody(const char* source)
+{
+    if ( strncmp(source, "#version", 8) != 0 ) { return source; }
+
+    const char* eol = strchr(source, '\n');
+    return eol ? eol + 1 : source + strlen(source);
+}
+
+
+// Create a shader from the concatenated parts and start compiling it
+GLuint
+compileShaderSource(GLenum type, const char* const* parts, int n)
+{
+    GLuint shader = glCreateShader( type );
+    glShaderSource( shader, n, (const GLchar**) parts, NULL );
+    glCompileShader( shader );
+    return shader;
+}
+
+
+// Read back whether shader compiled, printing its log if not
+bool
+shaderCompiled(GLuint shader, const char* name)
+{
+    GLint  compiled;
+    glGetShaderiv( shader, GL_COMPILE_STATUS, &compiled );
+    if ( compiled ) { return true; }
+
+    std::cerr << name << " failed to compile:" << std::endl;
+    GLint  logSize;
+    glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &logSize );
+    char* logMsg = new char[logSize + 1];
+    logMsg[0] = '\0';
+    glGetShaderInfoLog( shader, logSize + 1, NULL, logMsg );
+    std::cerr << logMsg << std::endl;
+    delete [] logMsg;
+    return false;
+}
+
+
+// Read back whether program linked, printing its log if not
+bool
+programLinked(GLuint program, const char* name)
+{
+    GLint  linked;
+    glGetProgramiv( program, GL_LINK_STATUS, &linked );
+    if ( linked ) { return true; }
+
+    std::cerr << name << " failed to link" << std::endl;
+    GLint  logSize;
+    glGetProgramiv( program, GL_INFO_LOG_LENGTH, &logSize );
+    char* logMsg = new char[logSize + 1];
+    logMsg[0] = '\0';
+    glGetProgramInfoLog( program, logSize + 1, NULL, logMsg );
+    std::cerr << logMsg << std::endl;
+    delete [] logMsg;
+    return false;
+}
+
+
 // Create a GLSL program object from vertex and fragment shader files
 GLuint
 InitShader(const char* vShaderFile, const char* fShaderFile)
@@ -48,21 +112,8 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
 	    exit( EXIT_FAILURE );
 	}
 
-	GLuint shader = glCreateShader( s.type );
-	glShaderSource( shader, 1, (const GLchar**) &s.source, NULL );
-	glCompileShader( shader );
-
-	GLint  compiled;
-	glGetShaderiv( shader, GL_COMPILE_STATUS, &compiled );
-	if ( !compiled ) {
-	    std::cerr << s.filename << " failed to compile:" << std::endl;
-	    GLint  logSize;
-	    glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &logSize );
-	    char* logMsg = new char[logSize];
-	    glGetShaderInfoLog( shader, logSize, NULL, logMsg );
-	    std::cerr << logMsg << std::endl;
-	    delete [] logMsg;
-
+	GLuint shader = compileShaderSource( s.type, &s.source, 1 );
+	if ( !shaderCompiled( shader, s.filename ) ) {
 	    exit( EXIT_FAILURE );
 	}
 
@@ -74,22 +125,12 @@ InitShader(const char* vShaderFile, const char* fShaderFile)
     /* link  and error check */
     glLinkProgram(program);
 
-    GLint  linked;
-    glGetProgramiv( program, GL_LINK_STATUS, &linked );
-    if ( !linked ) {
-	std::cerr << "Shader program failed to link" << std::endl;
-	GLint  logSize;
-	glGetProgramiv( program, GL_INFO_LOG_LENGTH, &logSize);
-	char* logMsg = new char[logSize];
-	glGetProgramInfoLog( program, logSize, NULL, logMsg );
-	std::cerr << logMsg << std::endl;
-	delete [] logMsg;
-
+    if ( !programLinked( program, "Shader program" ) ) {
 	exit( EXIT_FAILURE );
     }
 
     /* use program object */
-    glUseProgram(program);
+    glState.useProgram(program);
 
     return program;
 }
@@ -0,0 +1,66 @@
+//
+// Benchmark table, see bench.h
+//
+
+#include "bench.h"
+#include "bvh.h"
+#include "caustics.h"
+#include "lights.h"
+#include "ocean.h"
+#include "particles.h"
+#include "physics.h"
+#include "rig.h"
+#include "steering.h"
+#include "streambuffer.h"
+#include "swimmer.h"
+#include "water.h"
+
+#include <cstdio>
+#include <cstring>
+
+struct Benchmark {
+	const char* name;
+	void (*run)();
+	const char* what;
+};
+
+static const Benchmark benchmarks[] = {
+	{ "bvh", bvhBenchmark, "BVH build, refit, frustum/ray/box queries vs crowd size" },
+	{ "skin", skinBenchmark, "CPU (scalar, SSE, threaded) vs GPU skinning vs crowd size" },
+	{ "ocean", oceanBenchmark, "FFT ocean spectrum, FFT (SSE vs scalar) and vertex write vs grid size" },
+	{ "water", waterBenchmark, "wake grid cells per second vs grid size and thread count" },
+	{ "particles", particlesBenchmark, "particle update, compact and emit at a million particles vs thread count" },
+	{ "physics", physicsBenchmark, "buoyancy and drag step, scalar vs SSE, bodies per millisecond vs crowd size" },
+	{ "steering", steeringBenchmark, "spatial hash build and neighbour queries from 10k to 1M agents" },
+	{ "rig", rigBenchmark, "rig text parse vs compiled file map, hundreds to thousands of rig variants" },
+	{ "lights", lightsBenchmark, "tiled light assignment, scalar vs SSE, from 64 to 16k lights at 1080p" },
+	{ "oit", transparencyBenchmark, "sorted alpha blending vs weighted blended OIT vs per-pixel lists vs particle count" },
+	{ "caustics", causticsBenchmark, "Worley caustics per 512^2 tile, scalar vs SSE vs thread count, and its mips" },
+	{ "stream", streamBenchmark, "vertex streaming: persistent vs unsynchronized vs orphaned maps vs glBufferSubData" },
+};
+
+const int NumBenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+//----------------------------------------------------------------------------
+
+bool runBenchmark(const char* name)
+{
+	for (int i = 0; i < NumBenchmarks; i++) {
+		if (strcmp(name, benchmarks[i].name) == 0 || strcmp(name, "all") == 0) {
+			printf("== %s: %s\n", benchmarks[i].name, benchmarks[i].what);
+			benchmarks[i].run();
+			if (strcmp(name, "all") != 0)
+				return true;
+		}
+	}
+	if (strcmp(name, "all") == 0)
+		return true;
+
+	if (strcmp(name, "list") != 0)
+		printf("no benchmark named \"%s\"\n", name);
+	printf("benchmarks: all");
+	for (int i = 0; i < NumBenchmarks; i++)
+		printf(", %s", benchmarks[i].name);
+	printf("\n");
+	return strcmp(name, "list") == 0;
+}
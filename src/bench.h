@@ -0,0 +1,17 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+//----------------------------------------------------------------------------
+//
+//  Benchmarks, run with "cube --bench <name>" (or "--bench list").  They
+//    run after init(), so the ones that need GL have a context.
+//
+
+// runs the named benchmark; false if there is none by that name
+bool runBenchmark(const char* name);
+
+#endif // _BENCH_H_
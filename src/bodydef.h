@@ -0,0 +1,134 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BODYDEF_H_
+#define _BODYDEF_H_
+
+#include "skin.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Bodies as compile-time part tables
+//
+//  A body is a struct with a constexpr array of parts, parents first, and
+//    their count.  Each part is a joint carrying one box: where it pivots on
+//    its parent, the box, the axis it turns about and which animation
+//    channel turns it (with a sign, so mirrored limbs share a channel).
+//
+//  bodyPalette() is unrolled over the table by templates, so every part's
+//    parent, axis, sign and bind position are constants in the generated
+//    code; posing a body is straight-line matrix work with no table walk.
+//    A new body (fins, flippers, another species) is just another table.
+//
+
+// constexpr stand-in for glm::vec3 in the tables
+struct Float3 {
+	float x, y, z;
+};
+
+inline glm::vec3 toVec3(const Float3& f)
+{
+	return glm::vec3(f.x, f.y, f.z);
+}
+
+// animation channels a part can follow
+enum PartDriver {
+	DriveNone,			// fixed to its parent
+	DriveArm,
+	DriveLeg,
+	NumDrivers
+};
+
+struct PartDef {
+	int    parent;		// -1 for the root, else an earlier part
+	Float3 pivot;		// from the parent joint, in its frame
+	Float3 center;		// of the box, in joint space
+	Float3 scale;		// box size
+	Float3 axis;		// unit rotation axis, joint space
+	float  sign;		// applied to the driver's angle
+	int    driver;		// PartDriver
+};
+
+// joint position in the bind pose (no rotation): pivots summed up the chain
+constexpr Float3 bindOrigin(const PartDef* parts, int j)
+{
+	Float3 o = { 0.0f, 0.0f, 0.0f };
+	for (int p = j; p >= 0; p = parts[p].parent) {
+		o.x += parts[p].pivot.x;
+		o.y += parts[p].pivot.y;
+		o.z += parts[p].pivot.z;
+	}
+	return o;
+}
+
+//----------------------------------------------------------------------------
+
+// one part per instantiation; the Done specialization ends the chain
+template <class Body, int J = 0, bool Done = (J == Body::Count)>
+struct BodyEvaluator {
+	static void pose(const float drive[NumDrivers], const glm::mat4& root, glm::mat4* world, glm::mat4* palette)
+	{
+		constexpr PartDef part = Body::parts[J];
+		constexpr Float3 origin = bindOrigin(Body::parts, J);
+
+		glm::mat4 m = glm::translate(part.parent < 0 ? root : world[part.parent], toVec3(part.pivot));
+		if (part.driver != DriveNone)
+			m = glm::rotate(m, part.sign * drive[part.driver], toVec3(part.axis));
+		world[J] = m;
+		palette[J] = glm::translate(m, -toVec3(origin));
+
+		BodyEvaluator<Body, J + 1>::pose(drive, root, world, palette);
+	}
+};
+
+template <class Body, int J>
+struct BodyEvaluator<Body, J, true> {
+	static void pose(const float*, const glm::mat4&, glm::mat4*, glm::mat4*) {}
+};
+
+// palette[j] takes bind-pose positions to posed ones, as skeletonPalette()
+template <class Body>
+void bodyPalette(const float drive[NumDrivers], const glm::mat4& root, glm::mat4* palette)
+{
+	glm::mat4 world[Body::Count];
+	BodyEvaluator<Body>::pose(drive, root, world, palette);
+}
+
+// the same joints as a Skeleton, for code that walks one at run time
+template <class Body>
+void bodySkeleton(Skeleton& s)
+{
+	static_assert(Body::Count <= MaxJoints, "body has more parts than a skeleton holds");
+	s.count = 0;
+	for (int j = 0; j < Body::Count; j++)
+		addJoint(s, Body::parts[j].parent, toVec3(Body::parts[j].pivot));
+}
+
+// one box per part from a unit cube, each bound rigidly to its joint
+template <class Body>
+void bodyMesh(const glm::vec4* cube, const glm::vec4* normals, const glm::vec4* colors, int cubeVertices,
+	std::vector<SkinVertex>& mesh)
+{
+	mesh.clear();
+	for (int j = 0; j < Body::Count; j++) {
+		const PartDef& part = Body::parts[j];
+		glm::vec3 base = toVec3(bindOrigin(Body::parts, j)) + toVec3(part.center);
+		for (int v = 0; v < cubeVertices; v++) {
+			SkinVertex sv;
+			sv.position = glm::vec4(base + toVec3(part.scale) * glm::vec3(cube[v]), 1.0f);
+			sv.color = colors[v];
+			sv.normal = normals[v];		// boxes are only scaled along their axes
+			sv.joints[0] = sv.joints[1] = float(j);
+			sv.weights[0] = 1.0f;
+			sv.weights[1] = 0.0f;
+			mesh.push_back(sv);
+		}
+	}
+}
+
+#endif // _BODYDEF_H_
@@ -0,0 +1,439 @@
+//
+// Bounding volume hierarchy, see bvh.h
+//
+
+#include "bvh.h"
+#include "jobs.h"
+#include "timing.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+const int LeafSize = 4;				// one SSE batch of boxes per leaf
+const float DegradeFactor = 1.5f;	// rebuild once refits grow the tree area this much
+const int StackSize = 64;
+
+//----------------------------------------------------------------------------
+
+static inline float
+area(const float lo[3], const float hi[3])
+{
+	float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static inline bool
+overlaps(const float lo[3], const float hi[3], const glm::vec3& qlo, const glm::vec3& qhi)
+{
+	return lo[0] <= qhi.x && hi[0] >= qlo.x && lo[1] <= qhi.y && hi[1] >= qlo.y &&
+		lo[2] <= qhi.z && hi[2] >= qlo.z;
+}
+
+// entry distance of the ray into the box, or a negative value for a miss
+static inline float
+slab(const float lo[3], const float hi[3], const glm::vec3& o, const glm::vec3& inv, float tMax)
+{
+	float t0 = 0.0f, t1 = tMax;
+	for (int a = 0; a < 3; a++) {
+		float tn = (lo[a] - o[a]) * inv[a], tf = (hi[a] - o[a]) * inv[a];
+		if (tn > tf) std::swap(tn, tf);
+		t0 = std::max(t0, tn);
+		t1 = std::min(t1, tf);
+		if (t0 > t1)
+			return -1.0f;
+	}
+	return t0;
+}
+
+//----------------------------------------------------------------------------
+
+BVH::BVH()
+	: count(0), builtArea(0.0f)
+{
+	boxes = Boxes();
+}
+
+void BVH::clear()
+{
+	nodes.clear();
+	prims.clear();
+	levels.clear();
+	boxes = Boxes();
+	count = 0;
+	builtArea = 0.0f;
+}
+
+void BVH::fitRange(Node& n) const
+{
+	n.lo[0] = n.lo[1] = n.lo[2] = 1e30f;
+	n.hi[0] = n.hi[1] = n.hi[2] = -1e30f;
+	for (int i = n.first; i < n.first + n.count; i++) {
+		int p = prims[i];
+		n.lo[0] = std::min(n.lo[0], boxes.minX[p]); n.hi[0] = std::max(n.hi[0], boxes.maxX[p]);
+		n.lo[1] = std::min(n.lo[1], boxes.minY[p]); n.hi[1] = std::max(n.hi[1], boxes.maxY[p]);
+		n.lo[2] = std::min(n.lo[2], boxes.minZ[p]); n.hi[2] = std::max(n.hi[2], boxes.maxZ[p]);
+	}
+}
+
+float BVH::totalArea() const
+{
+	float sum = 0.0f;
+	for (size_t i = 0; i < nodes.size(); i++)
+		sum += area(nodes[i].lo, nodes[i].hi);
+	return sum;
+}
+
+//----------------------------------------------------------------------------
+
+void BVH::build(const Boxes& b, int n)
+{
+	boxes = b;
+	count = n;
+	nodes.clear();
+	levels.clear();
+	prims.resize(n);
+	for (int i = 0; i < n; i++)
+		prims[i] = i;
+	if (n == 0)
+		return;
+
+	std::vector<float> centroid[3];
+	centroid[0].resize(n); centroid[1].resize(n); centroid[2].resize(n);
+	for (int i = 0; i < n; i++) {
+		centroid[0][i] = b.minX[i] + b.maxX[i];
+		centroid[1][i] = b.minY[i] + b.maxY[i];
+		centroid[2][i] = b.minZ[i] + b.maxZ[i];
+	}
+
+	nodes.reserve(2 * (n / LeafSize + 1));
+	Node root = { { 0 }, { 0 }, 0, n, -1 };
+	nodes.push_back(root);
+
+	struct Work { int node, depth; };
+	std::vector<Work> work(1, Work());
+	work[0].node = 0;
+	work[0].depth = 0;
+
+	while (!work.empty()) {
+		Work w = work.back();
+		work.pop_back();
+
+		fitRange(nodes[w.node]);
+		if (int(levels.size()) <= w.depth)
+			levels.resize(w.depth + 1);
+		levels[w.depth].push_back(w.node);
+
+		int first = nodes[w.node].first, cnt = nodes[w.node].count;
+		if (cnt <= LeafSize)
+			continue;
+
+		// split at the median centroid along the widest centroid axis
+		float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+		for (int i = first; i < first + cnt; i++) {
+			for (int a = 0; a < 3; a++) {
+				lo[a] = std::min(lo[a], centroid[a][prims[i]]);
+				hi[a] = std::max(hi[a], centroid[a][prims[i]]);
+			}
+		}
+		int axis = 0;
+		if (hi[1] - lo[1] > hi[axis] - lo[axis]) axis = 1;
+		if (hi[2] - lo[2] > hi[axis] - lo[axis]) axis = 2;
+
+		const std::vector<float>& c = centroid[axis];
+		int mid = first + cnt / 2;
+		std::nth_element(prims.begin() + first, prims.begin() + mid, prims.begin() + first + cnt,
+			[&c](int p, int q) { return c[p] < c[q]; });
+
+		int left = int(nodes.size());
+		Node l = { { 0 }, { 0 }, first, mid - first, -1 };
+		Node r = { { 0 }, { 0 }, mid, first + cnt - mid, -1 };
+		nodes.push_back(l);
+		nodes.push_back(r);
+		nodes[w.node].left = left;
+
+		Work wl = { left, w.depth + 1 }, wr = { left + 1, w.depth + 1 };
+		work.push_back(wl);
+		work.push_back(wr);
+	}
+
+	builtArea = totalArea();
+}
+
+//----------------------------------------------------------------------------
+
+void BVH::refit(const Boxes& b)
+{
+	boxes = b;
+
+	// children sit one level deeper than their parent, so going from the
+	//   deepest level up every node sees finished children
+	for (int d = int(levels.size()) - 1; d >= 0; d--) {
+		const std::vector<int>& level = levels[d];
+		parallelFor(int(level.size()), 256, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				Node& n = nodes[level[i]];
+				if (n.left < 0) {
+					fitRange(n);
+					continue;
+				}
+				const Node& l = nodes[n.left];
+				const Node& r = nodes[n.left + 1];
+				for (int a = 0; a < 3; a++) {
+					n.lo[a] = std::min(l.lo[a], r.lo[a]);
+					n.hi[a] = std::max(l.hi[a], r.hi[a]);
+				}
+			}
+		});
+	}
+}
+
+bool BVH::degraded() const
+{
+	return !nodes.empty() && totalArea() > builtArea * DegradeFactor;
+}
+
+void BVH::bounds(glm::vec3& lo, glm::vec3& hi) const
+{
+	if (nodes.empty()) {
+		lo = glm::vec3(1.0f);
+		hi = glm::vec3(-1.0f);
+		return;
+	}
+	lo = glm::vec3(nodes[0].lo[0], nodes[0].lo[1], nodes[0].lo[2]);
+	hi = glm::vec3(nodes[0].hi[0], nodes[0].hi[1], nodes[0].hi[2]);
+}
+
+//----------------------------------------------------------------------------
+
+void BVH::queryFrustum(const Frustum& f, std::vector<int>& hits, std::vector<unsigned char>& results) const
+{
+	if (nodes.empty())
+		return;
+
+	int stack[StackSize];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		const Node& n = nodes[stack[--top]];
+
+		unsigned char r;
+		cullBoxes(f, &n.lo[0], &n.lo[1], &n.lo[2], &n.hi[0], &n.hi[1], &n.hi[2], 1, &r);
+		if (r == CullOutside)
+			continue;
+
+		if (r == CullInside) {
+			hits.insert(hits.end(), prims.begin() + n.first, prims.begin() + n.first + n.count);
+			results.insert(results.end(), n.count, (unsigned char)CullInside);
+			continue;
+		}
+
+		if (n.left >= 0) {
+			stack[top++] = n.left;
+			stack[top++] = n.left + 1;
+			continue;
+		}
+
+		// straddling leaf: test its boxes as one batch
+		float lo[3][LeafSize], hi[3][LeafSize];
+		unsigned char leaf[LeafSize];
+		for (int i = 0; i < n.count; i++) {
+			int p = prims[n.first + i];
+			lo[0][i] = boxes.minX[p]; lo[1][i] = boxes.minY[p]; lo[2][i] = boxes.minZ[p];
+			hi[0][i] = boxes.maxX[p]; hi[1][i] = boxes.maxY[p]; hi[2][i] = boxes.maxZ[p];
+		}
+		cullBoxes(f, lo[0], lo[1], lo[2], hi[0], hi[1], hi[2], n.count, leaf);
+		for (int i = 0; i < n.count; i++) {
+			if (leaf[i] != CullOutside) {
+				hits.push_back(prims[n.first + i]);
+				results.push_back(leaf[i]);
+			}
+		}
+	}
+}
+
+void BVH::queryBox(const glm::vec3& qlo, const glm::vec3& qhi, std::vector<int>& hits) const
+{
+	if (nodes.empty())
+		return;
+
+	int stack[StackSize];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		const Node& n = nodes[stack[--top]];
+		if (!overlaps(n.lo, n.hi, qlo, qhi))
+			continue;
+
+		if (n.left >= 0) {
+			stack[top++] = n.left;
+			stack[top++] = n.left + 1;
+			continue;
+		}
+
+		for (int i = n.first; i < n.first + n.count; i++) {
+			int p = prims[i];
+			float lo[3] = { boxes.minX[p], boxes.minY[p], boxes.minZ[p] };
+			float hi[3] = { boxes.maxX[p], boxes.maxY[p], boxes.maxZ[p] };
+			if (overlaps(lo, hi, qlo, qhi))
+				hits.push_back(p);
+		}
+	}
+}
+
+int BVH::raycast(const glm::vec3& origin, const glm::vec3& dir, float* tHit) const
+{
+	if (nodes.empty())
+		return -1;
+
+	glm::vec3 inv(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+	float best = 1e30f;
+	int hit = -1;
+
+	int stack[StackSize];
+	int top = 0;
+	stack[top++] = 0;
+
+	while (top > 0) {
+		const Node& n = nodes[stack[--top]];
+		if (slab(n.lo, n.hi, origin, inv, best) < 0.0f)
+			continue;
+
+		if (n.left >= 0) {
+			// visit the nearer child first so the far one is usually pruned
+			float tl = slab(nodes[n.left].lo, nodes[n.left].hi, origin, inv, best);
+			float tr = slab(nodes[n.left + 1].lo, nodes[n.left + 1].hi, origin, inv, best);
+			bool leftFirst = tr < 0.0f || (tl >= 0.0f && tl <= tr);
+			if (tl >= 0.0f && tr >= 0.0f) {
+				stack[top++] = leftFirst ? n.left + 1 : n.left;
+				stack[top++] = leftFirst ? n.left : n.left + 1;
+			}
+			else if (tl >= 0.0f)
+				stack[top++] = n.left;
+			else if (tr >= 0.0f)
+				stack[top++] = n.left + 1;
+			continue;
+		}
+
+		for (int i = n.first; i < n.first + n.count; i++) {
+			int p = prims[i];
+			float lo[3] = { boxes.minX[p], boxes.minY[p], boxes.minZ[p] };
+			float hi[3] = { boxes.maxX[p], boxes.maxY[p], boxes.maxZ[p] };
+			float t = slab(lo, hi, origin, inv, best);
+			if (t >= 0.0f && t < best) {
+				best = t;
+				hit = p;
+			}
+		}
+	}
+
+	if (hit >= 0 && tHit)
+		*tHit = best;
+	return hit;
+}
+
+void BVH::overlapPairs(std::vector<int>& pairs) const
+{
+	std::vector<int> hits;
+	for (int p = 0; p < count; p++) {
+		hits.clear();
+		queryBox(glm::vec3(boxes.minX[p], boxes.minY[p], boxes.minZ[p]),
+			glm::vec3(boxes.maxX[p], boxes.maxY[p], boxes.maxZ[p]), hits);
+		for (size_t h = 0; h < hits.size(); h++) {
+			if (hits[h] > p) {
+				pairs.push_back(p);
+				pairs.push_back(hits[h]);
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+
+void bvhBenchmark()
+{
+	// the default camera looking at a pool that grows with the crowd
+	glm::mat4 vp = glm::perspective(glm::radians(65.0f), 1.0f, 0.1f, 100.0f) *
+		glm::lookAt(glm::vec3(0, 0, 6), glm::vec3(0.2, 0, 0), glm::vec3(0, 1, 0));
+	Frustum f = frustumFromMatrix(vp);
+
+	const int Queries = 1000;
+	std::mt19937 rng(1234);
+
+	printf("%8s %9s %9s %10s %10s %8s %10s %10s\n", "swimmers", "build ms", "refit ms",
+		"frustum ms", "linear ms", "visible", "ray us", "box us");
+
+	for (int n = 1024; n <= (1 << 20); n *= 4) {
+		// same lane layout as the crowd, each box about one swimmer
+		std::vector<float> lo[3], hi[3];
+		for (int a = 0; a < 3; a++) {
+			lo[a].resize(n);
+			hi[a].resize(n);
+		}
+		int lanes = int(std::ceil(std::sqrt(float(n))));
+		for (int i = 0; i < n; i++) {
+			float x = (i / lanes) * 7.0f, z = -(i % lanes) * 3.0f;
+			lo[0][i] = x - 2.2f; hi[0][i] = x + 2.2f;
+			lo[1][i] = -1.6f; hi[1][i] = 1.6f;
+			lo[2][i] = z - 1.6f; hi[2][i] = z + 1.6f;
+		}
+		BVH::Boxes boxes = { &lo[0][0], &lo[1][0], &lo[2][0], &hi[0][0], &hi[1][0], &hi[2][0] };
+
+		BVH bvh;
+		Clock::time_point t = Clock::now();
+		bvh.build(boxes, n);
+		double buildMs = msSince(t);
+
+		for (int i = 0; i < n; i++) {
+			lo[1][i] += 0.1f;
+			hi[1][i] += 0.1f;
+		}
+		t = Clock::now();
+		bvh.refit(boxes);
+		double refitMs = msSince(t);
+
+		std::vector<int> hits;
+		std::vector<unsigned char> results;
+		t = Clock::now();
+		bvh.queryFrustum(f, hits, results);
+		double frustumMs = msSince(t);
+
+		std::vector<unsigned char> linear(n);
+		t = Clock::now();
+		cullBoxes(f, &lo[0][0], &lo[1][0], &lo[2][0], &hi[0][0], &hi[1][0], &hi[2][0], n, &linear[0]);
+		double linearMs = msSince(t);
+
+		// rays from the camera at random swimmers, neighbour boxes around them
+		std::uniform_int_distribution<int> pick(0, n - 1);
+		glm::vec3 eye(0, 0, 6);
+		t = Clock::now();
+		int rayHits = 0;
+		for (int q = 0; q < Queries; q++) {
+			int p = pick(rng);
+			glm::vec3 target((lo[0][p] + hi[0][p]) * 0.5f, 0.0f, (lo[2][p] + hi[2][p]) * 0.5f);
+			float dist;
+			rayHits += bvh.raycast(eye, glm::normalize(target - eye), &dist) >= 0;
+		}
+		double rayUs = msSince(t) * 1000.0 / Queries;
+
+		t = Clock::now();
+		size_t boxHits = 0;
+		for (int q = 0; q < Queries; q++) {
+			int p = pick(rng);
+			hits.clear();
+			bvh.queryBox(glm::vec3(lo[0][p] - 3, lo[1][p], lo[2][p] - 3),
+				glm::vec3(hi[0][p] + 3, hi[1][p], hi[2][p] + 3), hits);
+			boxHits += hits.size();
+		}
+		double boxUs = msSince(t) * 1000.0 / Queries;
+
+		printf("%8d %9.2f %9.2f %10.3f %10.3f %8d %10.2f %10.2f\n", n, buildMs, refitMs,
+			frustumMs, linearMs, int(results.size()), rayUs, boxUs);
+		(void)rayHits;
+		(void)boxHits;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include "frustum.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Bounding volume hierarchy over axis-aligned boxes
+//
+//  Built once by median split; while the boxes only move, refit() updates
+//    the node bounds bottom-up (level by level, in parallel) instead of
+//    rebuilding.  Every node covers a contiguous range of the primitive
+//    order, so a node found fully inside a query emits its range directly.
+//
+
+class BVH {
+public:
+	// boxes as separate min/max arrays, as kept by Crowd; the tree keeps
+	//   the pointers, so the arrays must outlive the queries
+	struct Boxes {
+		const float *minX, *minY, *minZ, *maxX, *maxY, *maxZ;
+	};
+
+	BVH();
+
+	void build(const Boxes& boxes, int count);
+	void refit(const Boxes& boxes);
+
+	// drops the tree, as before the first build; for when the boxes' arrays move
+	void clear();
+
+	// true once refitting has loosened the tree enough that a rebuild pays
+	bool degraded() const;
+
+	int size() const { return count; }
+
+	// box around everything, from the root; empty (lo > hi) before the first build
+	void bounds(glm::vec3& lo, glm::vec3& hi) const;
+
+	// primitives touching the frustum, with CullInside / CullIntersect each
+	void queryFrustum(const Frustum& f, std::vector<int>& hits, std::vector<unsigned char>& results) const;
+
+	// primitives whose box overlaps [lo, hi]
+	void queryBox(const glm::vec3& lo, const glm::vec3& hi, std::vector<int>& hits) const;
+
+	// nearest primitive whose box the ray enters, -1 for none; *t receives the distance
+	int raycast(const glm::vec3& origin, const glm::vec3& dir, float* t) const;
+
+	// all overlapping pairs (i < j)
+	void overlapPairs(std::vector<int>& pairs) const;
+
+private:
+	struct Node {
+		float lo[3], hi[3];
+		int first, count;		// range in prims
+		int left;				// children are left and left + 1; -1 for a leaf
+	};
+
+	void fitRange(Node& n) const;
+	float totalArea() const;
+
+	std::vector<Node> nodes;
+	std::vector<int> prims;					// primitive indices in tree order
+	std::vector<std::vector<int> > levels;	// node indices by depth, for refit
+	Boxes boxes;							// from the last build or refit
+	int count;
+	float builtArea;						// summed node surface area right after build
+};
+
+// build/refit/query timings over growing crowds, for --bench bvh
+void bvhBenchmark();
+
+#endif // _BVH_H_
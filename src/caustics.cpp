@@ -0,0 +1,330 @@
+//
+// Animated caustics texture, see caustics.h
+//
+
+#include "caustics.h"
+#include "hud.h"
+#include "jobs.h"
+#include "simd.h"
+#include "uploads.h"
+#include "timing.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/noise.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+const int NumOctaves = 2;
+const int octaveCells[NumOctaves] = { 8, 16 };			// per side; every cell a multiple of 4 texels wide
+const float octaveWeights[NumOctaves] = { 0.65f, 0.35f };
+const float octaveSpeeds[NumOctaves] = { 0.25f, 0.4f };	// of the feature points' wander
+const float Wander = 0.15f;				// of a cell, how far a feature point strays
+const float LineWidth = 0.12f;			// F2 - F1, in cells, where the light has faded out
+const int NumLevels = 10;				// 512 down to 1
+
+//----------------------------------------------------------------------------
+
+// feature points of one octave, in texels, cell (i, j) at [j * cells + i]
+struct Octave {
+	int cells;
+	float cellTexels;
+	std::vector<float> x, y;
+};
+
+static Octave octaves[NumOctaves];
+
+static unsigned
+hashCell(int i, int j, int seed)
+{
+	unsigned h = unsigned(i) * 73856093u ^ unsigned(j) * 19349663u ^ unsigned(seed + 1) * 83492791u;
+	h ^= h >> 13;
+	h *= 0x5bd1e995u;
+	return h ^ (h >> 15);
+}
+
+// A fixed jitter per cell, plus a slow wander on simplex noise through time.
+//   Points stay well inside their cells, so the nearest two are always
+//   among the 3x3 cells around a texel.
+static void
+placePoints(Octave& o, int cells, float t, float speed, int seed)
+{
+	o.cells = cells;
+	o.cellTexels = float(CausticsSize) / cells;
+	o.x.resize(cells * cells);
+	o.y.resize(cells * cells);
+	for (int j = 0; j < cells; j++) {
+		for (int i = 0; i < cells; i++) {
+			unsigned h = hashCell(i, j, seed);
+			glm::vec3 q(i * 0.9f + seed * 7.1f, j * 0.9f, t * speed);
+			float fx = 0.3f + 0.4f * (h & 0xffff) / 65535.0f + Wander * glm::simplex(q);
+			float fy = 0.3f + 0.4f * (h >> 16) / 65535.0f + Wander * glm::simplex(q + glm::vec3(17.3f, 5.1f, 0.0f));
+			o.x[j * cells + i] = (i + fx) * o.cellTexels;
+			o.y[j * cells + i] = (j + fy) * o.cellTexels;
+		}
+	}
+}
+
+// feature point of cell (ci + di, cj + dj), wrapped around the texture
+static inline void
+neighbour(const Octave& o, int ci, int cj, int di, int dj, float& x, float& y)
+{
+	int ni = ci + di, nj = cj + dj;
+	float ox = 0.0f, oy = 0.0f;
+	if (ni < 0) { ni += o.cells; ox = -float(CausticsSize); }
+	else if (ni >= o.cells) { ni -= o.cells; ox = float(CausticsSize); }
+	if (nj < 0) { nj += o.cells; oy = -float(CausticsSize); }
+	else if (nj >= o.cells) { nj -= o.cells; oy = float(CausticsSize); }
+	x = o.x[nj * o.cells + ni] + ox;
+	y = o.y[nj * o.cells + ni] + oy;
+}
+
+// the four texels from (x, y), x a multiple of 4
+static void
+shadeGroup(int x, int y, unsigned char* out, bool simd)
+{
+#ifdef USE_SSE
+	if (simd) {
+		const __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+		const __m128 py = _mm_set1_ps(y + 0.5f), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+		__m128 c = zero;
+		for (int k = 0; k < NumOctaves; k++) {
+			const Octave& o = octaves[k];
+			int ci = int(x / o.cellTexels), cj = int(y / o.cellTexels);
+			__m128 f1 = _mm_set1_ps(FLT_MAX), f2 = f1;
+			for (int dj = -1; dj <= 1; dj++) {
+				for (int di = -1; di <= 1; di++) {
+					float fx, fy;
+					neighbour(o, ci, cj, di, dj, fx, fy);
+					__m128 dx = _mm_sub_ps(px, _mm_set1_ps(fx)), dy = _mm_sub_ps(py, _mm_set1_ps(fy));
+					__m128 d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+					f2 = _mm_min_ps(f2, _mm_max_ps(f1, d));
+					f1 = _mm_min_ps(f1, d);
+				}
+			}
+			__m128 e = _mm_mul_ps(_mm_sub_ps(_mm_sqrt_ps(f2), _mm_sqrt_ps(f1)), _mm_set1_ps(1.0f / (o.cellTexels * LineWidth)));
+			__m128 l = _mm_max_ps(_mm_sub_ps(one, e), zero);
+			c = _mm_add_ps(c, _mm_mul_ps(_mm_set1_ps(octaveWeights[k]), _mm_mul_ps(l, _mm_mul_ps(l, l))));
+		}
+		__m128i v = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(c, one), _mm_set1_ps(255.0f)));
+		v = _mm_packus_epi16(_mm_packs_epi32(v, v), v);
+		int packed = _mm_cvtsi128_si32(v);
+		memcpy(out, &packed, 4);
+		return;
+	}
+#endif
+	for (int lane = 0; lane < 4; lane++) {
+		float px = x + lane + 0.5f, py = y + 0.5f, c = 0.0f;
+		for (int k = 0; k < NumOctaves; k++) {
+			const Octave& o = octaves[k];
+			int ci = int(x / o.cellTexels), cj = int(y / o.cellTexels);
+			float f1 = FLT_MAX, f2 = FLT_MAX;
+			for (int dj = -1; dj <= 1; dj++) {
+				for (int di = -1; di <= 1; di++) {
+					float fx, fy;
+					neighbour(o, ci, cj, di, dj, fx, fy);
+					float d = (px - fx) * (px - fx) + (py - fy) * (py - fy);
+					f2 = std::min(f2, std::max(f1, d));
+					f1 = std::min(f1, d);
+				}
+			}
+			float l = std::max(1.0f - (std::sqrt(f2) - std::sqrt(f1)) * (1.0f / (o.cellTexels * LineWidth)), 0.0f);
+			c += octaveWeights[k] * l * l * l;
+		}
+		out[lane] = (unsigned char)std::lrint(std::min(c, 1.0f) * 255.0f);		// half to even, as _mm_cvtps_epi32
+	}
+}
+
+void generateCaustics(unsigned char* out, float t, bool simd)
+{
+	for (int k = 0; k < NumOctaves; k++)
+		placePoints(octaves[k], octaveCells[k], t, octaveSpeeds[k], k);
+
+	// texels only read the feature points, so tiles are independent
+	const int tiles = CausticsSize / CausticsTile;
+	parallelFor(tiles * tiles, 1, [&](int begin, int end) {
+		for (int tile = begin; tile < end; tile++) {
+			int x0 = (tile % tiles) * CausticsTile, y0 = (tile / tiles) * CausticsTile;
+			for (int y = y0; y < y0 + CausticsTile; y++) {
+				for (int x = x0; x < x0 + CausticsTile; x += 4)
+					shadeGroup(x, y, out + size_t(y) * CausticsSize + x, simd);
+			}
+		}
+	});
+}
+
+//----------------------------------------------------------------------------
+
+static int
+levelSide(int level)
+{
+	return CausticsSize >> level;
+}
+
+static size_t
+levelOffset(int level)
+{
+	size_t offset = 0;
+	for (int l = 0; l < level; l++)
+		offset += size_t(levelSide(l)) * levelSide(l);
+	return offset;
+}
+
+// levels 1 and down from level 0, each the 2x2 average of the one above
+static void
+buildMips(unsigned char* chain)
+{
+	for (int l = 1; l < NumLevels; l++) {
+		const unsigned char* src = chain + levelOffset(l - 1);
+		unsigned char* dst = chain + levelOffset(l);
+		int side = levelSide(l), srcSide = levelSide(l - 1);
+		for (int y = 0; y < side; y++) {
+			const unsigned char* r0 = src + size_t(2 * y) * srcSide;
+			const unsigned char* r1 = r0 + srcSide;
+			for (int x = 0; x < side; x++)
+				dst[size_t(y) * side + x] = (unsigned char)((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+		}
+	}
+}
+
+// FNV-1a
+static unsigned long long
+hashBytes(const unsigned char* p, size_t n)
+{
+	unsigned long long h = 14695981039346656037ull;
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ p[i]) * 1099511628211ull;
+	return h;
+}
+
+//----------------------------------------------------------------------------
+
+static GLuint causticsTex;
+static std::vector<unsigned char> chain;			// every level, level 0 first
+static unsigned long long uploadedHashes[NumLevels];
+static float lastTime = -1.0f;
+static float lastMs;								// to generate and upload the last pattern
+static int lastLevels;								// and the levels it uploaded
+
+void causticsInit()
+{
+	chain.resize(levelOffset(NumLevels));
+
+	glGenTextures(1, &causticsTex);
+	glState.activeTexture(GL_TEXTURE0);
+	glState.bindTexture(GL_TEXTURE_2D, causticsTex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int l = 0; l < NumLevels; l++)
+		glTexImage2D(GL_TEXTURE_2D, l, GL_R8, levelSide(l), levelSide(l), 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, NumLevels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+void causticsUpdate(float t)
+{
+	frameStats.causticsMs = lastMs;
+	frameStats.causticsLevels = lastLevels;
+	if (lastTime >= 0.0f && t >= lastTime && t - lastTime < 1.0f / CausticsRate)
+		return;
+	lastTime = t;
+	Clock::time_point start = Clock::now();
+
+	generateCaustics(&chain[0], t, true);
+	buildMips(&chain[0]);
+
+	int changed[NumLevels], count = 0;
+	unsigned long long hashes[NumLevels];
+	size_t bytes = 0;
+	for (int l = 0; l < NumLevels; l++) {
+		size_t size = size_t(levelSide(l)) * levelSide(l);
+		hashes[l] = hashBytes(&chain[levelOffset(l)], size);
+		if (hashes[l] != uploadedHashes[l]) {
+			changed[count++] = l;
+			bytes += size;
+		}
+	}
+
+	// Packed into the upload ring by the job threads and transferred from
+	//   there when the GPU gets to it; with no room this time, the levels
+	//   still differ from the texture and go up with the next pattern.
+	UploadRing::Staging s;
+	if (count > 0 && uploadRing.stage(bytes, s)) {
+		size_t offset = 0;
+		for (int k = 0; k < count; k++) {
+			size_t size = size_t(levelSide(changed[k])) * levelSide(changed[k]);
+			uploadRing.fill(s, offset, &chain[levelOffset(changed[k])], size);
+			offset += size;
+		}
+		uploadRing.commit(s);
+
+		offset = 0;
+		for (int k = 0; k < count; k++) {
+			int side = levelSide(changed[k]);
+			uploadRing.copyToTexture(s, offset, causticsTex, changed[k], side, side, GL_RED, GL_UNSIGNED_BYTE);
+			uploadedHashes[changed[k]] = hashes[changed[k]];
+			offset += size_t(side) * side;
+		}
+	}
+	else {
+		count = 0;
+	}
+
+	lastMs = float(msSince(start));
+	lastLevels = count;
+	frameStats.causticsMs = lastMs;
+	frameStats.causticsLevels = lastLevels;
+}
+
+GLuint causticsTexture()
+{
+	return causticsTex;
+}
+
+//----------------------------------------------------------------------------
+
+void causticsBenchmark()
+{
+	const int Reps = 20;
+
+	std::vector<int> threadCounts;
+	for (int t = 1; t < jobThreads(); t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(jobThreads());
+
+	std::vector<unsigned char> levels(levelOffset(NumLevels));
+	printf("%10s %14s %10s\n", "threads", "ms per tile", "Mtexel/s");
+
+	// scalar on one thread first, then SSE
+	for (int r = -1; r < int(threadCounts.size()); r++) {
+		setJobThreads(r < 0 ? 1 : threadCounts[r]);
+		Clock::time_point start = Clock::now();
+		for (int k = 0; k < Reps; k++)
+			generateCaustics(&levels[0], k / CausticsRate, r >= 0);
+		double ms = msSince(start) / Reps;
+
+		char label[16];
+		if (r < 0)
+			snprintf(label, sizeof(label), "1 scalar");
+		else
+			snprintf(label, sizeof(label), "%d", threadCounts[r]);
+		printf("%10s %14.3f %10.1f\n", label, ms, double(CausticsSize) * CausticsSize / (ms * 1000.0));
+	}
+	setJobThreads(0);
+
+	// the rest of an update, on the calling thread
+	volatile unsigned long long sink = 0;
+	Clock::time_point start = Clock::now();
+	for (int k = 0; k < Reps; k++) {
+		buildMips(&levels[0]);
+		for (int l = 0; l < NumLevels; l++)
+			sink = sink ^ hashBytes(&levels[levelOffset(l)], size_t(levelSide(l)) * levelSide(l));
+	}
+	printf("mips and change hashes: %.3f ms per tile\n", msSince(start) / Reps);
+}
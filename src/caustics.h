@@ -0,0 +1,49 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _CAUSTICS_H_
+#define _CAUSTICS_H_
+
+#include "cube.h"
+
+//----------------------------------------------------------------------------
+//
+//  Animated caustics texture
+//
+//  A tileable pattern of bright lines generated on the CPU: two octaves of
+//    Worley noise, lit where the nearest two feature points are almost
+//    equally far (F2 - F1 small), which traces the cell borders the way
+//    focused light webs a pool floor.  Each cell's feature point wanders
+//    on glm::simplex noise over time, and the cells wrap around the
+//    texture's edges so it repeats seamlessly.
+//
+//  The CausticsSize^2 texture is cut into CausticsTile^2 tiles spread over
+//    the job threads, four texels at a time with SSE (a cell is a multiple
+//    of four texels wide, so the four share their neighbour cells).  The
+//    mip chain goes up through the upload ring, so the upload does not
+//    wait on the GPU; levels whose bytes did not change since the last
+//    upload (the coarse ones, which average out to the same grey) are
+//    skipped.
+//
+
+const int CausticsSize = 512;			// texels per side of level 0
+const int CausticsTile = 64;			// texels per side of a thread's tile
+const float CausticsRate = 30.0f;		// regenerations per second
+const float CausticsPeriod = 6.0f;		// world units per repeat of the texture
+
+void causticsInit();
+
+// regenerates and uploads the pattern for time t (seconds) if it is due
+void causticsUpdate(float t);
+
+// R8, mipmapped, repeating
+GLuint causticsTexture();
+
+// level 0 at time t into out (CausticsSize^2 bytes), for --bench caustics
+void generateCaustics(unsigned char* out, float t, bool simd);
+
+// per 512^2 tile: scalar vs SSE and thread count, and mips, for --bench caustics
+void causticsBenchmark();
+
+#endif // _CAUSTICS_H_
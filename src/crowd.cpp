@@ -0,0 +1,78 @@
+//
+// Swimmer crowd, see crowd.h
+//
+
+#include "crowd.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <cmath>
+
+Crowd crowd;
+BVH crowdBvh;
+
+const float RowSpacing = 7.0f;		// along x, head to toe plus a gap
+
+//----------------------------------------------------------------------------
+
+void crowdLayout(int count)
+{
+	if (count < 1)
+		count = 1;
+	if (count > MaxCrowd)
+		count = MaxCrowd;
+
+	crowd.x.resize(count); crowd.y.resize(count); crowd.z.resize(count);
+	crowd.heading.resize(count);
+	crowd.vx.resize(count); crowd.vy.resize(count); crowd.vz.resize(count);
+	crowd.yawRate.resize(count);
+	crowd.material.resize(count);
+	crowd.rig.resize(count);
+	crowd.lod.resize(count);
+	crowd.minX.resize(count); crowd.minY.resize(count); crowd.minZ.resize(count);
+	crowd.maxX.resize(count); crowd.maxY.resize(count); crowd.maxZ.resize(count);
+	crowdBvh.clear();		// its box pointers may have moved with the resize
+
+	// a roughly square block of lanes running away from the camera
+	int lanes = int(std::ceil(std::sqrt(float(count))));
+	for (int i = 0; i < count; i++) {
+		crowd.x[i] = (i / lanes) * RowSpacing;
+		crowd.y[i] = 0.0f;
+		crowd.z[i] = -(i % lanes) * LaneWidth;
+		crowd.heading[i] = 0.0f;
+		crowd.vx[i] = crowd.vy[i] = crowd.vz[i] = 0.0f;
+		crowd.yawRate[i] = 0.0f;
+		crowd.material[i] = 0;
+		crowd.rig[i] = (unsigned short)i;
+	}
+}
+
+//----------------------------------------------------------------------------
+
+glm::mat4 swimmerBasis(int i)
+{
+	glm::mat4 basis = glm::translate(glm::mat4(1.0f), glm::vec3(crowd.x[i], crowd.y[i], crowd.z[i]));
+	return glm::rotate(basis, crowd.heading[i], glm::vec3(0, 1, 0));
+}
+
+//----------------------------------------------------------------------------
+
+void crowdUpdateBounds(const glm::vec3& localMin, const glm::vec3& localMax)
+{
+	glm::vec3 c = (localMin + localMax) * 0.5f;
+	glm::vec3 e = (localMax - localMin) * 0.5f;
+
+	for (int i = 0; i < crowd.size(); i++) {
+		// rotating about y only mixes x and z
+		float s = std::sin(crowd.heading[i]), co = std::cos(crowd.heading[i]);
+		float as = std::fabs(s), ac = std::fabs(co);
+		float wx = crowd.x[i] + co * c.x + s * c.z;
+		float wy = crowd.y[i] + c.y;
+		float wz = crowd.z[i] - s * c.x + co * c.z;
+		float ex = ac * e.x + as * e.z;
+		float ez = as * e.x + ac * e.z;
+
+		crowd.minX[i] = wx - ex; crowd.maxX[i] = wx + ex;
+		crowd.minY[i] = wy - e.y; crowd.maxY[i] = wy + e.y;
+		crowd.minZ[i] = wz - ez; crowd.maxZ[i] = wz + ez;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _CROWD_H_
+#define _CROWD_H_
+
+#include "bvh.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  The swimmers in the scene, one entry per swimmer in separate arrays
+//    (structure of arrays) so batched passes can stream over one field.
+//
+//  Swimmer 0 sits at the origin facing -x, where the single swimmer used to
+//    be; the rest fill lanes behind it.
+//
+
+struct Crowd {
+	std::vector<float> x, y, z;				// base position
+	std::vector<float> heading;				// rotation about +y, radians
+	std::vector<float> vx, vy, vz;			// velocity, when the physics moves them
+	std::vector<float> yawRate;				// radians per second
+	std::vector<unsigned short> material;
+	std::vector<unsigned short> rig;		// rig variant, taken modulo swimmerRigCount()
+	std::vector<unsigned char> lod;			// LodLevel, kept between frames for hysteresis
+
+	// world AABB of each swimmer, refreshed by crowdUpdateBounds()
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+	int size() const { return int(x.size()); }
+};
+
+extern Crowd crowd;
+
+// over the crowd's AABBs, refitted every frame; it points into the arrays
+//   above, so crowdLayout() clears it until the next build
+extern BVH crowdBvh;
+
+const int MaxCrowd = 1 << 16;
+
+const float LaneWidth = 3.0f;		// along z
+
+void crowdLayout(int count);
+
+// translate(x, y, z) * rotate(heading, +y)
+glm::mat4 swimmerBasis(int i);
+
+// world bounds of every swimmer from the current pose's local bounds
+void crowdUpdateBounds(const glm::vec3& localMin, const glm::vec3& localMax);
+
+#endif // _CROWD_H_
@@ -44,6 +44,22 @@
 //  Helper function to load vertex and fragment shader files
 GLuint InitShader(const char* vertexShaderFile, const char* fragmentShaderFile);
 
+//  Reads a whole shader file into a NUL-terminated buffer (delete [] it),
+//    or returns NULL if it cannot be read
+char* readShaderSource(const char* shaderFile);
+
+//  The source after its #version line, which must stay first when other
+//    text is spliced in front of the rest; all of it if it has none
+const char* shaderBody(const char* source);
+
+//  Creates a shader of type from n concatenated parts and starts compiling
+//    it; the status is left for shaderCompiled(), so compiles can overlap
+GLuint compileShaderSource(GLenum type, const char* const* parts, int n);
+
+//  Whether the compile or link succeeded; if not, prints name and the log
+bool shaderCompiled(GLuint shader, const char* name);
+bool programLinked(GLuint program, const char* name);
+
 //  Defined constant for when numbers are too small to be used in the
 //    denominator of a division operation.  This is only used if the
 //    DEBUG macro is defined.
@@ -54,6 +70,14 @@ const GLfloat  DivideByZeroTolerance = GLfloat(1.0e-07);
 
 //#include "CheckError.h"
 
+//  Define GL_COUNT_CALLS (the Debug configuration does) to count GL calls,
+//    bytes and redundant state changes per frame.  See glcount.h.
+//#define GL_COUNT_CALLS
+#include "glcount.h"
+
+//  Shadowed GL state; bind through glState rather than calling GL directly
+#include "glstate.h"
+
 // #define Print(x)  do { std::cerr << #x " = " << (x) << std::endl; } while(0)
 
 
@@ -0,0 +1,186 @@
+//
+// Inverse 2D FFT, see fft.h
+//
+// Decimation in time: rows are put in bit-reversed order, then each stage
+//   combines pairs half a span apart, b' = a - w b and a' = a + w b.
+//
+
+#include "fft.h"
+#include "jobs.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int StripWidth = 16;		// columns per strip: one cache line of floats
+
+//----------------------------------------------------------------------------
+
+void FFT2D::init(int size)
+{
+	n = size;
+	int bits = 0;
+	while ((1 << bits) < n)
+		bits++;
+
+	twRe.resize(n / 2);
+	twIm.resize(n / 2);
+	for (int k = 0; k < n / 2; k++) {
+		double a = 2.0 * 3.14159265358979323846 * k / n;
+		twRe[k] = float(std::cos(a));
+		twIm[k] = float(std::sin(a));
+	}
+
+	rev.resize(n);
+	for (int i = 0; i < n; i++) {
+		int r = 0;
+		for (int b = 0; b < bits; b++)
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		rev[i] = r;
+	}
+}
+
+//----------------------------------------------------------------------------
+
+#ifdef USE_SSE
+
+static inline __m128 ld(const float* p) { return _mm_loadu_ps(p); }
+static inline void st(float* p, __m128 v) { _mm_storeu_ps(p, v); }
+
+#endif
+
+void FFT2D::columns(float* re, float* im, int x0, int x1) const
+{
+#ifdef USE_SSE
+	for (int x = x0; x < x1; x += StripWidth) {
+		float* r = re + x;
+		float* m = im + x;
+
+		for (int i = 0; i < n; i++) {
+			int j = rev[i];
+			if (j > i) {
+				std::swap_ranges(r + i * n, r + i * n + StripWidth, r + j * n);
+				std::swap_ranges(m + i * n, m + i * n + StripWidth, m + j * n);
+			}
+		}
+
+		// stages with spans 1 and 2: b1 and b3 take +-i * (a2 - a3)
+		for (int i = 0; i < n; i += 4) {
+			float *r0 = r + i * n, *r1 = r0 + n, *r2 = r1 + n, *r3 = r2 + n;
+			float *m0 = m + i * n, *m1 = m0 + n, *m2 = m1 + n, *m3 = m2 + n;
+			for (int c = 0; c < StripWidth; c += 4) {
+				__m128 a0r = ld(r0 + c), a1r = ld(r1 + c), a2r = ld(r2 + c), a3r = ld(r3 + c);
+				__m128 a0i = ld(m0 + c), a1i = ld(m1 + c), a2i = ld(m2 + c), a3i = ld(m3 + c);
+				__m128 s01r = _mm_add_ps(a0r, a1r), s01i = _mm_add_ps(a0i, a1i);
+				__m128 d01r = _mm_sub_ps(a0r, a1r), d01i = _mm_sub_ps(a0i, a1i);
+				__m128 s23r = _mm_add_ps(a2r, a3r), s23i = _mm_add_ps(a2i, a3i);
+				__m128 d23r = _mm_sub_ps(a2r, a3r), d23i = _mm_sub_ps(a2i, a3i);
+				st(r0 + c, _mm_add_ps(s01r, s23r)); st(m0 + c, _mm_add_ps(s01i, s23i));
+				st(r2 + c, _mm_sub_ps(s01r, s23r)); st(m2 + c, _mm_sub_ps(s01i, s23i));
+				st(r1 + c, _mm_sub_ps(d01r, d23i)); st(m1 + c, _mm_add_ps(d01i, d23r));
+				st(r3 + c, _mm_add_ps(d01r, d23i)); st(m3 + c, _mm_sub_ps(d01i, d23r));
+			}
+		}
+
+		for (int half = 4; half < n; half *= 2) {
+			int step = n / (2 * half);
+			for (int base = 0; base < n; base += 2 * half) {
+				for (int j = 0; j < half; j++) {
+					__m128 wr = _mm_set1_ps(twRe[j * step]), wi = _mm_set1_ps(twIm[j * step]);
+					float *ar = r + (base + j) * n, *br = ar + half * n;
+					float *ai = m + (base + j) * n, *bi = ai + half * n;
+					for (int c = 0; c < StripWidth; c += 4) {
+						__m128 Br = ld(br + c), Bi = ld(bi + c);
+						__m128 tr = _mm_sub_ps(_mm_mul_ps(Br, wr), _mm_mul_ps(Bi, wi));
+						__m128 ti = _mm_add_ps(_mm_mul_ps(Br, wi), _mm_mul_ps(Bi, wr));
+						__m128 Ar = ld(ar + c), Ai = ld(ai + c);
+						st(ar + c, _mm_add_ps(Ar, tr)); st(ai + c, _mm_add_ps(Ai, ti));
+						st(br + c, _mm_sub_ps(Ar, tr)); st(bi + c, _mm_sub_ps(Ai, ti));
+					}
+				}
+			}
+		}
+	}
+#else
+	for (int x = x0; x < x1; x++)
+		columnsScalar(re, im, x);
+#endif
+}
+
+void FFT2D::columnsScalar(float* re, float* im, int x) const
+{
+	float* r = re + x;
+	float* m = im + x;
+
+	for (int i = 0; i < n; i++) {
+		int j = rev[i];
+		if (j > i) {
+			std::swap(r[i * n], r[j * n]);
+			std::swap(m[i * n], m[j * n]);
+		}
+	}
+
+	for (int half = 1; half < n; half *= 2) {
+		int step = n / (2 * half);
+		for (int base = 0; base < n; base += 2 * half) {
+			for (int j = 0; j < half; j++) {
+				float wr = twRe[j * step], wi = twIm[j * step];
+				int a = (base + j) * n, b = a + half * n;
+				float tr = r[b] * wr - m[b] * wi;
+				float ti = r[b] * wi + m[b] * wr;
+				r[b] = r[a] - tr; m[b] = m[a] - ti;
+				r[a] += tr; m[a] += ti;
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+
+void FFT2D::inverse(float* re, float* im) const
+{
+	int strips = n / StripWidth;
+	for (int pass = 0; pass < 2; pass++) {
+		parallelFor(strips, 2, [&](int begin, int end) {
+			columns(re, im, begin * StripWidth, end * StripWidth);
+		});
+		transposeSquare(re, n);
+		transposeSquare(im, n);
+	}
+}
+
+void FFT2D::inverseScalar(float* re, float* im) const
+{
+	for (int pass = 0; pass < 2; pass++) {
+		for (int x = 0; x < n; x++)
+			columnsScalar(re, im, x);
+
+		for (int i = 0; i < n; i++) {
+			for (int j = i + 1; j < n; j++) {
+				std::swap(re[i * n + j], re[j * n + i]);
+				std::swap(im[i * n + j], im[j * n + i]);
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+
+void transposeSquare(float* a, int n)
+{
+	const int B = 16;
+	int blocks = (n + B - 1) / B;
+
+	// block row bi swaps its tiles right of the diagonal with those below it
+	parallelFor(blocks, 1, [&](int begin, int end) {
+		for (int bi = begin; bi < end; bi++) {
+			for (int bj = bi; bj < blocks; bj++) {
+				int iEnd = std::min(bi * B + B, n), jEnd = std::min(bj * B + B, n);
+				for (int i = bi * B; i < iEnd; i++) {
+					for (int j = bi == bj ? i + 1 : bj * B; j < jEnd; j++)
+						std::swap(a[i * n + j], a[j * n + i]);
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _FFT_H_
+#define _FFT_H_
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Inverse 2D FFT of square power-of-two grids
+//
+//  Grids are row major with the real and imaginary parts in separate arrays.
+//    Columns are transformed sixteen at a time, each SSE lane a different
+//    column, so no butterfly needs a shuffle; rows are done as columns
+//    between two transposes.  The first two stages run as one radix-4 pass
+//    (twiddles 1 and i need no multiplies), the rest as radix-2.
+//
+//  Sign convention is e^{+ikx} with no 1/n scaling, as the ocean spectrum
+//    sums want.
+//
+
+class FFT2D {
+public:
+	FFT2D() : n(0) {}
+
+	void init(int size);				// size a power of two, at least 16
+	int size() const { return n; }
+
+	// in place, strips of columns spread over the job threads
+	void inverse(float* re, float* im) const;
+
+	// the same in plain scalar code on the calling thread, for comparison
+	void inverseScalar(float* re, float* im) const;
+
+private:
+	void columns(float* re, float* im, int x0, int x1) const;
+	void columnsScalar(float* re, float* im, int x) const;
+
+	int n;
+	std::vector<float> twRe, twIm;		// e^{+2 pi i k / n}, k < n/2
+	std::vector<int> rev;				// bit-reversed row order
+};
+
+// in place, blocked, over the job threads
+void transposeSquare(float* a, int n);
+
+#endif // _FFT_H_
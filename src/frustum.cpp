@@ -0,0 +1,103 @@
+//
+// View-frustum tests, see frustum.h
+//
+// Boxes are tested in center/half-extent form: the box is outside a plane
+//   when the center is further behind it than the extent projected on the
+//   plane normal, which is the same test as a sphere with that radius.
+//
+
+#include "frustum.h"
+#include "simd.h"
+
+#include <cmath>
+
+//----------------------------------------------------------------------------
+
+Frustum frustumFromMatrix(const glm::mat4& m)
+{
+	// rows of m; glm is column major
+	glm::vec4 r0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 r1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 r2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 r3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	Frustum f;
+	f.planes[0] = r3 + r0;		// left
+	f.planes[1] = r3 - r0;		// right
+	f.planes[2] = r3 + r1;		// bottom
+	f.planes[3] = r3 - r1;		// top
+	f.planes[4] = r3 + r2;		// near
+	f.planes[5] = r3 - r2;		// far
+	for (int p = 0; p < 6; p++)
+		f.planes[p] /= glm::length(glm::vec3(f.planes[p]));
+	return f;
+}
+
+//----------------------------------------------------------------------------
+
+#ifdef USE_SSE
+
+// writes the CullResult of four lanes from their outside/inside masks
+static inline void
+store(__m128 outside, __m128 inside, unsigned char* result)
+{
+	int out = _mm_movemask_ps(outside), in = _mm_movemask_ps(inside);
+	for (int k = 0; k < 4; k++)
+		result[k] = (out >> k) & 1 ? CullOutside : (in >> k) & 1 ? CullInside : CullIntersect;
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+
+void cullBoxes(const Frustum& f, const float* minX, const float* minY, const float* minZ,
+	const float* maxX, const float* maxY, const float* maxZ, int n, unsigned char* result)
+{
+	int i = 0;
+
+#ifdef USE_SSE
+	const __m128 half = _mm_set1_ps(0.5f);
+	for (; i + 4 <= n; i += 4) {
+		__m128 lo = _mm_loadu_ps(minX + i), hi = _mm_loadu_ps(maxX + i);
+		__m128 cx = _mm_mul_ps(_mm_add_ps(lo, hi), half), ex = _mm_mul_ps(_mm_sub_ps(hi, lo), half);
+		lo = _mm_loadu_ps(minY + i); hi = _mm_loadu_ps(maxY + i);
+		__m128 cy = _mm_mul_ps(_mm_add_ps(lo, hi), half), ey = _mm_mul_ps(_mm_sub_ps(hi, lo), half);
+		lo = _mm_loadu_ps(minZ + i); hi = _mm_loadu_ps(maxZ + i);
+		__m128 cz = _mm_mul_ps(_mm_add_ps(lo, hi), half), ez = _mm_mul_ps(_mm_sub_ps(hi, lo), half);
+
+		__m128 outside = _mm_setzero_ps();
+		__m128 inside = _mm_cmpeq_ps(cx, cx);
+
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& pl = f.planes[p];
+			__m128 d = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl.x), cx), _mm_mul_ps(_mm_set1_ps(pl.y), cy)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl.z), cz), _mm_set1_ps(pl.w)));
+			__m128 r = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(pl.x)), ex), _mm_mul_ps(_mm_set1_ps(std::fabs(pl.y)), ey)),
+				_mm_mul_ps(_mm_set1_ps(std::fabs(pl.z)), ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_sub_ps(_mm_setzero_ps(), r)));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, r));
+		}
+		store(outside, inside, result + i);
+	}
+#endif
+
+	for (; i < n; i++) {
+		float cx = (minX[i] + maxX[i]) * 0.5f, ex = (maxX[i] - minX[i]) * 0.5f;
+		float cy = (minY[i] + maxY[i]) * 0.5f, ey = (maxY[i] - minY[i]) * 0.5f;
+		float cz = (minZ[i] + maxZ[i]) * 0.5f, ez = (maxZ[i] - minZ[i]) * 0.5f;
+
+		unsigned char r = CullInside;
+		for (int p = 0; p < 6 && r != CullOutside; p++) {
+			const glm::vec4& pl = f.planes[p];
+			float d = pl.x * cx + pl.y * cy + pl.z * cz + pl.w;
+			float e = std::fabs(pl.x) * ex + std::fabs(pl.y) * ey + std::fabs(pl.z) * ez;
+			if (d < -e)
+				r = CullOutside;
+			else if (d < e)
+				r = CullIntersect;
+		}
+		result[i] = r;
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include "glm/glm.hpp"
+
+//----------------------------------------------------------------------------
+//
+//  View-frustum tests
+//
+//  Bounds are passed as separate arrays (x[], y[], z[], ...) and tested four
+//    at a time with SSE.  Each result is one of the CullResult values.
+//
+
+enum CullResult {
+	CullOutside = 0,
+	CullIntersect = 1,		// partly inside, worth testing the pieces
+	CullInside = 2
+};
+
+struct Frustum {
+	glm::vec4 planes[6];	// xyz = inward normal, w = offset; inside when dot >= 0
+};
+
+// planes of a projection * view matrix, normalized
+Frustum frustumFromMatrix(const glm::mat4& m);
+
+void cullBoxes(const Frustum& f, const float* minX, const float* minY, const float* minZ,
+	const float* maxX, const float* maxY, const float* maxZ, int n, unsigned char* result);
+
+#endif // _FRUSTUM_H_
@@ -1,10 +1,105 @@
 #version 150
 
+// Swimmer fragment shader, every variant (see shaders.h):
+//   LIT           Blinn-Phong with ambient light and the sun; otherwise
+//                 the vertex color as it is
+//   POINT_LIGHTS  and the point lights listed for this fragment's screen
+//                 tile (see lights.h)
+//   SHADOWS       the sun term dimmed by the cascaded shadow maps (see
+//                 shadows.h)
+
 in  vec4  color;
 out vec4  fColor;
 
+#ifdef LIT
+const int MaxLights = 256;		// as in lights.h
+const float Shininess = 32.0;
+const float Specular = 0.25;
+
+in  vec3  position;
+in  vec3  normal;
+
+layout(std140) uniform Lights {
+    vec4  ambient;
+    vec4  sunDirection;
+    vec4  sunColor;
+    vec4  eyePosition;
+    ivec4 tileGrid;				// tile size, tiles across, tiles down, lights
+    vec4  lightPositions[MaxLights];	// xyz, radius
+    vec4  lightColors[MaxLights];
+};
+
+#ifdef POINT_LIGHTS
+uniform usamplerBuffer tileLights;	// per tile first << 8 | count, then the lists
+#endif
+
+#ifdef SHADOWS
+const int NumCascades = 3;		// as in shadows.h
+
+layout(std140) uniform Shadows {
+    mat4  shadowMatrices[NumCascades];	// world to map coordinates and depth
+    vec4  cascadeEnds;				// view depth where each cascade stops
+    vec4  cameraForward;
+};
+
+uniform sampler2DArrayShadow shadowMaps;	// one layer per cascade
+
+// how much of the sun reaches position: four compared, bilinear taps
+float sunVisibility()
+{
+    float depth = dot(position - eyePosition.xyz, cameraForward.xyz);
+    if (depth >= cascadeEnds[NumCascades - 1])
+        return 1.0;
+    int c = 0;
+    while (depth >= cascadeEnds[c])
+        c++;
+
+    vec4 p = shadowMatrices[c] * vec4(position, 1.0);
+    vec2 texel = 1.0 / vec2(textureSize(shadowMaps, 0).xy);
+    float lit = 0.0;
+    for (int k = 0; k < 4; k++) {
+        vec2 offset = (vec2(k & 1, k >> 1) - 0.5) * texel;
+        lit += texture(shadowMaps, vec4(p.xy + offset, float(c), p.z));
+    }
+    return lit * 0.25;
+}
+#endif
+
+vec3 shade(vec3 n, vec3 v, vec3 l, vec3 radiance)
+{
+    float diffuse = max(dot(n, l), 0.0);
+    float specular = diffuse > 0.0 ? pow(max(dot(n, normalize(l + v)), 0.0), Shininess) : 0.0;
+    return radiance * (diffuse * color.rgb + Specular * specular);
+}
+#endif
+
 void main() 
 { 
+#ifdef LIT
+    vec3 n = normalize(normal);
+    vec3 v = normalize(eyePosition.xyz - position);
+#ifdef SHADOWS
+    vec3 sun = sunColor.rgb * sunVisibility();
+#else
+    vec3 sun = sunColor.rgb;
+#endif
+    vec3 lit = ambient.rgb * color.rgb + shade(n, v, sunDirection.xyz, sun);
+
+#ifdef POINT_LIGHTS
+    ivec2 tile = ivec2(gl_FragCoord.xy) / max(tileGrid.x, 1);
+    if (tile.x < tileGrid.y && tile.y < tileGrid.z) {
+        uint header = texelFetch(tileLights, tile.y * tileGrid.y + tile.x).r;
+        int first = int(header >> 8u), count = int(header & 255u);
+        for (int k = 0; k < count; k++) {
+            int i = int(texelFetch(tileLights, first + k).r);
+            vec3 d = lightPositions[i].xyz - position;
+            float falloff = clamp(1.0 - dot(d, d) / (lightPositions[i].w * lightPositions[i].w), 0.0, 1.0);
+            lit += shade(n, v, normalize(d), lightColors[i].rgb * falloff * falloff);
+        }
+    }
+#endif
+    fColor = vec4(lit, color.a);
+#else
     fColor = color;
+#endif
 } 
-
@@ -0,0 +1,21 @@
+//
+// Full-screen passes, see fullscreen.h
+//
+
+#include "fullscreen.h"
+
+static GLuint fullscreenVao;
+
+GLuint fullscreenProgram(const char* fragmentFile)
+{
+	return InitShader("src/fullscreen_vshader.glsl", fragmentFile);
+}
+
+void drawFullscreen()
+{
+	// core profile still needs a VAO bound, even with no attributes
+	if (!fullscreenVao)
+		glGenVertexArrays(1, &fullscreenVao);
+	glState.bindVertexArray(fullscreenVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
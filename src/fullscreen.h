@@ -0,0 +1,26 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _FULLSCREEN_H_
+#define _FULLSCREEN_H_
+
+#include "cube.h"
+
+//----------------------------------------------------------------------------
+//
+//  Full-screen passes
+//
+//  fullscreen_vshader.glsl makes one triangle over the viewport from
+//    gl_VertexID, texCoord running 0 to 1 across it; the pass's fragment
+//    shader does the work.  The triangle needs no vertex data, so every
+//    pass shares one empty VAO.
+//
+
+// fullscreen_vshader.glsl linked with fragmentFile, as InitShader()
+GLuint fullscreenProgram(const char* fragmentFile);
+
+// the triangle, with the caller's program, framebuffer, textures and state
+void drawFullscreen();
+
+#endif // _FULLSCREEN_H_
@@ -0,0 +1,13 @@
+#version 150
+
+// One triangle over the whole screen, corners from gl_VertexID; texCoord
+//   runs 0 to 1 across the viewport
+
+out vec2 texCoord;
+
+void main()
+{
+  vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  texCoord = corner;
+  gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
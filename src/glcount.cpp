@@ -0,0 +1,301 @@
+//
+// GL call counting layer, see glcount.h
+//
+// The wrappers shadow just enough state (program, VAO, buffer and texture
+//   bindings, a few capabilities) to tell whether a state change was
+//   redundant.  None of this is compiled unless GL_COUNT_CALLS is defined.
+
+#define GLCOUNT_IMPL
+#include "cube.h"
+
+#ifdef GL_COUNT_CALLS
+
+#include <cstdio>
+#include <cstdlib>
+
+static const char* funcNames[GLC_NumFuncs] = {
+	"glUseProgram", "glBindVertexArray", "glBindBuffer", "glBufferData",
+	"glBufferSubData", "glUniform*", "glUniformMatrix4fv", "glDrawArrays",
+	"glDrawArraysInstanced", "glEnable", "glDisable", "glActiveTexture",
+	"glBindTexture", "glClear", "glDrawElementsInstancedBaseVertex"
+};
+
+const GLuint Unknown = ~0u;		// nothing recorded yet, first set is never redundant
+const int MaxUnits = 16;
+
+static GLCallStats current, lastFrame, total;
+static long long frames;
+static int suspended;
+
+static GLuint boundProgram = Unknown, boundVao = Unknown;
+static GLuint boundArrayBuffer = Unknown, boundElementBuffer = Unknown, boundTexBuffer = Unknown;
+static GLenum activeUnit = Unknown;
+static GLuint bound2D[MaxUnits], boundBufferTex[MaxUnits];
+static int depthTest = -1, blend = -1, cullFace = -1;
+
+//----------------------------------------------------------------------------
+
+static inline void
+registerDump()
+{
+	static bool registered = false;
+	if (!registered) {
+		for (int i = 0; i < MaxUnits; i++)
+			bound2D[i] = boundBufferTex[i] = Unknown;
+		atexit(glcountDump);
+		registered = true;
+	}
+}
+
+static inline bool
+count(GLCountFunc f)
+{
+	registerDump();
+	if (suspended)
+		return false;
+	current.calls++;
+	current.perFunc[f]++;
+	return true;
+}
+
+// records a state change; returns true when it changed nothing
+static inline bool
+stateChange(bool counting, GLuint& shadow, GLuint value)
+{
+	bool same = shadow == value;
+	shadow = value;
+	if (counting) {
+		current.stateChanges++;
+		if (same)
+			current.redundant++;
+	}
+	return same;
+}
+
+static GLuint*
+bufferSlot(GLenum target)
+{
+	switch (target) {
+	case GL_ARRAY_BUFFER:			return &boundArrayBuffer;
+	case GL_ELEMENT_ARRAY_BUFFER:	return &boundElementBuffer;
+	case GL_TEXTURE_BUFFER:			return &boundTexBuffer;
+	}
+	return NULL;
+}
+
+static int*
+capSlot(GLenum cap)
+{
+	switch (cap) {
+	case GL_DEPTH_TEST:	return &depthTest;
+	case GL_BLEND:		return &blend;
+	case GL_CULL_FACE:	return &cullFace;
+	}
+	return NULL;
+}
+
+static void
+setCap(GLCountFunc f, GLenum cap, int on)
+{
+	bool counting = count(f);
+	int* slot = capSlot(cap);
+	if (counting) {
+		current.stateChanges++;
+		if (slot && *slot == on)
+			current.redundant++;
+	}
+	if (slot)
+		*slot = on;
+}
+
+//----------------------------------------------------------------------------
+
+void glcUseProgram(GLuint program)
+{
+	stateChange(count(GLC_UseProgram), boundProgram, program);
+	glUseProgram(program);
+}
+
+void glcBindVertexArray(GLuint array)
+{
+	stateChange(count(GLC_BindVertexArray), boundVao, array);
+	glBindVertexArray(array);
+}
+
+void glcBindBuffer(GLenum target, GLuint buffer)
+{
+	bool counting = count(GLC_BindBuffer);
+	GLuint* slot = bufferSlot(target);
+	if (slot)
+		stateChange(counting, *slot, buffer);
+	else if (counting)
+		current.stateChanges++;
+	glBindBuffer(target, buffer);
+}
+
+void glcBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+	if (count(GLC_BufferData) && data)
+		current.bytes += size;
+	glBufferData(target, size, data, usage);
+}
+
+void glcBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+	if (count(GLC_BufferSubData))
+		current.bytes += size;
+	glBufferSubData(target, offset, size, data);
+}
+
+void glcUniform1i(GLint location, GLint v0)
+{
+	if (count(GLC_Uniform))
+		current.bytes += sizeof(GLint);
+	glUniform1i(location, v0);
+}
+
+void glcUniform1f(GLint location, GLfloat v0)
+{
+	if (count(GLC_Uniform))
+		current.bytes += sizeof(GLfloat);
+	glUniform1f(location, v0);
+}
+
+void glcUniform2f(GLint location, GLfloat v0, GLfloat v1)
+{
+	if (count(GLC_Uniform))
+		current.bytes += 2 * sizeof(GLfloat);
+	glUniform2f(location, v0, v1);
+}
+
+void glcUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+	if (count(GLC_Uniform))
+		current.bytes += 3 * sizeof(GLfloat);
+	glUniform3f(location, v0, v1, v2);
+}
+
+void glcUniformMatrix4fv(GLint location, GLsizei n, GLboolean transpose, const GLfloat* value)
+{
+	if (count(GLC_UniformMatrix4fv))
+		current.bytes += n * 16 * sizeof(GLfloat);
+	glUniformMatrix4fv(location, n, transpose, value);
+}
+
+void glcDrawArrays(GLenum mode, GLint first, GLsizei n)
+{
+	if (count(GLC_DrawArrays)) {
+		current.drawCalls++;
+		current.vertices += n;
+	}
+	glDrawArrays(mode, first, n);
+}
+
+void glcDrawArraysInstanced(GLenum mode, GLint first, GLsizei n, GLsizei primcount)
+{
+	if (count(GLC_DrawArraysInstanced)) {
+		current.drawCalls++;
+		current.vertices += (long long)n * primcount;
+	}
+	glDrawArraysInstanced(mode, first, n, primcount);
+}
+
+void glcDrawElementsInstancedBaseVertex(GLenum mode, GLsizei n, GLenum type, const void* indices,
+	GLsizei primcount, GLint basevertex)
+{
+	if (count(GLC_DrawElementsInstancedBaseVertex)) {
+		current.drawCalls++;
+		current.vertices += (long long)n * primcount;
+	}
+	glDrawElementsInstancedBaseVertex(mode, n, type, indices, primcount, basevertex);
+}
+
+void glcEnable(GLenum cap)
+{
+	setCap(GLC_Enable, cap, 1);
+	glEnable(cap);
+}
+
+void glcDisable(GLenum cap)
+{
+	setCap(GLC_Disable, cap, 0);
+	glDisable(cap);
+}
+
+void glcActiveTexture(GLenum texture)
+{
+	stateChange(count(GLC_ActiveTexture), activeUnit, texture);
+	glActiveTexture(texture);
+}
+
+void glcBindTexture(GLenum target, GLuint texture)
+{
+	bool counting = count(GLC_BindTexture);
+	int unit = activeUnit == Unknown ? 0 : int(activeUnit - GL_TEXTURE0);
+	if (unit >= 0 && unit < MaxUnits && target == GL_TEXTURE_2D)
+		stateChange(counting, bound2D[unit], texture);
+	else if (unit >= 0 && unit < MaxUnits && target == GL_TEXTURE_BUFFER)
+		stateChange(counting, boundBufferTex[unit], texture);
+	else if (counting)
+		current.stateChanges++;
+	glBindTexture(target, texture);
+}
+
+void glcClear(GLbitfield mask)
+{
+	count(GLC_Clear);
+	glClear(mask);
+}
+
+//----------------------------------------------------------------------------
+
+void glcountEndFrame()
+{
+	lastFrame = current;
+
+	total.calls += current.calls;
+	total.drawCalls += current.drawCalls;
+	total.vertices += current.vertices;
+	total.bytes += current.bytes;
+	total.stateChanges += current.stateChanges;
+	total.redundant += current.redundant;
+	for (int i = 0; i < GLC_NumFuncs; i++)
+		total.perFunc[i] += current.perFunc[i];
+	frames++;
+
+	current = GLCallStats();
+}
+
+const GLCallStats& glcountLastFrame()
+{
+	return lastFrame;
+}
+
+void glcountSuspend()
+{
+	suspended++;
+}
+
+void glcountResume()
+{
+	suspended--;
+}
+
+void glcountDump()
+{
+	double n = frames ? double(frames) : 1.0;
+
+	printf("GL call counts over %lld frames (total, per frame)\n", frames);
+	for (int i = 0; i < GLC_NumFuncs; i++) {
+		if (total.perFunc[i])
+			printf("  %-24s %10lld %10.1f\n", funcNames[i], total.perFunc[i], total.perFunc[i] / n);
+	}
+	printf("  %-24s %10lld %10.1f\n", "calls", total.calls, total.calls / n);
+	printf("  %-24s %10lld %10.1f\n", "draw calls", total.drawCalls, total.drawCalls / n);
+	printf("  %-24s %10lld %10.1f\n", "vertices", total.vertices, total.vertices / n);
+	printf("  %-24s %10lld %10.1f\n", "bytes", total.bytes, total.bytes / n);
+	printf("  %-24s %10lld %10.1f\n", "state changes", total.stateChanges, total.stateChanges / n);
+	printf("  %-24s %10lld %10.1f\n", "redundant changes", total.redundant, total.redundant / n);
+}
+
+#endif // GL_COUNT_CALLS
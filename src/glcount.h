@@ -0,0 +1,113 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _GLCOUNT_H_
+#define _GLCOUNT_H_
+
+//----------------------------------------------------------------------------
+//
+//  GL call counting layer
+//
+//  With GL_COUNT_CALLS defined, the GL entry points the app uses are
+//    redirected (by macro, after GLEW has declared them) to thin wrappers
+//    that count calls, bytes sent and state changes that set what was
+//    already set.  Without it none of this exists and the app calls GL
+//    directly; the glcount*() functions below become empty inlines.
+//
+//  cube.h includes this file, so every translation unit is covered.
+//
+
+enum GLCountFunc {
+	GLC_UseProgram, GLC_BindVertexArray, GLC_BindBuffer, GLC_BufferData,
+	GLC_BufferSubData, GLC_Uniform, GLC_UniformMatrix4fv, GLC_DrawArrays,
+	GLC_DrawArraysInstanced, GLC_Enable, GLC_Disable, GLC_ActiveTexture,
+	GLC_BindTexture, GLC_Clear, GLC_DrawElementsInstancedBaseVertex,
+	GLC_NumFuncs
+};
+
+struct GLCallStats {
+	long long calls;				// all wrapped calls
+	long long drawCalls;
+	long long vertices;				// per draw: count * instances
+	long long bytes;				// buffer data + uniform data
+	long long stateChanges;			// binds, program switches, enable/disable
+	long long redundant;			// state changes that changed nothing
+	long long perFunc[GLC_NumFuncs];
+};
+
+#ifdef GL_COUNT_CALLS
+
+void glcountEndFrame();					// close the current frame
+const GLCallStats& glcountLastFrame();	// totals of the last closed frame
+void glcountSuspend();					// stop counting (e.g. the HUD)
+void glcountResume();
+void glcountDump();						// totals and per-frame averages, also run at exit
+
+#ifndef GLCOUNT_IMPL
+
+void glcUseProgram(GLuint program);
+void glcBindVertexArray(GLuint array);
+void glcBindBuffer(GLenum target, GLuint buffer);
+void glcBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+void glcBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+void glcUniform1i(GLint location, GLint v0);
+void glcUniform1f(GLint location, GLfloat v0);
+void glcUniform2f(GLint location, GLfloat v0, GLfloat v1);
+void glcUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+void glcUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+void glcDrawArrays(GLenum mode, GLint first, GLsizei count);
+void glcDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei primcount);
+void glcDrawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices,
+	GLsizei primcount, GLint basevertex);
+void glcEnable(GLenum cap);
+void glcDisable(GLenum cap);
+void glcActiveTexture(GLenum texture);
+void glcBindTexture(GLenum target, GLuint texture);
+void glcClear(GLbitfield mask);
+
+#undef glUseProgram
+#undef glBindVertexArray
+#undef glBindBuffer
+#undef glBufferData
+#undef glBufferSubData
+#undef glUniform1i
+#undef glUniform1f
+#undef glUniform2f
+#undef glUniform3f
+#undef glUniformMatrix4fv
+#undef glDrawArraysInstanced
+#undef glDrawElementsInstancedBaseVertex
+#undef glActiveTexture
+
+#define glUseProgram			glcUseProgram
+#define glBindVertexArray		glcBindVertexArray
+#define glBindBuffer			glcBindBuffer
+#define glBufferData			glcBufferData
+#define glBufferSubData			glcBufferSubData
+#define glUniform1i				glcUniform1i
+#define glUniform1f				glcUniform1f
+#define glUniform2f				glcUniform2f
+#define glUniform3f				glcUniform3f
+#define glUniformMatrix4fv		glcUniformMatrix4fv
+#define glDrawArrays			glcDrawArrays
+#define glDrawArraysInstanced	glcDrawArraysInstanced
+#define glDrawElementsInstancedBaseVertex	glcDrawElementsInstancedBaseVertex
+#define glEnable				glcEnable
+#define glDisable				glcDisable
+#define glActiveTexture			glcActiveTexture
+#define glBindTexture			glcBindTexture
+#define glClear					glcClear
+
+#endif // GLCOUNT_IMPL
+
+#else // GL_COUNT_CALLS
+
+inline void glcountEndFrame() {}
+inline void glcountSuspend() {}
+inline void glcountResume() {}
+inline void glcountDump() {}
+
+#endif // GL_COUNT_CALLS
+
+#endif // _GLCOUNT_H_
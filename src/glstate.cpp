@@ -0,0 +1,339 @@
+//
+// Cached GL state tracker, see glstate.h
+//
+
+#include "cube.h"
+
+#include <cstdio>
+#include <cstring>
+
+GLStateCache glState;
+
+const GLuint Unknown = ~0u;		// never matches a real name, so the first set goes through
+
+//----------------------------------------------------------------------------
+
+GLStateCache::GLStateCache()
+	: validation(false)
+{
+	reset();
+	memset(&frame, 0, sizeof(frame));
+	memset(&last, 0, sizeof(last));
+	memset(&sum, 0, sizeof(sum));
+}
+
+void GLStateCache::reset()
+{
+	curProgram = curVao = Unknown;
+	arrayBuffer = elementBuffer = textureBuffer = uniformBuffer = Unknown;
+	curUnit = Unknown;
+	for (int i = 0; i < MaxUnits; i++)
+		bound2D[i] = boundBufferTex[i] = Unknown;
+	depthTest = blend = cullFace = -1;
+	curDepthFunc = Unknown;
+	curDepthMask = -1;
+	uniforms.clear();
+	curUniforms = NULL;
+}
+
+void GLStateCache::forgetTexture(GLuint texture)
+{
+	for (int i = 0; i < MaxUnits; i++) {
+		if (bound2D[i] == texture)
+			bound2D[i] = Unknown;
+		if (boundBufferTex[i] == texture)
+			boundBufferTex[i] = Unknown;
+	}
+}
+
+void GLStateCache::forgetBuffer(GLuint buffer)
+{
+	GLuint* slots[4] = { &arrayBuffer, &elementBuffer, &textureBuffer, &uniformBuffer };
+	for (int i = 0; i < 4; i++) {
+		if (*slots[i] == buffer)
+			*slots[i] = Unknown;
+	}
+}
+
+//----------------------------------------------------------------------------
+
+// counts the call and tells the caller whether to issue it
+bool GLStateCache::track(Kind kind, bool changed)
+{
+	if (changed)
+		frame.issued[kind]++;
+	else
+		frame.skipped[kind]++;
+	return changed;
+}
+
+GLuint* GLStateCache::bufferSlot(GLenum target)
+{
+	switch (target) {
+	case GL_ARRAY_BUFFER:			return &arrayBuffer;
+	case GL_ELEMENT_ARRAY_BUFFER:	return &elementBuffer;
+	case GL_TEXTURE_BUFFER:			return &textureBuffer;
+	case GL_UNIFORM_BUFFER:			return &uniformBuffer;
+	}
+	return NULL;
+}
+
+int* GLStateCache::capSlot(GLenum cap)
+{
+	switch (cap) {
+	case GL_DEPTH_TEST:	return &depthTest;
+	case GL_BLEND:		return &blend;
+	case GL_CULL_FACE:	return &cullFace;
+	}
+	return NULL;
+}
+
+bool GLStateCache::setCap(GLenum cap, int on)
+{
+	int* slot = capSlot(cap);
+	if (!slot)
+		return track(Capability, true);		// not shadowed, always issue
+	bool changed = *slot != on;
+	*slot = on;
+	return track(Capability, changed);
+}
+
+//----------------------------------------------------------------------------
+
+void GLStateCache::useProgram(GLuint program)
+{
+	if (track(Program, curProgram != program)) {
+		curProgram = program;
+		curUniforms = &uniforms[program];
+		glUseProgram(program);
+	}
+}
+
+void GLStateCache::bindVertexArray(GLuint vao)
+{
+	if (track(VertexArray, curVao != vao)) {
+		curVao = vao;
+		elementBuffer = Unknown;		// the element buffer binding belongs to the VAO
+		glBindVertexArray(vao);
+	}
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+	GLuint* slot = bufferSlot(target);
+	if (!slot) {
+		track(Buffer, true);
+		glBindBuffer(target, buffer);
+	}
+	else if (track(Buffer, *slot != buffer)) {
+		*slot = buffer;
+		glBindBuffer(target, buffer);
+	}
+}
+
+void GLStateCache::activeTexture(GLenum unit)
+{
+	if (track(Texture, curUnit != unit)) {
+		curUnit = unit;
+		glActiveTexture(unit);
+	}
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint texture)
+{
+	int unit = curUnit == Unknown ? -1 : int(curUnit - GL_TEXTURE0);
+	GLuint* slot = NULL;
+	if (unit >= 0 && unit < MaxUnits) {
+		if (target == GL_TEXTURE_2D)
+			slot = &bound2D[unit];
+		else if (target == GL_TEXTURE_BUFFER)
+			slot = &boundBufferTex[unit];
+	}
+
+	if (!slot) {
+		track(Texture, true);
+		glBindTexture(target, texture);
+	}
+	else if (track(Texture, *slot != texture)) {
+		*slot = texture;
+		glBindTexture(target, texture);
+	}
+}
+
+void GLStateCache::enable(GLenum cap)
+{
+	if (setCap(cap, 1))
+		glEnable(cap);
+}
+
+void GLStateCache::disable(GLenum cap)
+{
+	if (setCap(cap, 0))
+		glDisable(cap);
+}
+
+void GLStateCache::depthFunc(GLenum func)
+{
+	if (track(Depth, curDepthFunc != func)) {
+		curDepthFunc = func;
+		glDepthFunc(func);
+	}
+}
+
+void GLStateCache::depthMask(GLboolean flag)
+{
+	if (track(Depth, curDepthMask != int(flag))) {
+		curDepthMask = flag;
+		glDepthMask(flag);
+	}
+}
+
+//----------------------------------------------------------------------------
+
+GLStateCache::UniformSlot* GLStateCache::uniformSlot(GLint location)
+{
+	if (location < 0 || !curUniforms)
+		return NULL;
+	if (size_t(location) >= curUniforms->size()) {
+		UniformSlot empty = UniformSlot();
+		curUniforms->resize(location + 1, empty);
+	}
+	return &(*curUniforms)[location];
+}
+
+// stores the value and returns true when GL has to be told
+bool GLStateCache::setUniform(GLint location, GLenum type, const void* data, size_t size)
+{
+	if (location < 0)
+		return track(Uniform, false);
+
+	UniformSlot* slot = uniformSlot(location);
+	if (!slot)
+		return track(Uniform, true);	// no program bound through the cache
+
+	bool changed = !slot->valid || slot->type != type || memcmp(slot->data, data, size) != 0;
+	if (changed) {
+		slot->valid = true;
+		slot->type = type;
+		memcpy(slot->data, data, size);
+	}
+	return track(Uniform, changed);
+}
+
+void GLStateCache::uniform1i(GLint location, GLint v0)
+{
+	if (setUniform(location, GL_INT, &v0, sizeof(v0)))
+		glUniform1i(location, v0);
+}
+
+void GLStateCache::uniform1f(GLint location, GLfloat v0)
+{
+	if (setUniform(location, GL_FLOAT, &v0, sizeof(v0)))
+		glUniform1f(location, v0);
+}
+
+void GLStateCache::uniform2f(GLint location, GLfloat v0, GLfloat v1)
+{
+	GLfloat v[2] = { v0, v1 };
+	if (setUniform(location, GL_FLOAT_VEC2, v, sizeof(v)))
+		glUniform2f(location, v0, v1);
+}
+
+void GLStateCache::uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+	GLfloat v[3] = { v0, v1, v2 };
+	if (setUniform(location, GL_FLOAT_VEC3, v, sizeof(v)))
+		glUniform3f(location, v0, v1, v2);
+}
+
+void GLStateCache::uniformMatrix4fv(GLint location, const GLfloat* value)
+{
+	if (setUniform(location, GL_FLOAT_MAT4, value, 16 * sizeof(GLfloat)))
+		glUniformMatrix4fv(location, 1, GL_FALSE, value);
+}
+
+//----------------------------------------------------------------------------
+
+static bool
+check(const char* what, GLint actual, GLuint shadow)
+{
+	if (shadow == Unknown || GLuint(actual) == shadow)
+		return true;
+	fprintf(stderr, "glState: %s is %d, cache says %u\n", what, actual, shadow);
+	return false;
+}
+
+bool GLStateCache::validate()
+{
+	bool ok = true;
+	GLint v;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &v);					ok &= check("program", v, curProgram);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &v);				ok &= check("vertex array", v, curVao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &v);				ok &= check("array buffer", v, arrayBuffer);
+	glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &v);		ok &= check("element buffer", v, elementBuffer);
+	glGetIntegerv(GL_TEXTURE_BUFFER, &v);					ok &= check("texture buffer", v, textureBuffer);
+	glGetIntegerv(GL_UNIFORM_BUFFER_BINDING, &v);			ok &= check("uniform buffer", v, uniformBuffer);
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &v);					ok &= check("active texture", v, curUnit);
+	glGetIntegerv(GL_DEPTH_FUNC, &v);						ok &= check("depth func", v, curDepthFunc);
+	glGetIntegerv(GL_DEPTH_WRITEMASK, &v);					ok &= check("depth mask", v, GLuint(curDepthMask));
+
+	GLenum caps[3] = { GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE };
+	const char* capNames[3] = { "depth test", "blend", "cull face" };
+	for (int i = 0; i < 3; i++)
+		ok &= check(capNames[i], glIsEnabled(caps[i]), GLuint(*capSlot(caps[i])));
+
+	// texture bindings, unit by unit; restore the active unit afterwards
+	if (curUnit != Unknown) {
+		for (int i = 0; i < MaxUnits; i++) {
+			if (bound2D[i] == Unknown && boundBufferTex[i] == Unknown)
+				continue;
+			glActiveTexture(GL_TEXTURE0 + i);
+			glGetIntegerv(GL_TEXTURE_BINDING_2D, &v);		ok &= check("texture 2D", v, bound2D[i]);
+			glGetIntegerv(GL_TEXTURE_BINDING_BUFFER, &v);	ok &= check("buffer texture", v, boundBufferTex[i]);
+		}
+		glActiveTexture(curUnit);
+	}
+
+	// uniforms the cache believes the current program holds
+	if (curUniforms && curProgram != Unknown) {
+		for (size_t loc = 0; loc < curUniforms->size(); loc++) {
+			const UniformSlot& slot = (*curUniforms)[loc];
+			if (!slot.valid)
+				continue;
+			GLfloat f[16];
+			GLint i;
+			bool same;
+			if (slot.type == GL_INT) {
+				glGetUniformiv(curProgram, GLint(loc), &i);
+				same = memcmp(&i, slot.data, sizeof(i)) == 0;
+			}
+			else {
+				glGetUniformfv(curProgram, GLint(loc), f);
+				size_t n = slot.type == GL_FLOAT_MAT4 ? 16 : slot.type == GL_FLOAT_VEC3 ? 3 : slot.type == GL_FLOAT_VEC2 ? 2 : 1;
+				same = memcmp(f, slot.data, n * sizeof(GLfloat)) == 0;
+			}
+			if (!same) {
+				fprintf(stderr, "glState: uniform %d of program %u differs from cache\n", int(loc), curProgram);
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
+
+//----------------------------------------------------------------------------
+
+void GLStateCache::endFrame()
+{
+	if (validation && !validate())
+		fprintf(stderr, "glState: validation failed\n");
+
+	for (int k = 0; k < NumKinds; k++) {
+		sum.issued[k] += frame.issued[k];
+		sum.skipped[k] += frame.skipped[k];
+	}
+	last = frame;
+	memset(&frame, 0, sizeof(frame));
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _GLSTATE_H_
+#define _GLSTATE_H_
+
+#include <unordered_map>
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Cached GL state tracker
+//
+//  Shadows the bound program, VAO, buffers, textures, depth state and the
+//    uniforms of each program, and drops calls that would set what is
+//    already set.  Everything that binds should go through glState so the
+//    shadow stays true; validate() cross-checks it against glGet.
+//
+
+class GLStateCache {
+public:
+	enum Kind { Program, VertexArray, Buffer, Texture, Capability, Depth, Uniform, NumKinds };
+
+	struct Counts {
+		long long issued[NumKinds];		// calls passed on to GL
+		long long skipped[NumKinds];	// calls dropped as redundant
+	};
+
+	GLStateCache();
+
+	void reset();				// forget everything; the next call of each kind goes through
+
+	// GL unbinds a name when it is deleted and may hand it out again; call
+	//   before glDeleteTextures or glDeleteBuffers so no shadow keeps it
+	void forgetTexture(GLuint texture);
+	void forgetBuffer(GLuint buffer);
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	void bindBuffer(GLenum target, GLuint buffer);
+	void activeTexture(GLenum unit);
+	void bindTexture(GLenum target, GLuint texture);	// on the active unit
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void depthFunc(GLenum func);
+	void depthMask(GLboolean flag);
+
+	// uniforms of the current program; location -1 is dropped like GL does
+	void uniform1i(GLint location, GLint v0);
+	void uniform1f(GLint location, GLfloat v0);
+	void uniform2f(GLint location, GLfloat v0, GLfloat v1);
+	void uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+	void uniformMatrix4fv(GLint location, const GLfloat* value);
+
+	GLuint program() const { return curProgram; }
+
+	// Checks the shadow state against glGet and prints every mismatch.
+	//   Slow (it stalls the pipeline); endFrame() runs it while validation is on.
+	bool validate();
+	void setValidation(bool on) { validation = on; }
+	bool validating() const { return validation; }
+
+	void endFrame();
+	const Counts& lastFrame() const { return last; }
+	const Counts& total() const { return sum; }
+
+private:
+	struct UniformSlot {
+		bool valid;
+		GLenum type;
+		unsigned char data[16 * sizeof(GLfloat)];
+	};
+
+	GLuint* bufferSlot(GLenum target);
+	int* capSlot(GLenum cap);
+	bool setCap(GLenum cap, int on);
+	UniformSlot* uniformSlot(GLint location);
+	bool setUniform(GLint location, GLenum type, const void* data, size_t size);
+	bool track(Kind kind, bool changed);
+
+	static const int MaxUnits = 16;
+
+	GLuint curProgram, curVao;
+	GLuint arrayBuffer, elementBuffer, textureBuffer, uniformBuffer;
+	GLenum curUnit;
+	GLuint bound2D[MaxUnits], boundBufferTex[MaxUnits];
+	int depthTest, blend, cullFace;
+	GLenum curDepthFunc;
+	int curDepthMask;
+
+	std::unordered_map<GLuint, std::vector<UniformSlot> > uniforms;
+	std::vector<UniformSlot>* curUniforms;
+
+	bool validation;
+	Counts frame, last, sum;
+};
+
+extern GLStateCache glState;
+
+#endif // _GLSTATE_H_
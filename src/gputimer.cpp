@@ -0,0 +1,53 @@
+//
+// GPU time of a stretch of commands, see gputimer.h
+//
+
+#include "gputimer.h"
+
+bool GpuTimer::supported()
+{
+	return GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+}
+
+void GpuTimer::begin()
+{
+	if (!supported())
+		return;
+	if (!created) {
+		glGenQueries(Depth * 2, &queries[0][0]);
+		created = true;
+	}
+
+	collect();
+	if (pending == Depth) {
+		pending--;			// the GPU is that far behind; drop the oldest
+	}
+	glQueryCounter(queries[head][0], GL_TIMESTAMP);
+}
+
+void GpuTimer::end()
+{
+	if (!created)
+		return;
+	glQueryCounter(queries[head][1], GL_TIMESTAMP);
+	head = (head + 1) % Depth;
+	pending++;
+}
+
+// reads every finished slot, oldest first, without waiting
+void GpuTimer::collect()
+{
+	while (pending > 0) {
+		int slot = (head - pending + Depth) % Depth;
+		GLint available = 0;
+		glGetQueryObjectiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return;
+
+		GLuint64 start = 0, stop = 0;
+		glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &stop);
+		last = float(double(stop - start) * 1e-6);
+		pending--;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _GPUTIMER_H_
+#define _GPUTIMER_H_
+
+#include "cube.h"
+
+//----------------------------------------------------------------------------
+//
+//  GPU time of a stretch of commands
+//
+//  begin() and end() drop timestamps (ARB_timer_query) into the command
+//    stream; the result is read back a few frames later, once the GPU has
+//    got there, so timing never stalls the pipeline.  Timestamps rather
+//    than GL_TIME_ELAPSED, so timed stretches may nest and overlap.
+//    Without the extension every call does nothing and ms() stays 0.
+//
+
+class GpuTimer {
+public:
+	GpuTimer() : head(0), pending(0), last(0.0f), created(false) {}
+
+	void begin();
+	void end();
+
+	// the most recent result that has come back, in milliseconds
+	float ms() const { return last; }
+
+	static bool supported();
+
+private:
+	void collect();
+
+	static const int Depth = 4;		// frames in flight
+	GLuint queries[Depth][2];		// start, end
+	int head;						// slot the next begin() writes
+	int pending;					// slots written and not yet read
+	float last;
+	bool created;
+};
+
+#endif // _GPUTIMER_H_
@@ -0,0 +1,376 @@
+//
+// On-screen performance HUD
+//
+// Every glyph and histogram bar is one instance.  The instance data lives in
+//   a texture buffer (two RGBA32F texels per instance) and the shader builds
+//   a quad from gl_VertexID/gl_InstanceID, so the overlay costs one upload
+//   and one glDrawArraysInstanced per frame.
+
+#include "hud.h"
+#include "caustics.h"
+#include "overdraw.h"
+#include "postfx.h"
+#include "renderqueue.h"
+#include "resolution.h"
+#include "streambuffer.h"
+#include "timing.h"
+#include "glm/glm.hpp"
+
+#include <cstdio>
+#include <cctype>
+
+FrameStats frameStats;
+
+//----------------------------------------------------------------------------
+
+// 5x7 font for ASCII 0x20..0x5F, one byte per column, bit 0 = top row.
+//   Lower case is drawn with the upper case glyphs.
+static const unsigned char font5x7[64][5] = {
+	{ 0x00,0x00,0x00,0x00,0x00 }, { 0x00,0x00,0x5F,0x00,0x00 },	//   !
+	{ 0x00,0x07,0x00,0x07,0x00 }, { 0x14,0x7F,0x14,0x7F,0x14 },	// " #
+	{ 0x24,0x2A,0x7F,0x2A,0x12 }, { 0x23,0x13,0x08,0x64,0x62 },	// $ %
+	{ 0x36,0x49,0x56,0x20,0x50 }, { 0x00,0x08,0x07,0x03,0x00 },	// & '
+	{ 0x00,0x1C,0x22,0x41,0x00 }, { 0x00,0x41,0x22,0x1C,0x00 },	// ( )
+	{ 0x2A,0x1C,0x7F,0x1C,0x2A }, { 0x08,0x08,0x3E,0x08,0x08 },	// * +
+	{ 0x00,0x80,0x70,0x30,0x00 }, { 0x08,0x08,0x08,0x08,0x08 },	// , -
+	{ 0x00,0x00,0x60,0x60,0x00 }, { 0x20,0x10,0x08,0x04,0x02 },	// . /
+	{ 0x3E,0x51,0x49,0x45,0x3E }, { 0x00,0x42,0x7F,0x40,0x00 },	// 0 1
+	{ 0x72,0x49,0x49,0x49,0x46 }, { 0x21,0x41,0x49,0x4D,0x33 },	// 2 3
+	{ 0x18,0x14,0x12,0x7F,0x10 }, { 0x27,0x45,0x45,0x45,0x39 },	// 4 5
+	{ 0x3C,0x4A,0x49,0x49,0x31 }, { 0x41,0x21,0x11,0x09,0x07 },	// 6 7
+	{ 0x36,0x49,0x49,0x49,0x36 }, { 0x46,0x49,0x49,0x29,0x1E },	// 8 9
+	{ 0x00,0x00,0x14,0x00,0x00 }, { 0x00,0x40,0x34,0x00,0x00 },	// : ;
+	{ 0x00,0x08,0x14,0x22,0x41 }, { 0x14,0x14,0x14,0x14,0x14 },	// < =
+	{ 0x00,0x41,0x22,0x14,0x08 }, { 0x02,0x01,0x59,0x09,0x06 },	// > ?
+	{ 0x3E,0x41,0x5D,0x59,0x4E }, { 0x7C,0x12,0x11,0x12,0x7C },	// @ A
+	{ 0x7F,0x49,0x49,0x49,0x36 }, { 0x3E,0x41,0x41,0x41,0x22 },	// B C
+	{ 0x7F,0x41,0x41,0x41,0x3E }, { 0x7F,0x49,0x49,0x49,0x41 },	// D E
+	{ 0x7F,0x09,0x09,0x09,0x01 }, { 0x3E,0x41,0x41,0x51,0x73 },	// F G
+	{ 0x7F,0x08,0x08,0x08,0x7F }, { 0x00,0x41,0x7F,0x41,0x00 },	// H I
+	{ 0x20,0x40,0x41,0x3F,0x01 }, { 0x7F,0x08,0x14,0x22,0x41 },	// J K
+	{ 0x7F,0x40,0x40,0x40,0x40 }, { 0x7F,0x02,0x1C,0x02,0x7F },	// L M
+	{ 0x7F,0x04,0x08,0x10,0x7F }, { 0x3E,0x41,0x41,0x41,0x3E },	// N O
+	{ 0x7F,0x09,0x09,0x09,0x06 }, { 0x3E,0x41,0x51,0x21,0x5E },	// P Q
+	{ 0x7F,0x09,0x19,0x29,0x46 }, { 0x26,0x49,0x49,0x49,0x32 },	// R S
+	{ 0x03,0x01,0x7F,0x01,0x03 }, { 0x3F,0x40,0x40,0x40,0x3F },	// T U
+	{ 0x1F,0x20,0x40,0x20,0x1F }, { 0x3F,0x40,0x38,0x40,0x3F },	// V W
+	{ 0x63,0x14,0x08,0x14,0x63 }, { 0x03,0x04,0x78,0x04,0x03 },	// X Y
+	{ 0x61,0x59,0x49,0x4D,0x43 }, { 0x00,0x7F,0x41,0x41,0x41 },	// Z [
+	{ 0x02,0x04,0x08,0x10,0x20 }, { 0x00,0x41,0x41,0x41,0x7F },	// \ ]
+	{ 0x04,0x02,0x01,0x02,0x04 }, { 0x40,0x40,0x40,0x40,0x40 }	// ^ _
+};
+
+const int GlyphCount = 65;		// 64 font glyphs + one solid block for bars
+const int SolidGlyph = 64;
+const int CellW = 6, CellH = 8;	// glyph cell in atlas texels
+const float HudScale = 2.0f;		// screen pixels per atlas texel
+
+const int MaxInstances = 1024;
+const int HistoryLength = 256;		// frames kept for the histogram
+const int HistogramBins = 16;
+const float BinWidthMs = 2.0f;		// last bin also collects everything slower
+
+static bool visible = true;
+
+static GLuint hudProgram, hudVao, atlasTex, instanceBuffer, instanceTex;
+static GLint screenSizeID, glyphAtlasID, glyphDataID;
+
+// two texels per instance: (x, y, w, h) in pixels, (glyph, r, g, b)
+static glm::vec4 instances[MaxInstances * 2];
+static int numInstances;
+
+static Clock::time_point frameStart, fpsWindowStart;
+static bool firstFrame = true;
+static float frameHistory[HistoryLength];
+static int historyHead, historySize;
+static int fpsFrames;
+static float fps, cpuMs;
+
+//----------------------------------------------------------------------------
+
+static void
+pushRect(float x, float y, float w, float h, int glyph, glm::vec3 color)
+{
+	if (numInstances >= MaxInstances)
+		return;
+	instances[numInstances * 2] = glm::vec4(x, y, w, h);
+	instances[numInstances * 2 + 1] = glm::vec4(float(glyph), color);
+	numInstances++;
+}
+
+// returns the x position after the last glyph
+static float
+pushText(float x, float y, const char* text, glm::vec3 color)
+{
+	for (const char* c = text; *c; c++) {
+		int ch = toupper((unsigned char)*c);
+		if (ch != ' ' && ch >= 0x20 && ch < 0x60)
+			pushRect(x, y, CellW * HudScale, CellH * HudScale, ch - 0x20, color);
+		x += CellW * HudScale;
+	}
+	return x;
+}
+
+static void
+formatBytes(char* out, size_t size, long long bytes)
+{
+	if (bytes >= 1024 * 1024)
+		snprintf(out, size, "%.2f MB", bytes / (1024.0 * 1024.0));
+	else if (bytes >= 1024)
+		snprintf(out, size, "%.1f KB", bytes / 1024.0);
+	else
+		snprintf(out, size, "%lld B", bytes);
+}
+
+//----------------------------------------------------------------------------
+
+void hudInit()
+{
+	// bake the font into a single-channel atlas, one 6x8 cell per glyph
+	static unsigned char atlas[CellH][GlyphCount * CellW];
+	for (int g = 0; g < GlyphCount; g++) {
+		for (int col = 0; col < CellW; col++) {
+			for (int row = 0; row < CellH; row++) {
+				bool on;
+				if (g == SolidGlyph)
+					on = true;
+				else
+					on = col < 5 && row < 7 && (font5x7[g][col] >> row) & 1;
+				atlas[row][g * CellW + col] = on ? 255 : 0;
+			}
+		}
+	}
+
+	hudProgram = InitShader("src/hud_vshader.glsl", "src/hud_fshader.glsl");
+	screenSizeID = glGetUniformLocation(hudProgram, "screenSize");
+	glyphAtlasID = glGetUniformLocation(hudProgram, "glyphAtlas");
+	glyphDataID = glGetUniformLocation(hudProgram, "glyphData");
+	glState.uniform1i(glyphAtlasID, 0);
+	glState.uniform1i(glyphDataID, 1);
+	glState.uniform1f(glGetUniformLocation(hudProgram, "glyphCount"), float(GlyphCount));
+
+	// core profile still needs a VAO bound, even with no attributes
+	glGenVertexArrays(1, &hudVao);
+
+	glGenTextures(1, &atlasTex);
+	glState.bindTexture(GL_TEXTURE_2D, atlasTex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, GlyphCount * CellW, CellH, 0,
+		GL_RED, GL_UNSIGNED_BYTE, atlas);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenBuffers(1, &instanceBuffer);
+	glState.bindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(instances), NULL, GL_STREAM_DRAW);
+
+	glGenTextures(1, &instanceTex);
+	glState.bindTexture(GL_TEXTURE_BUFFER, instanceTex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceBuffer);
+}
+
+//----------------------------------------------------------------------------
+
+void hudBeginFrame()
+{
+	Clock::time_point now = Clock::now();
+
+	if (firstFrame) {
+		fpsWindowStart = now;
+		firstFrame = false;
+	}
+	else {
+		frameHistory[historyHead] = float(msBetween(frameStart, now));
+		historyHead = (historyHead + 1) % HistoryLength;
+		if (historySize < HistoryLength)
+			historySize++;
+	}
+
+	// refresh the FPS readout twice a second so it stays readable
+	fpsFrames++;
+	float windowMs = float(msBetween(fpsWindowStart, now));
+	if (windowMs >= 500.0f) {
+		fps = fpsFrames * 1000.0f / windowMs;
+		fpsFrames = 0;
+		fpsWindowStart = now;
+	}
+
+	frameStart = now;
+	frameStats = FrameStats();
+}
+
+//----------------------------------------------------------------------------
+
+void hudDraw()
+{
+	// CPU cost of the scene only; the HUD itself is not included
+	cpuMs = float(msSince(frameStart));
+
+	if (!visible)
+		return;
+
+	const glm::vec3 white(1.0f), gray(0.6f), green(0.3f, 1.0f, 0.3f);
+	const float lineH = (CellH + 2) * HudScale;
+	float x = 8.0f, y = 8.0f;
+	char buf[96], bytes[32];
+
+	numInstances = 0;
+
+	float lastMs = historySize ? frameHistory[(historyHead + HistoryLength - 1) % HistoryLength] : 0.0f;
+	snprintf(buf, sizeof(buf), "FPS %.1f  FRAME %.2f MS  CPU %.2f MS", fps, lastMs, cpuMs);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	snprintf(buf, sizeof(buf), "DRAWS %d  TRIS %lld", frameStats.drawCalls, frameStats.triangles);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	formatBytes(bytes, sizeof(bytes), frameStats.bytesUploaded);
+	snprintf(buf, sizeof(buf), "UPLOAD %s  SWIMMERS %d/%d", bytes,
+		frameStats.swimmers, frameStats.swimmersTotal);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	snprintf(buf, sizeof(buf), "LOD FULL %d  MERGED %d  IMPOSTOR %d",
+		frameStats.lodCounts[0], frameStats.lodCounts[1], frameStats.lodCounts[2]);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	snprintf(buf, sizeof(buf), "OCEAN %d  CPU %.2f MS  FFT %.2f MS",
+		frameStats.oceanSize, frameStats.oceanMs, frameStats.oceanFftMs);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	snprintf(buf, sizeof(buf), "WAKES %d STEPS  %.2f MS", frameStats.waterSteps, frameStats.waterMs);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	snprintf(buf, sizeof(buf), "PARTICLES %d  %.2f MS  SORT %.2f MS", frameStats.particles, frameStats.particlesMs,
+		frameStats.particlesSortMs);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	snprintf(buf, sizeof(buf), "LIGHTS %d  %.1f PER TILE  %.2f MS", frameStats.lights, frameStats.lightsPerTile,
+		frameStats.lightsMs);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	char overdraw[16];
+	if (overdrawEnabled())
+		snprintf(overdraw, sizeof(overdraw), "%.2fX", frameStats.overdraw);
+	else
+		snprintf(overdraw, sizeof(overdraw), "OFF");
+	snprintf(buf, sizeof(buf), "PREPASS %s %d DRAWS  SORTED %d  OVERDRAW %s",
+		renderQueue.depthPrepass() ? "ON" : "OFF", frameStats.prepassDraws, frameStats.sortedSwimmers, overdraw);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	snprintf(buf, sizeof(buf), "SHADOWS %d CASTERS  CPU %.2f MS  GPU %.2f MS", frameStats.shadowCasters,
+		frameStats.shadowMs, frameStats.shadowGpuMs);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	formatBytes(bytes, sizeof(bytes), frameStats.uploadStaged);
+	snprintf(buf, sizeof(buf), "STAGED %s  %d DEFERRED  STALL %.2f MS", bytes, frameStats.uploadDeferred,
+		frameStats.uploadStallMs);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	formatBytes(bytes, sizeof(bytes), frameStats.streamBytes);
+	snprintf(buf, sizeof(buf), "STREAMED %s  %s  %d BEHIND  STALL %.2f MS", bytes,
+		streamModeNames[streamBestMode()], frameStats.streamBehind, frameStats.streamStallMs);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	snprintf(buf, sizeof(buf), "CAUSTICS %d  %.2f MS PER TILE  %d MIPS UP", CausticsSize, frameStats.causticsMs,
+		frameStats.causticsLevels);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	formatBytes(bytes, sizeof(bytes), frameStats.postBytes);
+	snprintf(buf, sizeof(buf), "POST %s  %d TARGETS %s  %d NEW  GPU %.2f MS", postEffects ? "ON" : "OFF",
+		frameStats.postTargets, bytes, frameStats.postAllocations, frameStats.postGpuMs);
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	snprintf(buf, sizeof(buf), "RESOLUTION %d%% %s  FRAME %.2f OF %.1f MS", int(frameStats.renderScale * 100.0f + 0.5f),
+		resolutionEnabled() ? "DYNAMIC" : "FIXED", frameStats.frameGpuMs, resolutionBudget());
+	pushText(x, y, buf, white);
+	y += lineH;
+
+	const GLStateCache::Counts& cache = glState.lastFrame();
+	long long issued = 0, skipped = 0;
+	for (int k = 0; k < GLStateCache::NumKinds; k++) {
+		issued += cache.issued[k];
+		skipped += cache.skipped[k];
+	}
+	snprintf(buf, sizeof(buf), "STATE CACHE SKIPPED %lld OF %lld", skipped, issued + skipped);
+	pushText(x, y, buf, gray);
+	y += lineH;
+
+#ifdef GL_COUNT_CALLS
+	const GLCallStats& gl = glcountLastFrame();
+	snprintf(buf, sizeof(buf), "GL CALLS %lld  STATE %lld  REDUNDANT %lld", gl.calls, gl.stateChanges, gl.redundant);
+	pushText(x, y, buf, gray);
+	y += lineH;
+#endif
+
+	// frame-time histogram over the last HistoryLength frames
+	int bins[HistogramBins] = { 0 };
+	int maxBin = 1;
+	for (int i = 0; i < historySize; i++) {
+		int b = int(frameHistory[i] / BinWidthMs);
+		if (b >= HistogramBins)
+			b = HistogramBins - 1;
+		if (++bins[b] > maxBin)
+			maxBin = bins[b];
+	}
+
+	const float barW = 8.0f, barGap = 2.0f, graphH = 48.0f;
+	float graphTop = y + 4.0f;
+	for (int b = 0; b < HistogramBins; b++) {
+		float h = graphH * bins[b] / maxBin;
+		pushRect(x + b * (barW + barGap), graphTop + graphH - h, barW, h, SolidGlyph, green);
+	}
+	snprintf(buf, sizeof(buf), "0-%d MS", int(HistogramBins * BinWidthMs));
+	pushText(x + HistogramBins * (barW + barGap) + 8.0f, graphTop + graphH - CellH * HudScale, buf, gray);
+
+	if (numInstances == 0)
+		return;
+
+	// keep the overlay out of the GL call counts it reports
+	glcountSuspend();
+
+	glState.bindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, numInstances * 2 * sizeof(glm::vec4), instances);
+
+	glState.useProgram(hudProgram);
+	glState.uniform2f(screenSizeID, float(glutGet(GLUT_WINDOW_WIDTH)), float(glutGet(GLUT_WINDOW_HEIGHT)));
+
+	glState.activeTexture(GL_TEXTURE0);
+	glState.bindTexture(GL_TEXTURE_2D, atlasTex);
+	glState.activeTexture(GL_TEXTURE1);
+	glState.bindTexture(GL_TEXTURE_BUFFER, instanceTex);
+	glState.activeTexture(GL_TEXTURE0);
+
+	glState.disable(GL_DEPTH_TEST);
+	glState.bindVertexArray(hudVao);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numInstances);
+	glState.enable(GL_DEPTH_TEST);
+
+	glcountResume();
+}
+
+//----------------------------------------------------------------------------
+
+void hudToggle()
+{
+	visible = !visible;
+}
+
+bool hudVisible()
+{
+	return visible;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _HUD_H_
+#define _HUD_H_
+
+#include "cube.h"
+
+//----------------------------------------------------------------------------
+//
+//  On-screen performance HUD
+//
+//  The whole overlay (text and frame-time histogram) is packed into one
+//    texture buffer and drawn with a single instanced call, so turning it
+//    on does not noticeably change the numbers it shows.
+//
+
+// Per-frame counters shown by the HUD.  The draw path adds to these;
+//   hudBeginFrame() clears them.
+struct FrameStats {
+	int       drawCalls;
+	int       prepassDraws;		// of which depth-only, in the pre-pass
+	long long triangles;
+	long long bytesUploaded;
+	int       swimmers;			// drawn
+	int       swimmersTotal;	// in the scene
+	int       lodCounts[3];		// drawn at full, merged and impostor detail
+	int       oceanSize;		// FFT grid side
+	float     oceanMs;			// CPU time simulating and writing the surface
+	float     oceanFftMs;		// of which the three inverse FFTs
+	int       waterSteps;		// wake grid steps since the last frame
+	float     waterMs;			// and their CPU time
+	int       particles;		// alive
+	float     particlesMs;		// CPU time of the last particle update
+	float     particlesSortMs;	// and of sorting them back to front, for sorted blending
+	int       lights;			// pool lights
+	float     lightsPerTile;	// average over the screen tiles
+	float     lightsMs;			// CPU time moving, binning and uploading them
+	int       shadowCasters;	// swimmers drawn into the shadow cascades, over all of them
+	float     shadowMs;			// CPU time fitting, culling and submitting the cascades
+	float     shadowGpuMs;		// GPU time of the shadow pass, a few frames old
+	int       sortedSwimmers;	// ordered front to back before drawing
+	float     overdraw;			// fragments shaded per pixel, while the heatmap is on
+	int       postTargets;		// render targets in the pool
+	size_t    postBytes;		// and their memory
+	int       postAllocations;	// targets the pool had to make this frame
+	float     postGpuMs;		// GPU time of the post-processing passes, a few frames old
+	float     causticsMs;		// CPU time of the last caustics pattern, generated and uploaded
+	int       causticsLevels;	// mip levels it changed and uploaded
+	size_t    uploadStaged;		// bytes through the upload ring
+	int       uploadDeferred;	// uploads it had no room for, put off or sent directly
+	float     uploadStallMs;	// render thread time in its fence checks, maps and unmaps
+	size_t    streamBytes;		// vertices written straight into stream buffers
+	float     streamStallMs;	// render thread time in their fence checks, maps and unmaps
+	int       streamBehind;		// writes to a region the GPU still read: orphaned, or skipped if persistent
+	float     renderScale;		// of the window's size the scene renders at
+	float     frameGpuMs;		// what the resolution controller measured
+};
+
+extern FrameStats frameStats;
+
+void hudInit();
+void hudBeginFrame();		// call first thing in display()
+void hudDraw();				// call after the scene, before swapping
+void hudToggle();
+bool hudVisible();
+
+#endif // _HUD_H_
@@ -0,0 +1,14 @@
+#version 150
+
+in  vec2 uv;
+in  vec3 tint;
+out vec4 fColor;
+
+uniform sampler2D glyphAtlas;
+
+void main() 
+{ 
+    if (texture(glyphAtlas, uv).r < 0.5)
+        discard;
+    fColor = vec4(tint, 1.0);
+} 
@@ -0,0 +1,25 @@
+#version 150
+
+// Builds one screen-space quad per instance; see hud.cpp for the layout
+//   of glyphData (two texels per instance).
+
+uniform samplerBuffer glyphData;
+uniform vec2  screenSize;
+uniform float glyphCount;
+
+out vec2 uv;
+out vec3 tint;
+
+void main() 
+{
+  vec4 rect = texelFetch(glyphData, gl_InstanceID * 2);
+  vec4 info = texelFetch(glyphData, gl_InstanceID * 2 + 1);
+
+  // triangle strip corners: (0,0) (1,0) (0,1) (1,1)
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  vec2 pixel = rect.xy + corner * rect.zw;
+
+  gl_Position = vec4(pixel.x / screenSize.x * 2.0 - 1.0, 1.0 - pixel.y / screenSize.y * 2.0, 0.0, 1.0);
+  uv = vec2((info.x + corner.x) / glyphCount, corner.y);
+  tint = info.yzw;
+} 
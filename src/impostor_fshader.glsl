@@ -0,0 +1,14 @@
+#version 150
+
+in  vec3 texCoord;
+out vec4 fColor;
+
+uniform sampler2DArray frames;		// one layer per baked stroke pose
+
+void main()
+{
+  vec4 c = texture(frames, texCoord);
+  if (c.a < 0.5)
+    discard;
+  fColor = vec4(c.rgb, 1.0);
+}
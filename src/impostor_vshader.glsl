@@ -0,0 +1,21 @@
+#version 150
+
+// One camera-facing quad per far swimmer, corners from gl_VertexID
+//   (drawn as a 4-vertex triangle strip, no vertex attributes).
+
+out vec3 texCoord;
+
+uniform mat4 mVP;
+uniform samplerBuffer impostors;	// per instance: xyz = centre, w = baked frame
+uniform vec3 cameraRight;			// camera axes scaled by the half size of a frame
+uniform vec3 cameraUp;
+
+void main()
+{
+  vec4 inst = texelFetch(impostors, gl_InstanceID);
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+  vec3 p = inst.xyz + (corner.x * 2.0 - 1.0) * cameraRight + (corner.y * 2.0 - 1.0) * cameraUp;
+
+  gl_Position = mVP * vec4(p, 1.0);
+  texCoord = vec3(corner, inst.w);
+}
@@ -0,0 +1,156 @@
+//
+// Worker threads for data-parallel loops, see jobs.h
+//
+
+#include "jobs.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Task {
+	const std::function<void(int, int)>* fn;
+	int begin, end;
+	std::atomic<int>* pending;
+};
+
+class Pool {
+public:
+	Pool()
+		: quit(false)
+	{
+		unsigned n = std::thread::hardware_concurrency();
+		int workers = n > 1 ? int(n) - 1 : 0;
+		for (int i = 0; i < workers; i++)
+			threads.push_back(std::thread(&Pool::work, this));
+	}
+
+	~Pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+
+	int size() const { return int(threads.size()) + 1; }
+
+	void push(const Task& t)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(t);
+		}
+		wake.notify_one();
+	}
+
+	// runs one queued task on the calling thread; false if there was none
+	bool runOne()
+	{
+		Task t;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (queue.empty())
+				return false;
+			t = queue.front();
+			queue.pop_front();
+		}
+		run(t);
+		return true;
+	}
+
+private:
+	static void run(const Task& t)
+	{
+		(*t.fn)(t.begin, t.end);
+		t.pending->fetch_sub(1);
+	}
+
+	void work()
+	{
+		for (;;) {
+			Task t;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return quit || !queue.empty(); });
+				if (quit)
+					return;
+				t = queue.front();
+				queue.pop_front();
+			}
+			run(t);
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::deque<Task> queue;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool quit;
+};
+
+Pool& pool()
+{
+	static Pool p;
+	return p;
+}
+
+int threadLimit;		// 0 for no cap
+
+} // namespace
+
+//----------------------------------------------------------------------------
+
+int jobThreads()
+{
+	int n = pool().size();
+	return threadLimit > 0 && threadLimit < n ? threadLimit : n;
+}
+
+void setJobThreads(int n)
+{
+	threadLimit = n > 0 ? n : 0;
+}
+
+void parallelFor(int count, int minBatch, const std::function<void(int begin, int end)>& fn)
+{
+	if (count <= 0)
+		return;
+	if (minBatch < 1)
+		minBatch = 1;
+
+	Pool& p = pool();
+	int chunks = count / minBatch;
+	if (chunks > jobThreads())
+		chunks = jobThreads();
+	if (chunks <= 1) {
+		fn(0, count);
+		return;
+	}
+
+	// hand out all but the first range, run that one here
+	std::atomic<int> pending(chunks - 1);
+	int per = count / chunks, extra = count % chunks;
+	int begin = per + (extra > 0 ? 1 : 0);
+	for (int c = 1; c < chunks; c++) {
+		int end = begin + per + (c < extra ? 1 : 0);
+		Task t = { &fn, begin, end, &pending };
+		p.push(t);
+		begin = end;
+	}
+	fn(0, per + (extra > 0 ? 1 : 0));
+
+	// help with whatever is queued (ours or a nested loop's) until done
+	while (pending.load() > 0) {
+		if (!p.runOne())
+			std::this_thread::yield();
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+#include <functional>
+
+//----------------------------------------------------------------------------
+//
+//  Worker threads for data-parallel loops
+//
+//  One pool is started on first use with a thread per hardware core (the
+//    calling thread counts as one).  parallelFor() may be called from inside
+//    a job; the waiting thread keeps running queued work instead of blocking.
+//
+
+// number of threads parallelFor() spreads work over, caller included
+int jobThreads();
+
+// caps jobThreads() at n (for scaling measurements); 0 restores all of them
+void setJobThreads(int n);
+
+// Calls fn(begin, end) over [0, count) in contiguous ranges of at least
+//   minBatch items and returns when all of them are done.  Runs inline when
+//   the work is too small to be worth splitting.
+void parallelFor(int count, int minBatch, const std::function<void(int begin, int end)>& fn);
+
+#endif // _JOBS_H_
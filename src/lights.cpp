@@ -0,0 +1,383 @@
+//
+// Pool lights and tiled light assignment, see lights.h
+//
+
+#include "lights.h"
+#include "crowd.h"
+#include "hud.h"
+#include "jobs.h"
+#include "simd.h"
+#include "timing.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+
+LightList lights;
+
+const float LightSpacing = 7.0f;		// along x, between rows of swimmers
+const float LightDepth = -1.5f;			// below the surface, on the lane floor
+const float LightRadius = 5.0f;
+
+void LightList::resize(int n)
+{
+	x.resize(n); y.resize(n); z.resize(n); radius.resize(n);
+	r.resize(n); g.resize(n); b.resize(n);
+}
+
+//----------------------------------------------------------------------------
+
+namespace {
+
+// what bounding a light on screen needs from the camera
+struct TileCamera {
+	float view[3][4];			// rows of the view matrix: x, y, z (w is 1)
+	float p00, p11;				// projection scale
+	float zNear;
+	float halfTilesX, halfTilesY;	// ndc to tiles: (ndc + 1) * halfTiles
+	float maxX, maxY;			// last tile
+};
+
+TileCamera
+tileCamera(const glm::mat4& view, const glm::mat4& proj, int tilesX, int tilesY, int width, int height)
+{
+	TileCamera c;
+	for (int r = 0; r < 3; r++) {
+		for (int k = 0; k < 4; k++)
+			c.view[r][k] = view[k][r];
+	}
+	c.p00 = proj[0][0];
+	c.p11 = proj[1][1];
+	c.zNear = proj[3][2] / (proj[2][2] - 1.0f);
+	c.halfTilesX = 0.5f * width / TileSize;
+	c.halfTilesY = 0.5f * height / TileSize;
+	c.maxX = float(tilesX - 1);
+	c.maxY = float(tilesY - 1);
+	return c;
+}
+
+// Conservative screen bounds of a sphere: the box around it in view space,
+//   each side divided by whichever of its nearest and farthest depths
+//   pushes it further out.  Empty (x0 > x1) when nothing of it is on screen.
+void
+lightRect(const TileCamera& c, float x, float y, float z, float r, int& x0, int& x1, int& y0, int& y1)
+{
+	float vx = (c.view[0][0] * x + c.view[0][1] * y) + (c.view[0][2] * z + c.view[0][3]);
+	float vy = (c.view[1][0] * x + c.view[1][1] * y) + (c.view[1][2] * z + c.view[1][3]);
+	float d = -((c.view[2][0] * x + c.view[2][1] * y) + (c.view[2][2] * z + c.view[2][3]));
+
+	// reciprocals as the SSE path takes them, so both bin the same
+	float dMax = d + r;
+	float inMin = 1.0f / std::max(d - r, c.zNear), inMax = 1.0f / dMax;
+	float lx = vx - r, hx = vx + r, ly = vy - r, hy = vy + r;
+	float sx0 = c.p00 * (lx * (lx < 0.0f ? inMin : inMax));
+	float sx1 = c.p00 * (hx * (hx > 0.0f ? inMin : inMax));
+	float sy0 = c.p11 * (ly * (ly < 0.0f ? inMin : inMax));
+	float sy1 = c.p11 * (hy * (hy > 0.0f ? inMin : inMax));
+
+	if (dMax <= c.zNear || sx1 < -1.0f || sx0 > 1.0f || sy1 < -1.0f || sy0 > 1.0f) {
+		x0 = y0 = 1;
+		x1 = y1 = 0;
+		return;
+	}
+	x0 = int(std::min(std::max((sx0 + 1.0f) * c.halfTilesX, 0.0f), c.maxX));
+	x1 = int(std::min(std::max((sx1 + 1.0f) * c.halfTilesX, 0.0f), c.maxX));
+	y0 = int(std::min(std::max((sy0 + 1.0f) * c.halfTilesY, 0.0f), c.maxY));
+	y1 = int(std::min(std::max((sy1 + 1.0f) * c.halfTilesY, 0.0f), c.maxY));
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+
+void LightTiles::assign(const LightList& lights, const glm::mat4& view, const glm::mat4& proj, int width, int height)
+{
+	bounds(lights, view, proj, width, height, true);
+	bin(lights.size());
+}
+
+void LightTiles::assignScalar(const LightList& lights, const glm::mat4& view, const glm::mat4& proj, int width, int height)
+{
+	bounds(lights, view, proj, width, height, false);
+	bin(lights.size());
+}
+
+void LightTiles::bounds(const LightList& lights, const glm::mat4& view, const glm::mat4& proj, int width, int height,
+	bool simd)
+{
+	tilesX = (width + TileSize - 1) / TileSize;
+	tilesY = (height + TileSize - 1) / TileSize;
+	TileCamera c = tileCamera(view, proj, tilesX, tilesY, width, height);
+
+	int n = lights.size();
+	x0.resize(n); x1.resize(n); y0.resize(n); y1.resize(n);
+	int i = 0;
+
+#ifdef USE_SSE
+	if (simd) {
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f);
+		const __m128 zNear = _mm_set1_ps(c.zNear), p00 = _mm_set1_ps(c.p00), p11 = _mm_set1_ps(c.p11);
+		const __m128 halfX = _mm_set1_ps(c.halfTilesX), halfY = _mm_set1_ps(c.halfTilesY);
+		const __m128 maxX = _mm_set1_ps(c.maxX), maxY = _mm_set1_ps(c.maxY);
+		__m128 v[3][4];
+		for (int r = 0; r < 3; r++) {
+			for (int k = 0; k < 4; k++)
+				v[r][k] = _mm_set1_ps(c.view[r][k]);
+		}
+
+		// picks a where mask is set, else b
+		#define SELECT(mask, a, b) _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b))
+
+		for (; i + 4 <= n; i += 4) {
+			__m128 x = _mm_loadu_ps(&lights.x[i]), y = _mm_loadu_ps(&lights.y[i]);
+			__m128 z = _mm_loadu_ps(&lights.z[i]), r = _mm_loadu_ps(&lights.radius[i]);
+			__m128 vx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[0][0], x), _mm_mul_ps(v[0][1], y)),
+				_mm_add_ps(_mm_mul_ps(v[0][2], z), v[0][3]));
+			__m128 vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[1][0], x), _mm_mul_ps(v[1][1], y)),
+				_mm_add_ps(_mm_mul_ps(v[1][2], z), v[1][3]));
+			__m128 d = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[2][0], x), _mm_mul_ps(v[2][1], y)),
+				_mm_add_ps(_mm_mul_ps(v[2][2], z), v[2][3])));
+
+			__m128 dMax = _mm_add_ps(d, r);
+			__m128 inMin = _mm_div_ps(one, _mm_max_ps(_mm_sub_ps(d, r), zNear));
+			__m128 inMax = _mm_div_ps(one, dMax);
+			__m128 lx = _mm_sub_ps(vx, r), hx = _mm_add_ps(vx, r);
+			__m128 ly = _mm_sub_ps(vy, r), hy = _mm_add_ps(vy, r);
+			__m128 sx0 = _mm_mul_ps(p00, _mm_mul_ps(lx, SELECT(_mm_cmplt_ps(lx, zero), inMin, inMax)));
+			__m128 sx1 = _mm_mul_ps(p00, _mm_mul_ps(hx, SELECT(_mm_cmpgt_ps(hx, zero), inMin, inMax)));
+			__m128 sy0 = _mm_mul_ps(p11, _mm_mul_ps(ly, SELECT(_mm_cmplt_ps(ly, zero), inMin, inMax)));
+			__m128 sy1 = _mm_mul_ps(p11, _mm_mul_ps(hy, SELECT(_mm_cmpgt_ps(hy, zero), inMin, inMax)));
+
+			__m128 seen = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(dMax, zNear), _mm_cmpge_ps(sx1, minusOne)),
+				_mm_and_ps(_mm_and_ps(_mm_cmple_ps(sx0, one), _mm_cmpge_ps(sy1, minusOne)), _mm_cmple_ps(sy0, one)));
+
+			// clamped to the grid first, so truncation is floor
+			#define TILE(s, half, top) _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_add_ps(s, one), half), zero), top))
+			_mm_storeu_si128((__m128i*)&x0[i], TILE(sx0, halfX, maxX));
+			_mm_storeu_si128((__m128i*)&x1[i], TILE(sx1, halfX, maxX));
+			_mm_storeu_si128((__m128i*)&y0[i], TILE(sy0, halfY, maxY));
+			_mm_storeu_si128((__m128i*)&y1[i], TILE(sy1, halfY, maxY));
+			#undef TILE
+
+			int mask = _mm_movemask_ps(seen);
+			if (mask != 0xf) {
+				for (int k = 0; k < 4; k++) {
+					if (!(mask & (1 << k))) {
+						x0[i + k] = y0[i + k] = 1;
+						x1[i + k] = y1[i + k] = 0;
+					}
+				}
+			}
+		}
+		#undef SELECT
+	}
+#endif
+
+	for (; i < n; i++)
+		lightRect(c, lights.x[i], lights.y[i], lights.z[i], lights.radius[i], x0[i], x1[i], y0[i], y1[i]);
+}
+
+// Two passes over the rows of tiles (each row on one thread): count the
+//   lights per tile, then, once a prefix sum has placed the lists, fill them.
+void LightTiles::bin(int count)
+{
+	int tiles = tilesX * tilesY;
+	data.assign(tiles, 0);
+
+	parallelFor(tilesY, 4, [&](int begin, int end) {
+		for (int row = begin; row < end; row++) {
+			unsigned* header = &data[size_t(row) * tilesX];
+			for (int l = 0; l < count; l++) {
+				if (row < y0[l] || row > y1[l])
+					continue;
+				for (int t = x0[l]; t <= x1[l]; t++)
+					header[t] += header[t] < unsigned(MaxTileLights);
+			}
+		}
+	});
+
+	unsigned offset = unsigned(tiles);
+	for (int t = 0; t < tiles; t++) {
+		unsigned n = data[t];
+		data[t] = (offset << 8) | n;
+		offset += n;
+	}
+	lists = int(offset) - tiles;
+	data.resize(offset);
+
+	parallelFor(tilesY, 4, [&](int begin, int end) {
+		std::vector<unsigned> cursor(tilesX);
+		for (int row = begin; row < end; row++) {
+			const unsigned* header = &data[size_t(row) * tilesX];
+			for (int t = 0; t < tilesX; t++)
+				cursor[t] = header[t] >> 8;
+			for (int l = 0; l < count; l++) {
+				if (row < y0[l] || row > y1[l])
+					continue;
+				for (int t = x0[l]; t <= x1[l]; t++) {
+					if (cursor[t] < (header[t] >> 8) + (header[t] & 0xff))
+						data[cursor[t]++] = unsigned(l);
+				}
+			}
+		}
+	});
+}
+
+//----------------------------------------------------------------------------
+
+static GLuint lightsUbo, tileBuffer, tileTex;
+static LightTiles lightTiles;
+static LightBlock block;
+static std::vector<float> baseY, phase;		// per light, for the bobbing
+
+void lightsInit(int count)
+{
+	block = LightBlock();
+	block.ambient = glm::vec4(0.25f, 0.3f, 0.35f, 0.0f);
+	block.sunDirection = glm::vec4(glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f)), 0.0f);
+	block.sunColor = glm::vec4(0.8f, 0.78f, 0.7f, 0.0f);
+	block.tileGrid[0] = TileSize;		// no tiles until the first update
+
+	glGenBuffers(1, &lightsUbo);
+	glState.bindBuffer(GL_UNIFORM_BUFFER, lightsUbo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(block), &block, GL_STREAM_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LightsBinding, lightsUbo);
+
+	glGenBuffers(1, &tileBuffer);
+	glGenTextures(1, &tileTex);
+	glState.bindBuffer(GL_TEXTURE_BUFFER, tileBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(unsigned), NULL, GL_STREAM_DRAW);
+	glState.activeTexture(GL_TEXTURE2);
+	glState.bindTexture(GL_TEXTURE_BUFFER, tileTex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, tileBuffer);
+
+	lightsSetCount(count);
+}
+
+// a grid over the lanes, one light between each pair of rows and lanes
+void lightsSetCount(int count)
+{
+	static const glm::vec3 palette[4] = {
+		glm::vec3(0.3f, 0.8f, 1.0f), glm::vec3(1.0f, 0.85f, 0.6f),
+		glm::vec3(0.4f, 1.0f, 0.7f), glm::vec3(0.9f, 0.5f, 1.0f)
+	};
+
+	count = std::min(std::max(count, 0), MaxLights);
+	lights.resize(count);
+	baseY.resize(count);
+	phase.resize(count);
+
+	int lanes = std::max(int(std::ceil(std::sqrt(float(count)))), 1);
+	for (int i = 0; i < count; i++) {
+		lights.x[i] = (i / lanes) * LightSpacing - LightSpacing * 0.5f;
+		lights.z[i] = -(i % lanes) * LaneWidth + LaneWidth * 0.5f;
+		lights.y[i] = baseY[i] = LightDepth;
+		lights.radius[i] = LightRadius;
+		const glm::vec3& c = palette[i % 4];
+		lights.r[i] = c.r; lights.g[i] = c.g; lights.b[i] = c.b;
+		phase[i] = 0.37f * i;
+	}
+}
+
+int lightsCount()
+{
+	return lights.size();
+}
+
+glm::vec3 lightsSunDirection()
+{
+	return glm::vec3(block.sunDirection);
+}
+
+void lightsBindProgram(GLuint program)
+{
+	GLuint index = glGetUniformBlockIndex(program, "Lights");
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, index, LightsBinding);
+	glState.useProgram(program);
+	glState.uniform1i(glGetUniformLocation(program, "tileLights"), 2);
+}
+
+void lightsUpdate(float t, const glm::mat4& view, const glm::mat4& proj, int width, int height)
+{
+	Clock::time_point start = Clock::now();
+	int n = lights.size();
+	for (int i = 0; i < n; i++)
+		lights.y[i] = baseY[i] + 0.3f * std::sin(0.8f * t + phase[i]);
+
+	lightTiles.assign(lights, view, proj, width, height);
+
+	block.eyePosition = glm::inverse(view)[3];
+	block.tileGrid[1] = lightTiles.tilesAcross();
+	block.tileGrid[2] = lightTiles.tilesDown();
+	block.tileGrid[3] = n;
+	for (int i = 0; i < n; i++) {
+		block.lightPositions[i] = glm::vec4(lights.x[i], lights.y[i], lights.z[i], lights.radius[i]);
+		block.lightColors[i] = glm::vec4(lights.r[i], lights.g[i], lights.b[i], 0.0f);
+	}
+
+	// only the header and the lights in use
+	glState.bindBuffer(GL_UNIFORM_BUFFER, lightsUbo);
+	size_t header = offsetof(LightBlock, lightPositions);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, header, &block);
+	glBufferSubData(GL_UNIFORM_BUFFER, header, n * sizeof(glm::vec4), block.lightPositions);
+	glBufferSubData(GL_UNIFORM_BUFFER, offsetof(LightBlock, lightColors), n * sizeof(glm::vec4), block.lightColors);
+
+	const std::vector<unsigned>& texels = lightTiles.texels();
+	glState.bindBuffer(GL_TEXTURE_BUFFER, tileBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(unsigned), &texels[0], GL_STREAM_DRAW);
+	glState.activeTexture(GL_TEXTURE2);
+	glState.bindTexture(GL_TEXTURE_BUFFER, tileTex);
+
+	int tiles = lightTiles.tilesAcross() * lightTiles.tilesDown();
+	frameStats.bytesUploaded += header + 2 * n * sizeof(glm::vec4) + texels.size() * sizeof(unsigned);
+	frameStats.lights = n;
+	frameStats.lightsPerTile = tiles ? float(lightTiles.listed()) / tiles : 0.0f;
+	frameStats.lightsMs = float(msSince(start));
+}
+
+//----------------------------------------------------------------------------
+
+void lightsBenchmark()
+{
+	const int Counts[] = { 64, 256, 1024, 4096, 16384 };
+	const int Width = 1920, Height = 1080;
+	const int Frames = 20;
+
+	glm::mat4 proj = glm::perspective(glm::radians(65.0f), float(Width) / Height, 0.1f, 500.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(-10, 6, 10), glm::vec3(20, 0, -20), glm::vec3(0, 1, 0));
+
+	printf("%dx%d, %d pixel tiles, %d threads\n", Width, Height, TileSize, jobThreads());
+	printf("%8s %12s %12s %10s %14s %10s\n", "lights", "scalar ms", "SSE ms", "speedup", "lights/tile", "identical");
+	for (int c = 0; c < 5; c++) {
+		int n = Counts[c];
+		LightList list;
+		list.resize(n);
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> u(0.0f, 1.0f);
+		for (int i = 0; i < n; i++) {
+			list.x[i] = 60.0f * u(rng) - 10.0f;
+			list.y[i] = -2.0f * u(rng);
+			list.z[i] = -60.0f * u(rng) + 10.0f;
+			list.radius[i] = 2.0f + 4.0f * u(rng);
+		}
+
+		LightTiles scalar, simd;
+		Clock::time_point start = Clock::now();
+		for (int f = 0; f < Frames; f++)
+			scalar.assignScalar(list, view, proj, Width, Height);
+		double scalarMs = msSince(start) / Frames;
+
+		start = Clock::now();
+		for (int f = 0; f < Frames; f++)
+			simd.assign(list, view, proj, Width, Height);
+		double simdMs = msSince(start) / Frames;
+
+		int tiles = simd.tilesAcross() * simd.tilesDown();
+		printf("%8d %12.3f %12.3f %9.2fx %14.2f %10s\n", n, scalarMs, simdMs, scalarMs / simdMs,
+			float(simd.listed()) / tiles, scalar.texels() == simd.texels() ? "yes" : "NO");
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _LIGHTS_H_
+#define _LIGHTS_H_
+
+#include "cube.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Pool lights and tiled light assignment
+//
+//  Every point light lives in one uniform block (LightBlock) shared by all
+//    the lit programs, along with an ambient term and the sun.  Each frame
+//    the CPU bounds every light's sphere on screen, four lights at a time
+//    with SSE, and lists the lights touching each TileSize x TileSize pixel
+//    tile in a buffer texture: one header texel per tile (first index << 8
+//    | count), then the index lists.  A fragment only loops over its own
+//    tile's list, so the cost follows the lights per tile rather than the
+//    lights in the scene.
+//
+
+const int MaxLights = 256;			// as in fshader.glsl; 32 bytes each in the block
+const int MaxTileLights = 255;		// per tile, the header's count bits
+const int TileSize = 16;			// pixels
+const int LightsBinding = 0;		// uniform buffer binding point
+
+// world-space lights, one array per field
+struct LightList {
+	std::vector<float> x, y, z, radius;
+	std::vector<float> r, g, b;
+
+	int size() const { return int(x.size()); }
+	void resize(int n);
+};
+
+// std140 layout of the Lights block
+struct LightBlock {
+	glm::vec4 ambient;
+	glm::vec4 sunDirection;			// toward the sun
+	glm::vec4 sunColor;
+	glm::vec4 eyePosition;
+	int       tileGrid[4];			// tile size, tiles across, tiles down, lights
+	glm::vec4 lightPositions[MaxLights];	// xyz, radius
+	glm::vec4 lightColors[MaxLights];
+};
+
+class LightTiles {
+public:
+	LightTiles() : tilesX(0), tilesY(0), lists(0) {}
+
+	// Bins lights into tiles of a width x height viewport.  proj must be a
+	//   symmetric perspective projection.
+	void assign(const LightList& lights, const glm::mat4& view, const glm::mat4& proj, int width, int height);
+	void assignScalar(const LightList& lights, const glm::mat4& view, const glm::mat4& proj, int width, int height);
+
+	int tilesAcross() const { return tilesX; }
+	int tilesDown() const { return tilesY; }
+
+	// headers then index lists, as uploaded
+	const std::vector<unsigned>& texels() const { return data; }
+
+	// indices in all the lists, so per tile on average over the tile count
+	int listed() const { return lists; }
+
+private:
+	void bounds(const LightList& lights, const glm::mat4& view, const glm::mat4& proj, int width, int height, bool simd);
+	void bin(int count);
+
+	int tilesX, tilesY, lists;
+	std::vector<int> x0, x1, y0, y1;		// tile rectangle per light, empty if unseen
+	std::vector<unsigned> data;
+};
+
+extern LightList lights;
+
+// count pool lights in a grid over the crowd's lanes
+void lightsInit(int count);
+void lightsSetCount(int count);
+int lightsCount();
+
+// toward the sun, world space
+glm::vec3 lightsSunDirection();
+
+// attaches program's Lights block and tileLights sampler (unit 2)
+void lightsBindProgram(GLuint program);
+
+// moves the lights, bins them for this frame's camera and uploads both
+void lightsUpdate(float t, const glm::mat4& view, const glm::mat4& proj, int width, int height);
+
+// tile assignment cost, scalar vs SSE, vs light count, for --bench lights
+void lightsBenchmark();
+
+#endif // _LIGHTS_H_
@@ -0,0 +1,113 @@
+//
+// Swimmer level of detail, see lod.h
+//
+// With lo/hi the thresholds shrunk/grown by the hysteresis margin, a swimmer
+//   must be at least as coarse as the number of hi thresholds it is beyond and
+//   at most as coarse as the number of lo thresholds it is beyond; its level
+//   is last frame's clamped into that range.
+//
+
+#include "lod.h"
+#include "jobs.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <atomic>
+
+LodSettings lodSettings = { 12.0f, 30.0f, 0.1f, 256, 4096 };
+LodThresholds lodThresholds = { 12.0f, 30.0f };
+
+//----------------------------------------------------------------------------
+
+static void
+selectRange(const float* x, const float* y, const float* z, const int* ids, int begin, int end,
+	const glm::vec3& eye, unsigned char* level, int counts[NumLods])
+{
+	float h = lodSettings.hysteresis;
+	float lo1 = lodThresholds.merged * (1.0f - h), hi1 = lodThresholds.merged * (1.0f + h);
+	float lo2 = lodThresholds.impostor * (1.0f - h), hi2 = lodThresholds.impostor * (1.0f + h);
+	lo1 *= lo1; hi1 *= hi1; lo2 *= lo2; hi2 *= hi2;		// compared with squared distances
+
+	int i = begin;
+
+#ifdef USE_SSE
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 ex = _mm_set1_ps(eye.x), ey = _mm_set1_ps(eye.y), ez = _mm_set1_ps(eye.z);
+	const __m128 LO1 = _mm_set1_ps(lo1), HI1 = _mm_set1_ps(hi1), LO2 = _mm_set1_ps(lo2), HI2 = _mm_set1_ps(hi2);
+	for (; i + 4 <= end; i += 4) {
+		const int* id = ids + i;
+		__m128 dx = _mm_sub_ps(_mm_set_ps(x[id[3]], x[id[2]], x[id[1]], x[id[0]]), ex);
+		__m128 dy = _mm_sub_ps(_mm_set_ps(y[id[3]], y[id[2]], y[id[1]], y[id[0]]), ey);
+		__m128 dz = _mm_sub_ps(_mm_set_ps(z[id[3]], z[id[2]], z[id[1]], z[id[0]]), ez);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		__m128 coarsest = _mm_add_ps(_mm_and_ps(_mm_cmpgt_ps(d2, LO1), one), _mm_and_ps(_mm_cmpgt_ps(d2, LO2), one));
+		__m128 finest = _mm_add_ps(_mm_and_ps(_mm_cmpgt_ps(d2, HI1), one), _mm_and_ps(_mm_cmpgt_ps(d2, HI2), one));
+		__m128 cur = _mm_set_ps(level[id[3]], level[id[2]], level[id[1]], level[id[0]]);
+		__m128 next = _mm_min_ps(_mm_max_ps(cur, finest), coarsest);
+
+		SIMD_ALIGN(16) int out[4];
+		_mm_store_si128((__m128i*)out, _mm_cvttps_epi32(next));
+		for (int k = 0; k < 4; k++) {
+			level[id[k]] = (unsigned char)out[k];
+			counts[out[k]]++;
+		}
+	}
+#endif
+
+	for (; i < end; i++) {
+		int s = ids[i];
+		float dx = x[s] - eye.x, dy = y[s] - eye.y, dz = z[s] - eye.z;
+		float d2 = dx * dx + dy * dy + dz * dz;
+		int coarsest = (d2 > lo1) + (d2 > lo2);
+		int finest = (d2 > hi1) + (d2 > hi2);
+		int next = std::min(std::max(int(level[s]), finest), coarsest);
+		level[s] = (unsigned char)next;
+		counts[next]++;
+	}
+}
+
+void lodSelect(const float* x, const float* y, const float* z, const int* ids, int n,
+	const glm::vec3& eye, unsigned char* level, int counts[NumLods])
+{
+	std::atomic<int> total[NumLods];
+	for (int l = 0; l < NumLods; l++)
+		total[l] = 0;
+
+	// ids are distinct, so the batches write disjoint parts of level[]
+	parallelFor(n, 4096, [&](int begin, int end) {
+		int local[NumLods] = { 0 };
+		selectRange(x, y, z, ids, begin, end, eye, level, local);
+		for (int l = 0; l < NumLods; l++)
+			total[l] += local[l];
+	});
+
+	for (int l = 0; l < NumLods; l++)
+		counts[l] = total[l];
+}
+
+//----------------------------------------------------------------------------
+
+void lodAdapt(const int counts[NumLods])
+{
+	// a few percent a frame: fast enough to catch a doubled crowd within a
+	//   second, slow enough not to hunt around the budget
+	const float Shrink = 0.95f, Grow = 1.02f;
+
+	float& merged = lodThresholds.merged;
+	float& impostor = lodThresholds.impostor;
+
+	if (counts[LodFull] > lodSettings.fullBudget)
+		merged *= Shrink;
+	else if (counts[LodFull] < lodSettings.fullBudget * 3 / 4)
+		merged = std::min(merged * Grow, lodSettings.mergedDistance);
+
+	if (counts[LodMerged] > lodSettings.mergedBudget)
+		impostor *= Shrink;
+	else if (counts[LodMerged] < lodSettings.mergedBudget * 3 / 4)
+		impostor = std::min(impostor * Grow, lodSettings.impostorDistance);
+
+	// keep a merged band, however thin
+	merged = std::max(merged, 1.0f);
+	impostor = std::max(impostor, merged * 1.25f);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _LOD_H_
+#define _LOD_H_
+
+#include "glm/glm.hpp"
+
+//----------------------------------------------------------------------------
+//
+//  Distance-based level of detail for swimmers
+//
+//  Close swimmers are skinned meshes, all of them one instanced draw;
+//    mid-range ones one merged mesh of the current pose, far ones a
+//    billboard with a pre-baked stroke frame.  A swimmer keeps its level
+//    until it is past a threshold by the hysteresis margin, so standing on
+//    a boundary does not make it flicker.
+//
+//  The thresholds pull in while more swimmers than the budget are drawn at a
+//    level and drift back out to the configured distances when there is room,
+//    so the cost of a frame levels off as the crowd grows.
+//
+
+enum LodLevel {
+	LodFull = 0,
+	LodMerged = 1,
+	LodImpostor = 2,
+	NumLods
+};
+
+struct LodSettings {
+	float mergedDistance;		// furthest full-detail swimmer, when under budget
+	float impostorDistance;		// furthest merged swimmer, when under budget
+	float hysteresis;			// fraction of a threshold to pass before switching
+	int   fullBudget;			// swimmers drawn at full detail
+	int   mergedBudget;			// swimmers drawn as merged meshes
+};
+
+extern LodSettings lodSettings;
+
+// distances in use this frame, after adapting to the budgets
+struct LodThresholds {
+	float merged, impostor;
+};
+
+extern LodThresholds lodThresholds;
+
+// Updates level[] (indexed by swimmer, last frame's choice on entry) for the
+//   swimmers listed in ids, from their distance to eye, four at a time.
+//   counts[] receives how many of them ended up at each level.
+void lodSelect(const float* x, const float* y, const float* z, const int* ids, int n,
+	const glm::vec3& eye, unsigned char* level, int counts[NumLods]);
+
+// moves lodThresholds toward the budgets given this frame's counts
+void lodAdapt(const int counts[NumLods]);
+
+#endif // _LOD_H_
@@ -0,0 +1,328 @@
+//
+// FFT ocean surface, see ocean.h
+//
+// With ht the spectrum at time t, the packed transforms are
+//   F1 = ht + i (i kx ht)            -> height + i slopeX
+//   F2 = i kz ht + i (-i kx/k ht)    -> slopeZ + i dispX
+//   F3 = -i kz/k ht                  -> dispZ
+// (a real field's spectrum is Hermitian, so i times another one lands
+// entirely in the imaginary part of the result).
+//
+
+#include "ocean.h"
+#include "water.h"
+#include "renderqueue.h"
+#include "oit.h"
+#include "hud.h"
+#include "jobs.h"
+#include "streambuffer.h"
+#include "timing.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+const float Gravity = 9.81f;
+
+const int OceanTiles = 3;					// per side, centred on the origin
+const glm::vec2 OceanWind(6.0f, 2.0f);		// m/s
+const float OceanAmplitude = 0.08f;			// RMS height
+const float OceanChoppiness = 0.8f;
+
+//----------------------------------------------------------------------------
+
+void OceanSim::init(int size, float side, const glm::vec2& wind, float amplitude, float chop)
+{
+	n = size;
+	patchSize = side;
+	choppiness = chop;
+	fft.init(n);
+
+	size_t cells = size_t(n) * n;
+	h0Re.assign(cells, 0.0f); h0Im.assign(cells, 0.0f);
+	h0mRe.resize(cells); h0mIm.resize(cells);
+	omega.resize(cells);
+	kx.resize(cells); kz.resize(cells); kInv.resize(cells);
+	for (int f = 0; f < 3; f++) {
+		re[f].resize(cells);
+		im[f].resize(cells);
+	}
+
+	// Phillips spectrum: waves up to about V^2/g long, aligned with the wind,
+	//   with the very short ones damped
+	float speed = glm::length(wind);
+	glm::vec2 dir = wind / speed;
+	float longest = speed * speed / Gravity;
+	float shortest = longest * 0.001f;
+
+	std::mt19937 rng(1337);
+	std::normal_distribution<float> gauss;
+	const float TwoPi = 6.28318530718f;
+
+	for (int z = 0; z < n; z++) {
+		for (int x = 0; x < n; x++) {
+			size_t i = size_t(z) * n + x;
+			// natural FFT order: upper half of the indices are the negative frequencies
+			float fx = TwoPi * (x < n / 2 ? x : x - n) / side;
+			float fz = TwoPi * (z < n / 2 ? z : z - n) / side;
+			float k2 = fx * fx + fz * fz, k = std::sqrt(k2);
+			kx[i] = fx;
+			kz[i] = fz;
+			kInv[i] = k > 0.0f ? 1.0f / k : 0.0f;
+			omega[i] = std::sqrt(Gravity * k);
+
+			float a = gauss(rng), b = gauss(rng);
+			if (k2 == 0.0f || x == n / 2 || z == n / 2)
+				continue;	// no mean level, and Nyquist terms have no partner
+
+			float along = (fx * dir.x + fz * dir.y) / k;
+			float p = std::exp(-1.0f / (k2 * longest * longest)) / (k2 * k2) * along * along *
+				std::exp(-k2 * shortest * shortest);
+			if (along < 0.0f)
+				p *= 0.07f;		// little travelling against the wind
+			float s = std::sqrt(p * 0.5f);
+			h0Re[i] = a * s;
+			h0Im[i] = b * s;
+		}
+	}
+
+	// conj(h0(-k)); the mirror of index j is (n - j) mod n on both axes
+	double variance = 0.0;
+	for (int z = 0; z < n; z++) {
+		for (int x = 0; x < n; x++) {
+			size_t i = size_t(z) * n + x;
+			size_t m = size_t((n - z) % n) * n + (n - x) % n;
+			h0mRe[i] = h0Re[m];
+			h0mIm[i] = -h0Im[m];
+			variance += double(h0Re[i]) * h0Re[i] + double(h0Im[i]) * h0Im[i] +
+				double(h0mRe[i]) * h0mRe[i] + double(h0mIm[i]) * h0mIm[i];
+		}
+	}
+
+	// scale to the requested RMS height whatever the resolution
+	float scale = variance > 0.0 ? float(amplitude / std::sqrt(variance)) : 0.0f;
+	for (size_t i = 0; i < cells; i++) {
+		h0Re[i] *= scale; h0Im[i] *= scale;
+		h0mRe[i] *= scale; h0mIm[i] *= scale;
+	}
+}
+
+//----------------------------------------------------------------------------
+
+void OceanSim::update(float t, OceanVertex* out)
+{
+	Clock::time_point start = Clock::now();
+
+	// ht = h0 e^{i w t} + conj(h0(-k)) e^{-i w t}, then the packed spectra
+	parallelFor(n, 16, [&](int begin, int end) {
+		for (size_t i = size_t(begin) * n; i < size_t(end) * n; i++) {
+			float c = std::cos(omega[i] * t), s = std::sin(omega[i] * t);
+			float a = h0Re[i], b = h0Im[i], p = h0mRe[i], q = h0mIm[i];
+			float hr = (a + p) * c - (b - q) * s;
+			float hi = (a - p) * s + (b + q) * c;
+			float dx = kx[i] * kInv[i], dz = kz[i] * kInv[i];
+
+			re[0][i] = (1.0f - kx[i]) * hr;		im[0][i] = (1.0f - kx[i]) * hi;
+			re[1][i] = dx * hr - kz[i] * hi;	im[1][i] = dx * hi + kz[i] * hr;
+			re[2][i] = dz * hi;					im[2][i] = -dz * hr;
+		}
+	});
+	spectrumMs = msSince(start);
+
+	start = Clock::now();
+	for (int f = 0; f < 3; f++)
+		fft.inverse(&re[f][0], &im[f][0]);
+	fftMs = msSince(start);
+
+	// (n + 1)^2 vertices: the last row and column repeat the first one patch
+	//   further on, so neighbouring tiles share an edge
+	start = Clock::now();
+	float cell = patchSize / n;
+	int side = n + 1;
+	parallelFor(side, 16, [&](int begin, int end) {
+		for (int z = begin; z < end; z++) {
+			for (int x = 0; x < side; x++) {
+				size_t i = size_t(z % n) * n + x % n;
+				OceanVertex& v = out[size_t(z) * side + x];
+				v.x = (x - n / 2) * cell - choppiness * im[1][i];
+				v.y = re[0][i];
+				v.z = (z - n / 2) * cell - choppiness * re[2][i];
+				v.slopeX = im[0][i];
+				v.slopeZ = re[1][i];
+			}
+		}
+	});
+	writeMs = msSince(start);
+}
+
+//----------------------------------------------------------------------------
+
+static OceanSim sim;
+// one program per transparency mode, attributes at fixed locations
+struct OceanProgram {
+	GLuint program;
+	GLint  vpID, eyeID;
+};
+enum { OceanPosition, OceanSlope };
+
+static OceanProgram oceanPrograms[NumTransparencyModes];
+static GLuint oceanVao, indexBuffer;
+static GLsizei indexCount;
+static size_t gridVertices;
+static StreamBuffer grids;				// a grid per region
+
+static void
+createBuffers(int size)
+{
+	int side = size + 1;
+	gridVertices = size_t(side) * side;
+
+	// the old buffer's grids may still be in flight, GL keeps them alive
+	grids.create(gridVertices * sizeof(OceanVertex));
+
+	glState.bindVertexArray(oceanVao);
+	glState.bindBuffer(GL_ARRAY_BUFFER, grids.buffer());
+	glEnableVertexAttribArray(OceanPosition);
+	glVertexAttribPointer(OceanPosition, 3, GL_FLOAT, GL_FALSE, sizeof(OceanVertex), BUFFER_OFFSET(0));
+	glEnableVertexAttribArray(OceanSlope);
+	glVertexAttribPointer(OceanSlope, 2, GL_FLOAT, GL_FALSE, sizeof(OceanVertex),
+		BUFFER_OFFSET(offsetof(OceanVertex, slopeX)));
+
+	// two triangles per cell; the grid never changes shape, only its vertices move
+	std::vector<GLuint> indices;
+	indices.reserve(size_t(size) * size * 6);
+	for (int z = 0; z < size; z++) {
+		for (int x = 0; x < size; x++) {
+			GLuint i = GLuint(z * side + x);
+			GLuint quad[6] = { i, i + side, i + 1, i + 1, i + side, i + side + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+	indexCount = GLsizei(indices.size());
+	if (!indexBuffer)
+		glGenBuffers(1, &indexBuffer);
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+}
+
+void oceanInit(int size)
+{
+	static const char* attributes[3] = { "vPosition", "vSlope", NULL };
+	for (int m = 0; m < NumTransparencyModes; m++) {
+		OceanProgram& p = oceanPrograms[m];
+		p.program = oitSupported(TransparencyMode(m)) ?
+			oitBuildProgram("src/ocean_vshader.glsl", "src/ocean_fshader.glsl", TransparencyMode(m), attributes) : 0;
+		if (!p.program) {
+			if (m == TransparencySorted)
+				exit(EXIT_FAILURE);
+			continue;
+		}
+		p.vpID = glGetUniformLocation(p.program, "mVP");
+		p.eyeID = glGetUniformLocation(p.program, "eyePos");
+		glState.useProgram(p.program);
+		glState.uniform1f(glGetUniformLocation(p.program, "patchSize"), OceanPatch);
+		glState.uniform1i(glGetUniformLocation(p.program, "tiles"), OceanTiles);
+		glState.uniform1f(glGetUniformLocation(p.program, "level"), OceanLevel);
+		glState.uniform1i(glGetUniformLocation(p.program, "wake"), 1);
+		glState.uniform1f(glGetUniformLocation(p.program, "wakeExtent"), waterExtent());
+	}
+
+	glGenVertexArrays(1, &oceanVao);
+	oceanSetSize(size);
+}
+
+void oceanSetSize(int size)
+{
+	if (size < OceanMinSize)
+		size = OceanMinSize;
+	if (size > OceanMaxSize)
+		size = OceanMaxSize;
+	if (size == sim.size())
+		return;
+
+	sim.init(size, OceanPatch, OceanWind, OceanAmplitude, OceanChoppiness);
+	createBuffers(size);
+}
+
+int oceanSize()
+{
+	return sim.size();
+}
+
+//----------------------------------------------------------------------------
+
+void drawOcean(float t, const glm::mat4& vp, const glm::vec3& eye)
+{
+	// the job threads write the grid straight into the buffer; with the GPU
+	//   too far behind for that, the last grid is drawn again
+	OceanVertex* dst = (OceanVertex*)grids.begin(grids.regionBytes());
+	if (dst) {
+		Clock::time_point start = Clock::now();
+		sim.update(t, dst);
+		frameStats.oceanMs = float(msSince(start));
+		frameStats.oceanFftMs = float(sim.fftMs);
+		frameStats.oceanSize = sim.size();
+		grids.end();
+	}
+	else if (!grids.canRedraw()) {
+		return;
+	}
+
+	const OceanProgram& p = oceanPrograms[oitMode()].program ? oceanPrograms[oitMode()] : oceanPrograms[TransparencySorted];
+	glState.useProgram(p.program);
+	glState.uniform3f(p.eyeID, eye.x, eye.y, eye.z);
+
+	DrawItem item = DrawItem();
+	item.program = p.program;
+	item.vao = oceanVao;
+	item.mode = GL_TRIANGLES;
+	item.count = indexCount;
+	item.instances = OceanTiles * OceanTiles;
+	item.indexType = GL_UNSIGNED_INT;
+	item.baseVertex = GLint(grids.offset() / sizeof(OceanVertex));
+	item.textureTarget = GL_TEXTURE_2D;
+	item.texture = waterTexture();
+	item.matrixID = p.vpID;
+	item.matrix = vp;
+	renderQueue.submit(makeSortKey(PassTransparent, p.program, 0, 0.0f), item);
+}
+
+//----------------------------------------------------------------------------
+
+void oceanBenchmark()
+{
+	const int Reps = 5;
+
+	printf("%6s %12s %8s %9s %9s %12s %9s\n", "size", "spectrum ms", "fft ms", "write ms",
+		"total ms", "fft x1 sse", "fft x1 scalar");
+
+	for (int n = OceanMinSize; n <= OceanMaxSize; n *= 2) {
+		OceanSim s;
+		s.init(n, OceanPatch, OceanWind, OceanAmplitude, OceanChoppiness);
+		std::vector<OceanVertex> out(size_t(n + 1) * (n + 1));
+		s.update(0.0f, &out[0]);
+
+		double spectrum = 0.0, fftTime = 0.0, write = 0.0;
+		for (int r = 0; r < Reps; r++) {
+			s.update(r / 60.0f, &out[0]);
+			spectrum += s.spectrumMs;
+			fftTime += s.fftMs;
+			write += s.writeMs;
+		}
+		spectrum /= Reps; fftTime /= Reps; write /= Reps;
+
+		// one transform on its own, vectorized and threaded vs plain
+		FFT2D f;
+		f.init(n);
+		std::vector<float> re(size_t(n) * n, 1.0f), im(size_t(n) * n, 0.0f);
+		Clock::time_point t = Clock::now();
+		f.inverse(&re[0], &im[0]);
+		double sse = msSince(t);
+		t = Clock::now();
+		f.inverseScalar(&re[0], &im[0]);
+		double scalar = msSince(t);
+
+		printf("%6d %12.2f %8.2f %9.2f %9.2f %12.2f %9.2f\n", n, spectrum, fftTime, write,
+			spectrum + fftTime + write, sse, scalar);
+	}
+}
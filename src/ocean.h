@@ -0,0 +1,77 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _OCEAN_H_
+#define _OCEAN_H_
+
+#include "cube.h"
+#include "fft.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  FFT ocean surface (Tessendorf)
+//
+//  A Phillips spectrum is drawn once per resolution.  Each frame it is
+//    advanced to time t and turned into heights, slopes and horizontal
+//    (choppy) displacement by three inverse FFTs; two real fields share
+//    each complex transform.  The grid is written straight into a vertex
+//    buffer and tiled around the origin, the FFT being periodic.
+//
+//  The vertex buffer is a StreamBuffer (see streambuffer.h) holding a grid
+//    per region, so the CPU never writes a grid the GPU is still drawing.
+//
+
+const int OceanMinSize = 128;
+const int OceanMaxSize = 1024;
+
+const float OceanPatch = 64.0f;		// world units per FFT tile
+const float OceanLevel = -0.3f;		// mean surface height
+
+struct OceanVertex {
+	float x, y, z;				// displaced, within one patch
+	float slopeX, slopeZ;		// dh/dx, dh/dz
+};
+
+class OceanSim {
+public:
+	OceanSim() : n(0) {}
+
+	// size x size grid over a patch of side patchSize; amplitude is the RMS height
+	void init(int size, float patchSize, const glm::vec2& wind, float amplitude, float choppiness);
+
+	// the surface at time t (seconds), into (size + 1)^2 vertices, the last
+	//   row and column repeating the first
+	void update(float t, OceanVertex* out);
+
+	int size() const { return n; }
+	float patch() const { return patchSize; }
+
+	// timings of the last update
+	double spectrumMs, fftMs, writeMs;
+
+private:
+	int n;
+	float patchSize, choppiness;
+	FFT2D fft;
+	std::vector<float> h0Re, h0Im;			// h0(k)
+	std::vector<float> h0mRe, h0mIm;		// conj(h0(-k))
+	std::vector<float> omega;				// dispersion, sqrt(g |k|)
+	std::vector<float> kx, kz, kInv;		// wave vector, 1/|k| (0 at k = 0)
+	std::vector<float> re[3], im[3];		// h + i slopeX, slopeZ + i dispX, dispZ
+};
+
+void oceanInit(int size);
+void oceanSetSize(int size);				// clamped to OceanMinSize..OceanMaxSize
+int oceanSize();
+
+// simulates time t and queues the surface
+void drawOcean(float t, const glm::mat4& vp, const glm::vec3& eye);
+
+// spectrum, FFT and write timings (SSE vs scalar FFT) per resolution, for --bench ocean
+void oceanBenchmark();
+
+#endif // _OCEAN_H_
@@ -0,0 +1,26 @@
+#version 150
+
+// Transparent: the colour goes out through emitTransparent(), see oit.h
+
+in  vec3 normal;
+in  vec3 worldPos;
+
+uniform vec3 eyePos;
+
+const vec3 deep = vec3(0.0, 0.12, 0.22);
+const vec3 sky = vec3(0.55, 0.7, 0.85);
+const vec3 sunDir = vec3(0.3, 0.8, -0.52);	// normalized
+
+void main()
+{
+  vec3 n = normalize(normal);
+  vec3 v = normalize(eyePos - worldPos);
+
+  // Schlick fresnel between the water colour and the sky, plus a sun glint;
+  //   looking straight down shows what is under the surface, at grazing
+  //   angles the reflection hides it
+  float fresnel = 0.02 + 0.98 * pow(1.0 - max(dot(n, v), 0.0), 5.0);
+  float glint = pow(max(dot(n, normalize(v + sunDir)), 0.0), 200.0);
+
+  emitTransparent(vec4(mix(deep, sky, fresnel) + glint, mix(0.55, 1.0, fresnel)));
+}
@@ -0,0 +1,36 @@
+#version 150
+
+// One FFT patch per instance, tiles x tiles of them around the origin,
+// plus the swimmers' wakes from the water grid.
+
+in  vec3 vPosition;
+in  vec2 vSlope;		// dh/dx, dh/dz
+out vec3 normal;
+out vec3 worldPos;
+
+uniform mat4  mVP;
+uniform float patchSize;
+uniform int   tiles;
+uniform float level;
+uniform sampler2D wake;		// heights over [-wakeExtent/2, wakeExtent/2]^2
+uniform float wakeExtent;
+
+void main()
+{
+  vec2 tile = vec2(gl_InstanceID % tiles, gl_InstanceID / tiles) - float(tiles - 1) * 0.5;
+  vec3 p = vPosition + vec3(tile.x * patchSize, level, tile.y * patchSize);
+
+  // clamped at the edge, where the grid is flat
+  vec2 uv = p.xz / wakeExtent + 0.5;
+  float texel = 1.0 / float(textureSize(wake, 0).x);
+  vec2 wakeSlope = vec2(
+    textureLodOffset(wake, uv, 0.0, ivec2(1, 0)).r - textureLodOffset(wake, uv, 0.0, ivec2(-1, 0)).r,
+    textureLodOffset(wake, uv, 0.0, ivec2(0, 1)).r - textureLodOffset(wake, uv, 0.0, ivec2(0, -1)).r)
+    / (2.0 * texel * wakeExtent);
+  p.y += textureLod(wake, uv, 0.0).r;
+
+  vec2 slope = vSlope + wakeSlope;
+  normal = vec3(-slope.x, 1.0, -slope.y);
+  worldPos = p;
+  gl_Position = mVP * vec4(p, 1.0);
+}
@@ -0,0 +1,259 @@
+//
+// Transparency for the water surface and the particles, see oit.h
+//
+
+#include "oit.h"
+#include "fullscreen.h"
+#include "renderqueue.h"
+
+#include <string>
+#include <vector>
+
+const char* transparencyModeNames[NumTransparencyModes] = { "sorted blending", "weighted blended OIT", "per-pixel lists" };
+
+static const char* modeDefines[NumTransparencyModes] = { "OIT_SORTED", "OIT_WEIGHTED", "OIT_LINKED_LIST" };
+static const char* PreludeFile = "src/oit.glsl";
+
+static TransparencyMode mode = TransparencyWeighted;
+static char* prelude;
+static int width, height;		// of the targets below, 0 before the first oitBegin()
+static GLuint sceneFbo;			// the opaque scene, and where the layers end up
+
+// weighted: colour sum and transmittance, weight sum, and a copy of the scene's depth
+static GLuint weightedFbo, accumTex, weightTex, depthBuffer;
+static GLuint compositeProgram;
+
+// linked lists: heads image (cleared through listFbo), node and counter buffers
+static GLuint listFbo, headsTex, nodeBuffer, nodeTex, counterBuffer, counterTex;
+static GLuint resolveProgram;
+static GLint capacity;
+static std::vector<GLuint> listPrograms;		// built for TransparencyLinkedList, told the capacity
+
+//----------------------------------------------------------------------------
+
+GLuint oitBuildProgram(const char* vertexFile, const char* fragmentFile, TransparencyMode m,
+	const char* const* attributes)
+{
+	if (!prelude)
+		prelude = readShaderSource(PreludeFile);
+	char* vertexSource = readShaderSource(vertexFile);
+	char* fragmentSource = readShaderSource(fragmentFile);
+	if (!prelude || !vertexSource || !fragmentSource) {
+		std::cerr << "Failed to read " << (!prelude ? PreludeFile : !vertexSource ? vertexFile : fragmentFile) << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// #version, the mode, the prelude and then the shader, at its own line numbers
+	std::string header = std::string("#version 150\n#define ") + modeDefines[m] + "\n";
+	const char* fragment[4] = { header.c_str(), prelude, "#line 2\n", shaderBody(fragmentSource) };
+	GLuint vs = compileShaderSource(GL_VERTEX_SHADER, &vertexSource, 1);
+	GLuint fs = compileShaderSource(GL_FRAGMENT_SHADER, fragment, 4);
+
+	GLuint program = 0;
+	if (shaderCompiled(vs, vertexFile) && shaderCompiled(fs, fragmentFile)) {
+		program = glCreateProgram();
+		glAttachShader(program, vs);
+		glAttachShader(program, fs);
+		for (GLuint a = 0; attributes && attributes[a]; a++)
+			glBindAttribLocation(program, a, attributes[a]);
+		glBindFragDataLocation(program, 0, m == TransparencyWeighted ? "oitAccum" : "fColor");
+		if (m == TransparencyWeighted)
+			glBindFragDataLocation(program, 1, "oitWeight");
+		glLinkProgram(program);
+
+		std::string name = std::string(fragmentFile) + " (" + transparencyModeNames[m] + ")";
+		if (!programLinked(program, name.c_str())) {
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+	delete [] vertexSource;
+	delete [] fragmentSource;
+
+	// the list images keep their units for good; only the capacity changes
+	if (program && m == TransparencyLinkedList) {
+		glState.useProgram(program);
+		glState.uniform1i(glGetUniformLocation(program, "oitHeads"), 0);
+		glState.uniform1i(glGetUniformLocation(program, "oitNodes"), 1);
+		glState.uniform1i(glGetUniformLocation(program, "oitCounter"), 2);
+		glState.uniform1i(glGetUniformLocation(program, "oitCapacity"), capacity);
+		listPrograms.push_back(program);
+	}
+	return program;
+}
+
+//----------------------------------------------------------------------------
+
+void oitInit()
+{
+	compositeProgram = fullscreenProgram("src/oit_composite_fshader.glsl");
+	glState.useProgram(compositeProgram);
+	glState.uniform1i(glGetUniformLocation(compositeProgram, "oitAccum"), 0);
+	glState.uniform1i(glGetUniformLocation(compositeProgram, "oitWeight"), 1);
+
+	glGenFramebuffers(1, &weightedFbo);
+	glGenTextures(1, &accumTex);
+	glGenTextures(1, &weightTex);
+	glGenRenderbuffers(1, &depthBuffer);
+
+	if (GLEW_ARB_shader_image_load_store || GLEW_VERSION_4_2) {
+		resolveProgram = fullscreenProgram("src/oit_resolve_fshader.glsl");
+		glState.useProgram(resolveProgram);
+		glState.uniform1i(glGetUniformLocation(resolveProgram, "oitHeads"), 0);
+		glState.uniform1i(glGetUniformLocation(resolveProgram, "oitNodes"), 1);
+
+		glGenFramebuffers(1, &listFbo);
+		glGenTextures(1, &headsTex);
+		glGenBuffers(1, &nodeBuffer);
+		glGenTextures(1, &nodeTex);
+		glGenBuffers(1, &counterBuffer);
+		glGenTextures(1, &counterTex);
+		glState.bindBuffer(GL_TEXTURE_BUFFER, counterBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+		glState.bindTexture(GL_TEXTURE_BUFFER, counterTex);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, counterBuffer);
+	}
+}
+
+bool oitSupported(TransparencyMode m)
+{
+	return m != TransparencyLinkedList || resolveProgram != 0;
+}
+
+void oitSetMode(TransparencyMode m)
+{
+	if (oitSupported(m))
+		mode = m;
+}
+
+TransparencyMode oitMode()
+{
+	return mode;
+}
+
+static void
+colorTexture(GLuint tex, GLenum format, int w, int h)
+{
+	glState.bindTexture(GL_TEXTURE_2D, tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, format == GL_R32UI ? GL_RED_INTEGER : GL_RGBA,
+		format == GL_R32UI ? GL_UNSIGNED_INT : GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+// (re)allocates every target at the window size
+static void
+resize(int w, int h)
+{
+	width = w;
+	height = h;
+	glState.activeTexture(GL_TEXTURE0);
+
+	colorTexture(accumTex, GL_RGBA16F, w, h);
+	colorTexture(weightTex, GL_R16F, w, h);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+	glBindFramebuffer(GL_FRAMEBUFFER, weightedFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTex, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTex, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	const GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, buffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE && mode == TransparencyWeighted) {
+		std::cerr << "weighted OIT framebuffer incomplete, using sorted blending" << std::endl;
+		mode = TransparencySorted;
+	}
+
+	if (listFbo) {
+		colorTexture(headsTex, GL_R32UI, w, h);
+		glBindFramebuffer(GL_FRAMEBUFFER, listFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, headsTex, 0);
+
+		capacity = GLint(w) * h * OitNodesPerPixel;
+		glState.bindBuffer(GL_TEXTURE_BUFFER, nodeBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, size_t(capacity) * 4 * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+		glState.bindTexture(GL_TEXTURE_BUFFER, nodeTex);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, nodeBuffer);
+		for (size_t p = 0; p < listPrograms.size(); p++) {
+			glState.useProgram(listPrograms[p]);
+			glState.uniform1i(glGetUniformLocation(listPrograms[p], "oitCapacity"), capacity);
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+}
+
+//----------------------------------------------------------------------------
+
+void oitBegin(GLuint scene, int w, int h)
+{
+	sceneFbo = scene;
+	if (mode != TransparencySorted && (w != width || h != height))
+		resize(w, h);
+
+	glState.depthMask(GL_FALSE);
+	if (mode == TransparencySorted) {
+		glState.enable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	else if (mode == TransparencyWeighted) {
+		// the transparent layers test against the opaque scene's depth
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, weightedFbo);
+		glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, weightedFbo);
+
+		const GLfloat clearAccum[4] = { 0.0f, 0.0f, 0.0f, 1.0f }, clearWeight[4] = { 0.0f };
+		glClearBufferfv(GL_COLOR, 0, clearAccum);
+		glClearBufferfv(GL_COLOR, 1, clearWeight);
+		glState.enable(GL_BLEND);
+		glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	else {
+		const GLuint zero[4] = { 0 };
+		glBindFramebuffer(GL_FRAMEBUFFER, listFbo);
+		glClearBufferuiv(GL_COLOR, 0, zero);
+		glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+		glState.bindBuffer(GL_TEXTURE_BUFFER, counterBuffer);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(GLuint), zero);
+
+		// into the scene, whose depth does the testing; the lists take the colour
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glBindImageTexture(0, headsTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+		glBindImageTexture(1, nodeTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32UI);
+		glBindImageTexture(2, counterTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+	}
+}
+
+void oitEnd()
+{
+	renderQueue.flush();
+
+	if (mode == TransparencyWeighted) {
+		glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+		glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+		glState.disable(GL_DEPTH_TEST);
+		glState.useProgram(compositeProgram);
+		glState.activeTexture(GL_TEXTURE0);
+		glState.bindTexture(GL_TEXTURE_2D, accumTex);
+		glState.activeTexture(GL_TEXTURE1);
+		glState.bindTexture(GL_TEXTURE_2D, weightTex);
+		drawFullscreen();
+		glState.enable(GL_DEPTH_TEST);
+	}
+	else if (mode == TransparencyLinkedList) {
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glState.enable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+		glState.disable(GL_DEPTH_TEST);
+		glBindImageTexture(1, nodeTex, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32UI);
+		glState.useProgram(resolveProgram);
+		drawFullscreen();
+		glState.enable(GL_DEPTH_TEST);
+	}
+
+	glState.disable(GL_BLEND);
+	glState.depthMask(GL_TRUE);
+}
@@ -0,0 +1,54 @@
+// Transparent fragment output, spliced in front of a transparent fragment
+//   shader by oitBuildProgram() with one of OIT_SORTED, OIT_WEIGHTED or
+//   OIT_LINKED_LIST defined (see oit.h).  emitTransparent() takes a colour
+//   that is not premultiplied.
+
+#ifdef OIT_LINKED_LIST
+#extension GL_ARB_shader_image_load_store : require
+#endif
+
+#if defined(OIT_SORTED)
+
+out vec4 fColor;
+
+void emitTransparent(vec4 c)
+{
+  fColor = c;
+}
+
+#elif defined(OIT_WEIGHTED)
+
+out vec4 oitAccum;		// rgb weighted colour sum; alpha blends to the product of 1 - alpha
+out vec4 oitWeight;		// r weighted alpha sum
+
+// favours near and opaque fragments; the range keeps 16-bit floats in bounds
+void emitTransparent(vec4 c)
+{
+  float z = gl_FragCoord.z;
+  float w = clamp(pow(min(1.0, c.a * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - z * 0.9, 3.0), 1e-2, 3e3);
+  oitAccum = vec4(c.rgb * c.a * w, c.a);
+  oitWeight = vec4(c.a * w);
+}
+
+#elif defined(OIT_LINKED_LIST)
+
+// fragments hidden by the opaque scene must not be stored
+layout(early_fragment_tests) in;
+
+layout(r32ui) coherent uniform uimage2D oitHeads;		// per pixel first node + 1, 0 for none
+layout(rgba32ui) writeonly uniform uimageBuffer oitNodes;	// colour, depth, next + 1
+layout(r32ui) coherent uniform uimageBuffer oitCounter;	// nodes handed out
+uniform int oitCapacity;
+
+void emitTransparent(vec4 c)
+{
+  uint node = imageAtomicAdd(oitCounter, 0, 1u);
+  if (node >= uint(oitCapacity))
+    return;
+  uvec4 u = uvec4(clamp(c, 0.0, 1.0) * 255.0 + 0.5);
+  uint next = imageAtomicExchange(oitHeads, ivec2(gl_FragCoord.xy), node + 1u);
+  imageStore(oitNodes, int(node), uvec4(u.r | (u.g << 8) | (u.b << 16) | (u.a << 24),
+    floatBitsToUint(gl_FragCoord.z), next, 0u));
+}
+
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _OIT_H_
+#define _OIT_H_
+
+#include "cube.h"
+
+//----------------------------------------------------------------------------
+//
+//  Transparency for the water surface and the particles
+//
+//  Transparent fragment shaders end in emitTransparent(color), with color
+//    not premultiplied; oitBuildProgram() splices oit.glsl in front of them,
+//    which defines it for one TransparencyMode:
+//
+//    TransparencySorted      plain alpha blending into the scene, in
+//                            submission order; the particles are sorted
+//                            back to front on the CPU first
+//    TransparencyWeighted    weighted blended OIT: fragments add into a
+//                            weighted colour sum, a weight sum and a
+//                            product of transmittances (two float targets
+//                            and one blend state), which a full-screen pass
+//                            averages over the scene.  No sorting and no
+//                            per-pixel storage, at the price of an
+//                            approximation where layers differ strongly
+//    TransparencyLinkedList  every fragment is appended to a per-pixel list
+//                            (ARB_shader_image_load_store); a full-screen
+//                            pass sorts each list and blends it exactly,
+//                            up to OitMaxFragments layers.  For reference
+//
+//  Transparent draws are submitted between oitBegin() and oitEnd(), after
+//    the opaque scene has been drawn and its depth is final; they test
+//    against that depth and write none of their own.
+//
+
+enum TransparencyMode {
+	TransparencySorted,
+	TransparencyWeighted,
+	TransparencyLinkedList,
+	NumTransparencyModes
+};
+
+extern const char* transparencyModeNames[NumTransparencyModes];
+
+const int OitNodesPerPixel = 4;		// linked-list storage, on average over the screen
+const int OitMaxFragments = 16;		// as in oit_resolve_fshader.glsl; nearer ones are dropped
+
+void oitInit();
+bool oitSupported(TransparencyMode mode);
+
+void oitSetMode(TransparencyMode mode);
+TransparencyMode oitMode();
+
+// A program whose fragment shader writes through emitTransparent() in the
+//   given mode; 0, with the log printed, if it does not build.  attributes,
+//   NULL-terminated, get locations 0, 1, ... so one VAO serves every mode.
+GLuint oitBuildProgram(const char* vertexFile, const char* fragmentFile, TransparencyMode mode,
+	const char* const* attributes = NULL);
+
+// Redirects output for the current mode; the transparent draws follow.
+//   scene is the framebuffer holding the opaque scene (0 for the window),
+//   width x height, and bound.
+void oitBegin(GLuint scene, int width, int height);
+
+// flushes the queued transparent draws and composites them over the scene,
+//   leaving its framebuffer bound
+void oitEnd();
+
+#endif // _OIT_H_
@@ -0,0 +1,19 @@
+#version 150
+
+// Weighted blended OIT: the weighted average colour of a pixel's
+//   transparent fragments, with the product of their transmittances as
+//   alpha, blended over the opaque scene with (1 - alpha, alpha)
+
+uniform sampler2D oitAccum;
+uniform sampler2D oitWeight;
+out vec4 fColor;
+
+void main()
+{
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  vec4 accum = texelFetch(oitAccum, pixel, 0);
+  if (accum.a >= 1.0)
+    discard;		// nothing transparent here
+  float weight = texelFetch(oitWeight, pixel, 0).r;
+  fColor = vec4(accum.rgb / max(weight, 1e-5), accum.a);
+}
@@ -0,0 +1,65 @@
+#version 150
+#extension GL_ARB_shader_image_load_store : require
+
+// Linked-list OIT: sorts a pixel's fragments far to near and blends them,
+//   giving premultiplied colour and 1 - transmittance, blended over the
+//   opaque scene with (1, 1 - alpha)
+
+const int MaxFragments = 16;	// OitMaxFragments in oit.h
+
+layout(r32ui) coherent uniform uimage2D oitHeads;
+layout(rgba32ui) readonly uniform uimageBuffer oitNodes;
+out vec4 fColor;
+
+void main()
+{
+  vec4 colors[MaxFragments];
+  float depths[MaxFragments];
+  int n = 0;
+
+  // a full list keeps the nearest fragments
+  uint node = imageLoad(oitHeads, ivec2(gl_FragCoord.xy)).r;
+  while (node != 0u) {
+    uvec4 e = imageLoad(oitNodes, int(node - 1u));
+    vec4 c = vec4(uvec4(e.x, e.x >> 8, e.x >> 16, e.x >> 24) & 255u) / 255.0;
+    float z = uintBitsToFloat(e.y);
+    int i = n < MaxFragments ? n++ : MaxFragments;
+    if (i == MaxFragments) {
+      int farthest = 0;
+      for (int k = 1; k < MaxFragments; k++)
+        if (depths[k] > depths[farthest])
+          farthest = k;
+      if (z < depths[farthest])
+        i = farthest;
+    }
+    if (i < MaxFragments) {
+      colors[i] = c;
+      depths[i] = z;
+    }
+    node = e.z;
+  }
+  if (n == 0)
+    discard;
+
+  // insertion sort, farthest first
+  for (int i = 1; i < n; i++) {
+    vec4 c = colors[i];
+    float z = depths[i];
+    int j = i - 1;
+    while (j >= 0 && depths[j] < z) {
+      colors[j + 1] = colors[j];
+      depths[j + 1] = depths[j];
+      j--;
+    }
+    colors[j + 1] = c;
+    depths[j + 1] = z;
+  }
+
+  vec3 color = vec3(0.0);
+  float transmittance = 1.0;
+  for (int i = 0; i < n; i++) {
+    color = colors[i].rgb * colors[i].a + color * (1.0 - colors[i].a);
+    transmittance *= 1.0 - colors[i].a;
+  }
+  fColor = vec4(color, 1.0 - transmittance);
+}
@@ -0,0 +1,77 @@
+//
+// Overdraw heatmap, see overdraw.h
+//
+
+#include "overdraw.h"
+#include "fullscreen.h"
+#include "hud.h"
+
+#include <vector>
+
+static GLuint overdrawProgram;
+static GLint heatID;
+static bool enabled;
+static std::vector<unsigned char> counts;
+
+// shaded once, twice, ... OverdrawLevels or more
+static const float heatRamp[OverdrawLevels][3] = {
+	{ 0.0f, 0.0f, 0.6f }, { 0.0f, 0.4f, 1.0f }, { 0.0f, 0.8f, 0.6f }, { 0.4f, 1.0f, 0.0f },
+	{ 1.0f, 0.9f, 0.0f }, { 1.0f, 0.5f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f }
+};
+
+void overdrawInit()
+{
+	overdrawProgram = fullscreenProgram("src/overdraw_fshader.glsl");
+	heatID = glGetUniformLocation(overdrawProgram, "heat");
+}
+
+void overdrawToggle()
+{
+	enabled = !enabled;
+}
+
+bool overdrawEnabled()
+{
+	return enabled;
+}
+
+void overdrawBegin()
+{
+	if (!enabled)
+		return;
+	glClearStencil(0);
+	glStencilMask(~0u);
+	glClear(GL_STENCIL_BUFFER_BIT);
+	glState.enable(GL_STENCIL_TEST);
+	glStencilFunc(GL_ALWAYS, 0, ~0u);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+}
+
+void overdrawEnd(int width, int height)
+{
+	if (!enabled)
+		return;
+
+	// the average before the heatmap is drawn over the counts
+	counts.resize(size_t(width) * height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, &counts[0]);
+	long long fragments = 0;
+	for (size_t i = 0; i < counts.size(); i++)
+		fragments += counts[i];
+	frameStats.overdraw = counts.empty() ? 0.0f : float(double(fragments) / counts.size());
+
+	glClear(GL_COLOR_BUFFER_BIT);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+	glState.disable(GL_DEPTH_TEST);
+	glState.useProgram(overdrawProgram);
+	for (int level = 1; level <= OverdrawLevels; level++) {
+		// the last level takes every count from there up
+		glStencilFunc(level < OverdrawLevels ? GL_EQUAL : GL_LEQUAL, level, ~0u);
+		const float* c = heatRamp[level - 1];
+		glState.uniform3f(heatID, c[0], c[1], c[2]);
+		drawFullscreen();
+	}
+	glState.enable(GL_DEPTH_TEST);
+	glState.disable(GL_STENCIL_TEST);
+}
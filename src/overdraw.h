@@ -0,0 +1,34 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _OVERDRAW_H_
+#define _OVERDRAW_H_
+
+#include "cube.h"
+
+//----------------------------------------------------------------------------
+//
+//  Overdraw heatmap
+//
+//  While it is on, every fragment that passes the depth test increments
+//    the stencil buffer, so after the scene each pixel holds the number of
+//    times it was shaded (the depth pre-pass writes no stencil, so its
+//    depth-only fragments are not counted).  overdrawEnd() then replaces
+//    the picture with one full-screen pass per count, blue for once
+//    through red to white for OverdrawLevels or more, and reads the counts
+//    back for the average the HUD shows.  The read-back waits for the GPU,
+//    so this is a measuring mode, not something to leave on.
+//
+
+const int OverdrawLevels = 8;
+
+void overdrawInit();
+void overdrawToggle();
+bool overdrawEnabled();
+
+// around the scene's draws; nothing happens while the mode is off
+void overdrawBegin();
+void overdrawEnd(int width, int height);
+
+#endif // _OVERDRAW_H_
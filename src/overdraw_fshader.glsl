@@ -0,0 +1,11 @@
+#version 150
+
+// The heatmap colour of the fragment count the stencil test selected
+
+uniform vec3 heat;
+out vec4 fColor;
+
+void main()
+{
+  fColor = vec4(heat, 1.0);
+}
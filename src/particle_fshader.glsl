@@ -0,0 +1,14 @@
+#version 150
+
+// Transparent: the colour goes out through emitTransparent(), see oit.h
+
+in  vec2 corner;
+in  vec4 color;
+
+void main()
+{
+  float r = dot(corner, corner);
+  if (r > 1.0)
+    discard;
+  emitTransparent(vec4(color.rgb * (0.8 + 0.2 * r), color.a * (1.0 - r * r)));
+}
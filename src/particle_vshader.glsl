@@ -0,0 +1,25 @@
+#version 150
+
+// One camera-facing quad per particle, corners from gl_VertexID
+//   (drawn as a 4-vertex triangle strip, no vertex attributes).
+
+out vec2 corner;
+out vec4 color;		// alpha at the centre
+
+uniform mat4 mVP;
+uniform samplerBuffer particles;	// per instance: xyz, w = life left, negative for bubbles
+uniform vec3 cameraRight;			// camera axes scaled by the half size of a particle
+uniform vec3 cameraUp;
+
+void main()
+{
+  vec4 inst = texelFetch(particles, gl_InstanceID);
+  corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+
+  // shrink away over the last second
+  float size = abs(inst.w);
+  vec3 p = inst.xyz + size * (corner.x * cameraRight + corner.y * cameraUp);
+
+  color = inst.w < 0.0 ? vec4(0.7, 0.85, 1.0, 0.45) : vec4(0.95, 0.97, 1.0, 0.7);
+  gl_Position = mVP * vec4(p, 1.0);
+}
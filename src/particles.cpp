@@ -0,0 +1,460 @@
+//
+// Splash and bubble particles, see particles.h
+//
+
+#include "particles.h"
+#include "crowd.h"
+#include "ocean.h"
+#include "renderqueue.h"
+#include "oit.h"
+#include "hud.h"
+#include "jobs.h"
+#include "simd.h"
+#include "uploads.h"
+#include "timing.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+ParticleSystem particles;
+
+const int ParticleChunks = 64;			// per pass; a few per thread evens out the load
+const float ParticleGravity = 9.81f;
+const float BubbleLift = 3.0f;			// upward acceleration of a bubble
+const float ParticleDrag = 0.8f;		// fraction of velocity lost per second
+const float ParticleSize = 0.06f;		// half width of a quad at full life
+
+const float SplashRate = 250.0f;		// per hand per second, at the surface
+const float BubbleRate = 150.0f;
+const float EmitDepth = 0.5f;			// hands closer than this to the surface emit
+
+// xorshift; cheap enough to give every emitter its own stream
+static inline float
+randomUnit(unsigned& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+//----------------------------------------------------------------------------
+
+void ParticleSystem::Fields::resize(int n)
+{
+	x.resize(n); y.resize(n); z.resize(n);
+	vx.resize(n); vy.resize(n); vz.resize(n);
+	accel.resize(n); life.resize(n);
+}
+
+void ParticleSystem::Fields::swap(Fields& o)
+{
+	x.swap(o.x); y.swap(o.y); z.swap(o.z);
+	vx.swap(o.vx); vy.swap(o.vy); vz.swap(o.vz);
+	accel.swap(o.accel); life.swap(o.life);
+}
+
+void ParticleSystem::init(int n)
+{
+	capacity = n;
+	count = 0;
+	cur.resize(n);
+	next.resize(n);
+	instanceData.resize(n);
+	offsets.resize(ParticleChunks + 1);
+}
+
+//----------------------------------------------------------------------------
+
+void ParticleSystem::emit(const ParticleEmitter* emitters, int numEmitters, unsigned seed)
+{
+	if (numEmitters <= 0)
+		return;
+
+	if (int(offsets.size()) < numEmitters + 1)
+		offsets.resize(numEmitters + 1);
+	offsets[0] = 0;
+	for (int e = 0; e < numEmitters; e++)
+		offsets[e + 1] = std::min(offsets[e] + emitters[e].count, capacity - count);
+
+	parallelFor(numEmitters, 64, [&](int begin, int end) {
+		for (int e = begin; e < end; e++) {
+			const ParticleEmitter& em = emitters[e];
+			unsigned state = (seed ^ (unsigned(e) * 0x9E3779B9u)) | 1u;
+			for (int i = count + offsets[e]; i < count + offsets[e + 1]; i++) {
+				float jx = randomUnit(state) - 0.5f, jz = randomUnit(state) - 0.5f;
+				cur.x[i] = em.position.x + jx * 0.2f;
+				cur.z[i] = em.position.z + jz * 0.2f;
+				if (em.kind == ParticleSplash) {
+					// thrown up and outwards
+					cur.y[i] = em.position.y;
+					cur.vx[i] = jx * 3.0f;
+					cur.vy[i] = 2.0f + randomUnit(state) * 2.5f;
+					cur.vz[i] = jz * 3.0f;
+					cur.accel[i] = -ParticleGravity;
+					cur.life[i] = 1.0f + randomUnit(state);
+				}
+				else {
+					// trapped a little under the surface
+					cur.y[i] = em.position.y - 0.05f - randomUnit(state) * 0.4f;
+					cur.vx[i] = jx * 0.6f;
+					cur.vy[i] = 0.0f;
+					cur.vz[i] = jz * 0.6f;
+					cur.accel[i] = BubbleLift;
+					cur.life[i] = 1.5f + randomUnit(state) * 1.5f;
+				}
+				float fade = std::min(cur.life[i], 1.0f);
+				instanceData[i] = glm::vec4(cur.x[i], cur.y[i], cur.z[i], em.kind == ParticleBubble ? -fade : fade);
+			}
+		}
+	});
+	count += offsets[numEmitters];
+}
+
+//----------------------------------------------------------------------------
+
+// integrates [begin, end) in place and returns how many survive; the dead
+//   get a negative life
+static int
+integrate(float* x, float* y, float* z, float* vx, float* vy, float* vz, const float* accel,
+	float* life, int begin, int end, float dt, float level)
+{
+	float damp = std::max(1.0f - ParticleDrag * dt, 0.0f);
+	int alive = 0, i = begin;
+
+#ifdef USE_SSE
+	static const int bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+	__m128 vdt = _mm_set1_ps(dt), vdamp = _mm_set1_ps(damp), vlevel = _mm_set1_ps(level);
+	__m128 zero = _mm_setzero_ps(), dead = _mm_set1_ps(-1.0f);
+	for (; i + 4 <= end; i += 4) {
+		__m128 a = _mm_loadu_ps(accel + i);
+		__m128 nvx = _mm_mul_ps(_mm_loadu_ps(vx + i), vdamp);
+		__m128 nvy = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vy + i), _mm_mul_ps(a, vdt)), vdamp);
+		__m128 nvz = _mm_mul_ps(_mm_loadu_ps(vz + i), vdamp);
+		__m128 ny = _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(nvy, vdt));
+		_mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(nvx, vdt)));
+		_mm_storeu_ps(y + i, ny);
+		_mm_storeu_ps(z + i, _mm_add_ps(_mm_loadu_ps(z + i), _mm_mul_ps(nvz, vdt)));
+		_mm_storeu_ps(vx + i, nvx);
+		_mm_storeu_ps(vy + i, nvy);
+		_mm_storeu_ps(vz + i, nvz);
+
+		// alive while life remains and still on its own side of the surface
+		__m128 l = _mm_sub_ps(_mm_loadu_ps(life + i), vdt);
+		__m128 ok = _mm_and_ps(_mm_cmpgt_ps(l, zero),
+			_mm_cmple_ps(_mm_mul_ps(_mm_sub_ps(ny, vlevel), a), zero));
+		_mm_storeu_ps(life + i, _mm_or_ps(_mm_and_ps(ok, l), _mm_andnot_ps(ok, dead)));
+		alive += bits[_mm_movemask_ps(ok)];
+	}
+#endif
+	for (; i < end; i++) {
+		vx[i] *= damp;
+		vy[i] = (vy[i] + accel[i] * dt) * damp;
+		vz[i] *= damp;
+		x[i] += vx[i] * dt;
+		y[i] += vy[i] * dt;
+		z[i] += vz[i] * dt;
+		life[i] -= dt;
+		if (life[i] > 0.0f && (y[i] - level) * accel[i] <= 0.0f)
+			alive++;
+		else
+			life[i] = -1.0f;
+	}
+	return alive;
+}
+
+void ParticleSystem::update(float dt, float level)
+{
+	if (count == 0)
+		return;
+
+	// chunks start on a multiple of four so the SSE loop covers them whole
+	int per = ((count + ParticleChunks - 1) / ParticleChunks + 3) & ~3;
+	int chunks = (count + per - 1) / per;
+
+	parallelFor(chunks, 1, [&](int begin, int end) {
+		for (int c = begin; c < end; c++) {
+			int first = c * per, last = std::min(first + per, count);
+			offsets[c + 1] = integrate(&cur.x[0], &cur.y[0], &cur.z[0], &cur.vx[0], &cur.vy[0], &cur.vz[0],
+				&cur.accel[0], &cur.life[0], first, last, dt, level);
+		}
+	});
+
+	offsets[0] = 0;
+	for (int c = 0; c < chunks; c++)
+		offsets[c + 1] += offsets[c];
+
+	parallelFor(chunks, 1, [&](int begin, int end) {
+		for (int c = begin; c < end; c++) {
+			int o = offsets[c];
+			for (int i = c * per; i < std::min(c * per + per, count); i++) {
+				if (cur.life[i] <= 0.0f)
+					continue;
+				next.x[o] = cur.x[i]; next.y[o] = cur.y[i]; next.z[o] = cur.z[i];
+				next.vx[o] = cur.vx[i]; next.vy[o] = cur.vy[i]; next.vz[o] = cur.vz[i];
+				next.accel[o] = cur.accel[i];
+				next.life[o] = cur.life[i];
+				float fade = std::min(cur.life[i], 1.0f);
+				instanceData[o] = glm::vec4(cur.x[i], cur.y[i], cur.z[i], cur.accel[i] > 0.0f ? -fade : fade);
+				o++;
+			}
+		}
+	});
+
+	cur.swap(next);
+	count = offsets[chunks];
+}
+
+//----------------------------------------------------------------------------
+
+// one program per transparency mode
+struct ParticleProgram {
+	GLuint program;
+	GLint  vpID, cameraRightID, cameraUpID;
+};
+
+static ParticleProgram particlePrograms[NumTransparencyModes];
+static GLuint particleVao;
+static InstanceStream particleStream;
+static std::vector<SortEntry> sortEntries, sortScratch;
+static std::vector<glm::vec4> sortedInstances;
+static std::vector<ParticleEmitter> emitters;
+static unsigned frameSeed = 1;
+static float lastMs;
+
+void particlesInit(int capacity)
+{
+	for (int m = 0; m < NumTransparencyModes; m++) {
+		ParticleProgram& p = particlePrograms[m];
+		p.program = oitSupported(TransparencyMode(m)) ?
+			oitBuildProgram("src/particle_vshader.glsl", "src/particle_fshader.glsl", TransparencyMode(m)) : 0;
+		if (!p.program) {
+			if (m == TransparencySorted)
+				exit(EXIT_FAILURE);
+			continue;
+		}
+		p.vpID = glGetUniformLocation(p.program, "mVP");
+		p.cameraRightID = glGetUniformLocation(p.program, "cameraRight");
+		p.cameraUpID = glGetUniformLocation(p.program, "cameraUp");
+		glState.useProgram(p.program);
+		glState.uniform1i(glGetUniformLocation(p.program, "particles"), 0);
+	}
+	glGenVertexArrays(1, &particleVao);
+	createInstanceStream(particleStream);
+
+	particles.init(capacity);
+}
+
+void particlesAdvance(float dt, const glm::vec3 tips[NumLimbTips])
+{
+	Clock::time_point start = Clock::now();
+	particles.update(dt, OceanLevel);
+
+	// each hand near the surface throws up a splash and drags bubbles under
+	unsigned state = frameSeed * 0x2545F491u | 1u;
+	emitters.clear();
+	for (int i = 0; i < crowd.size(); i++) {
+		float s = std::sin(crowd.heading[i]), c = std::cos(crowd.heading[i]);
+		for (int t = TipRightHand; t <= TipLeftHand; t++) {
+			float depth = std::fabs(crowd.y[i] + tips[t].y - OceanLevel);
+			if (depth >= EmitDepth)
+				continue;
+			float x = crowd.x[i] + c * tips[t].x + s * tips[t].z;
+			float z = crowd.z[i] - s * tips[t].x + c * tips[t].z;
+			float closeness = (1.0f - depth / EmitDepth) * dt;
+
+			// fractional counts carry over on average
+			ParticleEmitter e = { glm::vec3(x, OceanLevel, z), int(SplashRate * closeness + randomUnit(state)), ParticleSplash };
+			emitters.push_back(e);
+			e.count = int(BubbleRate * closeness + randomUnit(state));
+			e.kind = ParticleBubble;
+			emitters.push_back(e);
+		}
+	}
+	particles.emit(emitters.empty() ? NULL : &emitters[0], int(emitters.size()), frameSeed++);
+	lastMs = float(msSince(start));
+}
+
+// Farthest first along the view direction, for plain alpha blending.  The
+//   keys are depths with the bits flipped to sort descending; a particle
+//   behind the camera counts as depth 0 and goes last, clipped anyway.
+static const glm::vec4*
+sortBackToFront(const glm::vec4* instances, int n, const glm::mat4& view)
+{
+	glm::vec3 forward(-view[0][2], -view[1][2], -view[2][2]);
+	sortEntries.resize(n);
+	for (int i = 0; i < n; i++) {
+		float depth = std::max(glm::dot(glm::vec3(instances[i]), forward) - view[3][2], 0.0f);
+		unsigned bits;
+		memcpy(&bits, &depth, sizeof(bits));
+		sortEntries[i].key = ~bits;
+		sortEntries[i].index = unsigned(i);
+	}
+	radixSort(sortEntries, sortScratch);
+
+	sortedInstances.resize(n);
+	for (int i = 0; i < n; i++)
+		sortedInstances[i] = instances[sortEntries[i].index];
+	return &sortedInstances[0];
+}
+
+// queues n particles for the current transparency mode
+static void
+submitParticles(const glm::vec4* instances, int n, const glm::mat4& vp, const glm::mat4& view)
+{
+	TransparencyMode mode = oitMode();
+	const ParticleProgram& p = particlePrograms[mode].program ? particlePrograms[mode] : particlePrograms[TransparencySorted];
+
+	if (mode == TransparencySorted) {
+		Clock::time_point start = Clock::now();
+		instances = sortBackToFront(instances, n, view);
+		frameStats.particlesSortMs = float(msSince(start));
+	}
+
+	// camera axes are the rows of the view matrix
+	glm::vec3 right = glm::vec3(view[0][0], view[1][0], view[2][0]) * ParticleSize;
+	glm::vec3 up = glm::vec3(view[0][1], view[1][1], view[2][1]) * ParticleSize;
+	glState.useProgram(p.program);
+	glState.uniform3f(p.cameraRightID, right.x, right.y, right.z);
+	glState.uniform3f(p.cameraUpID, up.x, up.y, up.z);
+
+	// through the upload ring, copied in by the job threads; directly if it has no room
+	size_t bytes = n * sizeof(glm::vec4);
+	UploadRing::Staging s;
+	if (uploadRing.stage(bytes, s)) {
+		uploadRing.fill(s, 0, instances, bytes);
+		uploadRing.commit(s);
+		reserveInstances(particleStream, bytes);
+		uploadRing.copyToBuffer(s, 0, particleStream.buffer, 0, bytes);
+	}
+	else {
+		uploadInstances(particleStream, instances, bytes);
+	}
+
+	DrawItem item = DrawItem();
+	item.program = p.program;
+	item.vao = particleVao;
+	item.mode = GL_TRIANGLE_STRIP;
+	item.count = 4;
+	item.instances = n;
+	item.instanceTex = particleStream.tex;
+	item.matrixID = p.vpID;
+	item.matrix = vp;
+	renderQueue.submit(makeSortKey(PassTransparent, p.program, 0, 0.0f), item);
+}
+
+void drawParticles(const glm::mat4& vp, const glm::mat4& view)
+{
+	frameStats.particles = particles.size();
+	frameStats.particlesMs = lastMs;
+	if (particles.size() == 0)
+		return;
+	submitParticles(particles.instances(), particles.size(), vp, view);
+}
+
+//----------------------------------------------------------------------------
+
+void particlesBenchmark()
+{
+	const int Capacity = 1 << 20;
+	const int NumEmitters = 1024;
+	const int Frames = 60;
+	const float Dt = 1.0f / 60.0f;
+
+	std::vector<int> threadCounts;
+	for (int t = 1; t < jobThreads(); t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(jobThreads());
+
+	ParticleSystem s;
+	s.init(Capacity);
+	std::vector<ParticleEmitter> em(NumEmitters);
+	unsigned state = 12345u;
+	for (int e = 0; e < NumEmitters; e++) {
+		em[e].position = glm::vec3(randomUnit(state) * 100.0f, 0.0f, randomUnit(state) * -100.0f);
+		em[e].kind = e & 1 ? ParticleBubble : ParticleSplash;
+	}
+
+	printf("%8s %10s %10s %12s %8s\n", "threads", "particles", "ms/frame", "Mparticles/s", "60 Hz");
+	for (size_t r = 0; r < threadCounts.size(); r++) {
+		setJobThreads(threadCounts[r]);
+		s.clear();
+
+		// every frame tops the system back up to capacity, so it runs full
+		double ms = 0.0;
+		long long processed = 0;
+		for (int f = 0; f < Frames + 10; f++) {
+			Clock::time_point start = Clock::now();
+			int before = s.size();
+			s.update(Dt, 0.0f);
+			int room = Capacity - s.size();
+			for (int e = 0; e < NumEmitters; e++)
+				em[e].count = room / NumEmitters + (e < room % NumEmitters ? 1 : 0);
+			s.emit(&em[0], NumEmitters, unsigned(f + 1));
+			if (f >= 10) {		// skip the fill-up
+				ms += msSince(start);
+				processed += before;
+			}
+		}
+		ms /= Frames;
+		printf("%8d %10d %10.2f %12.1f %8s\n", threadCounts[r], s.size(), ms,
+			processed / (ms * Frames * 1000.0), ms < 1000.0 / 60.0 ? "yes" : "no");
+	}
+	setJobThreads(0);
+}
+
+//----------------------------------------------------------------------------
+
+void transparencyBenchmark()
+{
+	const int MaxCount = 1 << 20;
+	const int Reps = 10;
+	int width = glutGet(GLUT_WINDOW_WIDTH), height = glutGet(GLUT_WINDOW_HEIGHT);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 6.0f), glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0, 1, 0));
+	glm::mat4 vp = glm::perspective(glm::radians(65.0f), float(width) / height, 0.1f, 100.0f) * view;
+
+	// a cloud in front of the camera, every other particle a bubble
+	std::vector<glm::vec4> cloud(MaxCount);
+	unsigned state = 12345u;
+	for (int i = 0; i < MaxCount; i++) {
+		float life = 0.3f + 0.7f * randomUnit(state);
+		cloud[i] = glm::vec4(randomUnit(state) * 16.0f - 8.0f, randomUnit(state) * 4.0f - 2.0f,
+			randomUnit(state) * -20.0f, i & 1 ? -life : life);
+	}
+
+	TransparencyMode saved = oitMode();
+	printf("%10s %10s %12s %12s %12s\n", "particles", "sort ms", "sorted ms", "weighted ms", "lists ms");
+	for (int n = 1 << 10; n <= MaxCount; n *= 4) {
+		Clock::time_point start = Clock::now();
+		for (int r = 0; r < Reps; r++)
+			sortBackToFront(&cloud[0], n, view);
+		double sortMs = msSince(start) / Reps;
+
+		// whole frames: clear, sort if sorting, upload, draw, composite, and wait for the GPU
+		char cells[NumTransparencyModes][16];
+		for (int m = 0; m < NumTransparencyModes; m++) {
+			if (!oitSupported(TransparencyMode(m))) {
+				snprintf(cells[m], sizeof(cells[m]), "-");
+				continue;
+			}
+			oitSetMode(TransparencyMode(m));
+			glFinish();
+			start = Clock::now();
+			for (int r = 0; r < Reps; r++) {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				oitBegin(0, width, height);
+				submitParticles(&cloud[0], n, vp, view);
+				oitEnd();
+				uploadRing.endFrame();
+				glFinish();
+			}
+			snprintf(cells[m], sizeof(cells[m]), "%.2f", msSince(start) / Reps);
+		}
+		printf("%10d %10.2f %12s %12s %12s\n", n, sortMs, cells[TransparencySorted], cells[TransparencyWeighted],
+			cells[TransparencyLinkedList]);
+	}
+	oitSetMode(saved);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PARTICLES_H_
+#define _PARTICLES_H_
+
+#include "cube.h"
+#include "swimmer.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Splash and bubble particles
+//
+//  Particles are kept as separate arrays per field, allocated once at the
+//    full capacity, so a frame does no allocation once the crowd stops
+//    growing.  A frame runs three passes, each split into fixed chunks
+//    across the job threads:
+//
+//    update   integrates four particles per SSE op and marks the dead ones
+//    compact  copies the survivors of each chunk to its offset (a prefix
+//             sum of the chunk counts) in the second set of arrays, writing
+//             their render instances as it goes
+//    emit     appends each emitter's particles at its own prefix offset
+//
+//  Splashes fly up from the surface and die when they fall back through
+//    it; bubbles rise and die when they reach it.  The two are told apart
+//    by the sign of their vertical acceleration.
+//
+
+enum ParticleKind { ParticleSplash, ParticleBubble };
+
+struct ParticleEmitter {
+	glm::vec3 position;
+	int       count;
+	int       kind;
+};
+
+class ParticleSystem {
+public:
+	ParticleSystem() : capacity(0), count(0) {}
+
+	void init(int capacity);
+	void clear() { count = 0; }
+
+	// emitters that do not fit in the remaining capacity are cut short;
+	//   seed varies the spray from frame to frame
+	void emit(const ParticleEmitter* emitters, int numEmitters, unsigned seed);
+
+	// advances dt seconds against a surface at height level and drops the dead
+	void update(float dt, float level);
+
+	int size() const { return count; }
+
+	// per particle: xyz, w = remaining life (capped at 1), negative for bubbles
+	const glm::vec4* instances() const { return &instanceData[0]; }
+
+private:
+	struct Fields {
+		std::vector<float> x, y, z, vx, vy, vz, accel, life;
+		void resize(int n);
+		void swap(Fields& o);
+	};
+
+	int capacity, count;
+	Fields cur, next;
+	std::vector<glm::vec4> instanceData;
+	std::vector<int> offsets;		// scratch for the prefix sums
+};
+
+extern ParticleSystem particles;
+
+void particlesInit(int capacity);
+
+// emits from every swimmer's hands near the surface and steps dt seconds;
+//   tips as from swimmerLimbTips
+void particlesAdvance(float dt, const glm::vec3 tips[NumLimbTips]);
+
+// queues the particles as camera-facing quads
+void drawParticles(const glm::mat4& vp, const glm::mat4& view);
+
+// frame time vs thread count at a million particles, for --bench particles
+void particlesBenchmark();
+
+// sorted blending vs weighted OIT vs per-pixel lists from a thousand to a
+//   million particles, for --bench oit
+void transparencyBenchmark();
+
+#endif // _PARTICLES_H_
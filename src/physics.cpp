@@ -0,0 +1,245 @@
+//
+// Buoyancy and drag on swimmers, see physics.h
+//
+
+#include "physics.h"
+#include "crowd.h"
+#include "ocean.h"
+#include "jobs.h"
+#include "simd.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+bool physicsEnabled = true;
+
+const float WaterDensity = 1.0f;
+const float SwimmerDensity = 0.7f;		// relative to water, so they float
+const float DragCoefficient = 1.0f;
+const float PhysicsGravity = 9.81f;
+const int PhysicsBatch = 256;			// bodies per job
+
+//----------------------------------------------------------------------------
+
+void bodyPose(const glm::mat4 prev[NumJoints], const glm::mat4 cur[NumJoints], float dt, BodyPose& pose)
+{
+	glm::vec3 centers[NumJoints], extents[NumJoints];
+	glm::vec3 before[NumJoints], unused[NumJoints];
+	swimmerPartBoxes(cur, centers, extents);
+	if (dt > 0.0f)
+		swimmerPartBoxes(prev, before, unused);
+
+	pose.mass = 0.0f;
+	pose.inertia = 0.0f;
+	for (int j = 0; j < NumJoints; j++) {
+		glm::vec3 v = dt > 0.0f ? (centers[j] - before[j]) / dt : glm::vec3(0.0f);
+		glm::vec3 size = extents[j] * 2.0f;
+		float volume = size.x * size.y * size.z;
+		float area = (size.x * size.y + size.y * size.z + size.z * size.x) / 3.0f;	// mean face
+
+		pose.cx[j] = centers[j].x; pose.cy[j] = centers[j].y; pose.cz[j] = centers[j].z;
+		pose.vx[j] = v.x; pose.vy[j] = v.y; pose.vz[j] = v.z;
+		pose.halfY[j] = extents[j].y;
+		pose.volume[j] = volume;
+		pose.dragFactor[j] = 0.5f * WaterDensity * DragCoefficient * area;
+
+		float m = volume * SwimmerDensity * WaterDensity;
+		pose.mass += m;
+		pose.inertia += m * (centers[j].x * centers[j].x + centers[j].z * centers[j].z +
+			(size.x * size.x + size.z * size.z) / 12.0f);
+	}
+}
+
+//----------------------------------------------------------------------------
+
+static void
+stepBody(const RigidBodies& b, const BodyPose& pose, float level, float dt, int i)
+{
+	float s = std::sin(b.heading[i]), c = std::cos(b.heading[i]);
+	float w = b.yawRate[i];
+	float fx = 0.0f, fy = 0.0f, fz = 0.0f, torque = 0.0f, buoyant = 0.0f;
+
+	for (int j = 0; j < NumJoints; j++) {
+		// box offset and stroke velocity turned to world axes
+		float rx = c * pose.cx[j] + s * pose.cz[j], rz = -s * pose.cx[j] + c * pose.cz[j];
+		float lx = c * pose.vx[j] + s * pose.vz[j], lz = -s * pose.vx[j] + c * pose.vz[j];
+
+		float bottom = b.y[i] + pose.cy[j] - pose.halfY[j];
+		float sub = std::min(std::max((level - bottom) / (2.0f * pose.halfY[j]), 0.0f), 1.0f);
+		buoyant += pose.volume[j] * sub;
+
+		// velocity through the water, including the spin about +y
+		float ux = b.vx[i] + lx + w * rz, uy = b.vy[i] + pose.vy[j], uz = b.vz[i] + lz - w * rx;
+		float k = -pose.dragFactor[j] * sub * std::sqrt(ux * ux + uy * uy + uz * uz);
+		fx += k * ux; fy += k * uy; fz += k * uz;
+		torque += rz * k * ux - rx * k * uz;
+	}
+
+	fy += (buoyant * WaterDensity - pose.mass) * PhysicsGravity;
+
+	// semi-implicit Euler
+	b.vx[i] += fx / pose.mass * dt;
+	b.vy[i] += fy / pose.mass * dt;
+	b.vz[i] += fz / pose.mass * dt;
+	b.yawRate[i] += torque / pose.inertia * dt;
+	b.x[i] += b.vx[i] * dt;
+	b.y[i] += b.vy[i] * dt;
+	b.z[i] += b.vz[i] * dt;
+	b.heading[i] += b.yawRate[i] * dt;
+}
+
+#ifdef USE_SSE
+static void
+stepFour(const RigidBodies& b, const BodyPose& pose, float level, float dt, int i)
+{
+	SIMD_ALIGN(16) float sines[4], cosines[4];
+	for (int k = 0; k < 4; k++) {
+		sines[k] = std::sin(b.heading[i + k]);
+		cosines[k] = std::cos(b.heading[i + k]);
+	}
+	__m128 s = _mm_load_ps(sines), c = _mm_load_ps(cosines);
+	__m128 w = _mm_loadu_ps(b.yawRate + i);
+	__m128 y = _mm_loadu_ps(b.y + i);
+	__m128 vx = _mm_loadu_ps(b.vx + i), vy = _mm_loadu_ps(b.vy + i), vz = _mm_loadu_ps(b.vz + i);
+	__m128 vlevel = _mm_set1_ps(level), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	__m128 fx = zero, fy = zero, fz = zero, torque = zero, buoyant = zero;
+
+	for (int j = 0; j < NumJoints; j++) {
+		__m128 cx = _mm_set1_ps(pose.cx[j]), cz = _mm_set1_ps(pose.cz[j]);
+		__m128 px = _mm_set1_ps(pose.vx[j]), pz = _mm_set1_ps(pose.vz[j]);
+		__m128 rx = _mm_add_ps(_mm_mul_ps(c, cx), _mm_mul_ps(s, cz));
+		__m128 rz = _mm_sub_ps(_mm_mul_ps(c, cz), _mm_mul_ps(s, cx));
+		__m128 lx = _mm_add_ps(_mm_mul_ps(c, px), _mm_mul_ps(s, pz));
+		__m128 lz = _mm_sub_ps(_mm_mul_ps(c, pz), _mm_mul_ps(s, px));
+
+		__m128 bottom = _mm_add_ps(y, _mm_set1_ps(pose.cy[j] - pose.halfY[j]));
+		__m128 sub = _mm_mul_ps(_mm_sub_ps(vlevel, bottom), _mm_set1_ps(1.0f / (2.0f * pose.halfY[j])));
+		sub = _mm_min_ps(_mm_max_ps(sub, zero), one);
+		buoyant = _mm_add_ps(buoyant, _mm_mul_ps(_mm_set1_ps(pose.volume[j]), sub));
+
+		__m128 ux = _mm_add_ps(_mm_add_ps(vx, lx), _mm_mul_ps(w, rz));
+		__m128 uy = _mm_add_ps(vy, _mm_set1_ps(pose.vy[j]));
+		__m128 uz = _mm_sub_ps(_mm_add_ps(vz, lz), _mm_mul_ps(w, rx));
+		__m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, ux), _mm_mul_ps(uy, uy)), _mm_mul_ps(uz, uz)));
+		__m128 k = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(-pose.dragFactor[j]), sub), speed);
+		__m128 dx = _mm_mul_ps(k, ux), dz = _mm_mul_ps(k, uz);
+		fx = _mm_add_ps(fx, dx);
+		fy = _mm_add_ps(fy, _mm_mul_ps(k, uy));
+		fz = _mm_add_ps(fz, dz);
+		torque = _mm_add_ps(torque, _mm_sub_ps(_mm_mul_ps(rz, dx), _mm_mul_ps(rx, dz)));
+	}
+
+	__m128 g = _mm_set1_ps(PhysicsGravity);
+	fy = _mm_add_ps(fy, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(buoyant, _mm_set1_ps(WaterDensity)), _mm_set1_ps(pose.mass)), g));
+
+	__m128 vdt = _mm_set1_ps(dt);
+	__m128 step = _mm_set1_ps(dt / pose.mass);
+	vx = _mm_add_ps(vx, _mm_mul_ps(fx, step));
+	vy = _mm_add_ps(vy, _mm_mul_ps(fy, step));
+	vz = _mm_add_ps(vz, _mm_mul_ps(fz, step));
+	w = _mm_add_ps(w, _mm_mul_ps(torque, _mm_set1_ps(dt / pose.inertia)));
+	_mm_storeu_ps(b.vx + i, vx);
+	_mm_storeu_ps(b.vy + i, vy);
+	_mm_storeu_ps(b.vz + i, vz);
+	_mm_storeu_ps(b.yawRate + i, w);
+	_mm_storeu_ps(b.x + i, _mm_add_ps(_mm_loadu_ps(b.x + i), _mm_mul_ps(vx, vdt)));
+	_mm_storeu_ps(b.y + i, _mm_add_ps(y, _mm_mul_ps(vy, vdt)));
+	_mm_storeu_ps(b.z + i, _mm_add_ps(_mm_loadu_ps(b.z + i), _mm_mul_ps(vz, vdt)));
+	_mm_storeu_ps(b.heading + i, _mm_add_ps(_mm_loadu_ps(b.heading + i), _mm_mul_ps(w, vdt)));
+}
+#endif
+
+void physicsStep(const RigidBodies& bodies, const BodyPose& pose, float level, float dt)
+{
+	parallelFor(bodies.count, PhysicsBatch, [&](int begin, int end) {
+		int i = begin;
+#ifdef USE_SSE
+		for (; i + 4 <= end; i += 4)
+			stepFour(bodies, pose, level, dt, i);
+#endif
+		for (; i < end; i++)
+			stepBody(bodies, pose, level, dt, i);
+	});
+}
+
+void physicsStepScalar(const RigidBodies& bodies, const BodyPose& pose, float level, float dt)
+{
+	parallelFor(bodies.count, PhysicsBatch, [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			stepBody(bodies, pose, level, dt, i);
+	});
+}
+
+//----------------------------------------------------------------------------
+
+static glm::mat4 lastPalette[NumJoints];
+static bool haveLast;
+static float pendingTime;
+
+void physicsAdvance(float dt, const glm::mat4 palette[NumJoints])
+{
+	if (!physicsEnabled || crowd.size() == 0) {
+		haveLast = false;
+		return;
+	}
+
+	// the stroke velocities come from how far the boxes moved over this frame
+	BodyPose pose;
+	bodyPose(lastPalette, palette, haveLast ? dt : 0.0f, pose);
+	std::copy(palette, palette + NumJoints, lastPalette);
+	haveLast = true;
+
+	pendingTime += dt;
+	int steps = int(pendingTime / PhysicsStep);
+	pendingTime -= steps * PhysicsStep;
+	if (steps > PhysicsMaxSteps)
+		steps = PhysicsMaxSteps;
+
+	RigidBodies b = { &crowd.x[0], &crowd.y[0], &crowd.z[0], &crowd.heading[0],
+		&crowd.vx[0], &crowd.vy[0], &crowd.vz[0], &crowd.yawRate[0], crowd.size() };
+	for (int k = 0; k < steps; k++)
+		physicsStep(b, pose, OceanLevel, PhysicsStep);
+}
+
+//----------------------------------------------------------------------------
+
+void physicsBenchmark()
+{
+	const int Steps = 20;
+
+	glm::mat4 prev[NumJoints], cur[NumJoints];
+	swimmerPalette(0.0f, 0.0f, prev);
+	swimmerPalette(0.05f, 0.02f, cur);
+	BodyPose pose;
+	bodyPose(prev, cur, PhysicsStep, pose);
+
+	printf("%8s %12s %12s %12s\n", "bodies", "scalar /ms", "sse /ms", "threads");
+	for (int n = 1024; n <= (1 << 20); n *= 4) {
+		std::vector<float> fields[8];
+		for (int f = 0; f < 8; f++)
+			fields[f].assign(n, 0.0f);
+		for (int i = 0; i < n; i++) {
+			fields[0][i] = float(i % 1024);		// spread out, partly submerged
+			fields[1][i] = -0.3f * float(i % 3);
+			fields[3][i] = 0.001f * i;
+		}
+		RigidBodies b = { &fields[0][0], &fields[1][0], &fields[2][0], &fields[3][0],
+			&fields[4][0], &fields[5][0], &fields[6][0], &fields[7][0], n };
+
+		double rate[2];
+		for (int path = 0; path < 2; path++) {
+			Clock::time_point start = Clock::now();
+			for (int s = 0; s < Steps; s++) {
+				if (path == 0)
+					physicsStepScalar(b, pose, OceanLevel, PhysicsStep);
+				else
+					physicsStep(b, pose, OceanLevel, PhysicsStep);
+			}
+			rate[path] = double(n) * Steps / msSince(start);
+		}
+		printf("%8d %12.0f %12.0f %12d\n", n, rate[0], rate[1], jobThreads());
+	}
+}
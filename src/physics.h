@@ -0,0 +1,63 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PHYSICS_H_
+#define _PHYSICS_H_
+
+#include "swimmer.h"
+#include "glm/glm.hpp"
+
+//----------------------------------------------------------------------------
+//
+//  Buoyancy and drag on swimmers as rigid bodies
+//
+//  Each swimmer is one rigid body moving in x, y, z and turning about +y.
+//    Every box of the rig adds buoyancy for its submerged volume and
+//    quadratic drag for its velocity through the water, which is the body's
+//    velocity plus the box's own velocity in the stroke.  A limb sweeping
+//    back underwater therefore pushes the body forward; the same limb in
+//    the air pushes nothing.
+//
+//  The stroke is the same for every swimmer, so the per-box terms are
+//    worked out once per frame (BodyPose) and the step runs over the crowd
+//    four bodies at a time with SSE, in batches across the job threads.
+//
+
+const float PhysicsStep = 1.0f / 120.0f;	// seconds per step
+const int PhysicsMaxSteps = 8;				// per advance; a longer stall drops time
+
+// the rig's boxes in one pose, swimmer space
+struct BodyPose {
+	float cx[NumJoints], cy[NumJoints], cz[NumJoints];		// box centres
+	float vx[NumJoints], vy[NumJoints], vz[NumJoints];		// their stroke velocities
+	float halfY[NumJoints];									// vertical half extent
+	float volume[NumJoints];
+	float dragFactor[NumJoints];	// 1/2 rho Cd A
+	float mass, inertia;			// inertia about +y
+};
+
+// pose now and how far the boxes moved since prev, dt seconds ago (0 for none)
+void bodyPose(const glm::mat4 prev[NumJoints], const glm::mat4 cur[NumJoints], float dt, BodyPose& pose);
+
+// the integrator's view of the bodies, as kept by Crowd
+struct RigidBodies {
+	float *x, *y, *z, *heading;
+	float *vx, *vy, *vz, *yawRate;
+	int count;
+};
+
+// one step of dt seconds against a water surface at height level
+void physicsStep(const RigidBodies& bodies, const BodyPose& pose, float level, float dt);
+void physicsStepScalar(const RigidBodies& bodies, const BodyPose& pose, float level, float dt);
+
+extern bool physicsEnabled;
+
+// moves the crowd through dt seconds of animation in fixed steps, driven by
+//   the stroke in palette (from swimmerPalette)
+void physicsAdvance(float dt, const glm::mat4 palette[NumJoints]);
+
+// bodies per millisecond vs crowd size and path, for --bench physics
+void physicsBenchmark();
+
+#endif // _PHYSICS_H_
@@ -0,0 +1,22 @@
+#version 150
+
+// One direction of a 9-tap Gaussian, in five bilinear fetches; the
+//   target may be smaller than the source, which then downsamples too
+
+uniform sampler2D source;
+uniform vec2 direction;		// one source texel along the blur, in texture coordinates
+in vec2 texCoord;
+out vec4 fColor;
+
+const float Offsets[3] = float[3](0.0, 1.3846153846, 3.2307692308);
+const float Weights[3] = float[3](0.2270270270, 0.3162162162, 0.0702702703);
+
+void main()
+{
+  vec3 sum = texture(source, texCoord).rgb * Weights[0];
+  for (int i = 1; i < 3; i++) {
+    sum += texture(source, texCoord + direction * Offsets[i]).rgb * Weights[i];
+    sum += texture(source, texCoord - direction * Offsets[i]).rgb * Weights[i];
+  }
+  fColor = vec4(sum, 1.0);
+}
@@ -0,0 +1,16 @@
+#version 150
+
+// Bloom's bright pass at half resolution: one bilinear fetch averages each
+//   2x2 block, and only the light above the threshold is kept
+
+uniform sampler2D source;
+uniform float threshold;		// luminance
+in vec2 texCoord;
+out vec4 fColor;
+
+void main()
+{
+  vec3 c = texture(source, texCoord).rgb;
+  float luminance = dot(c, vec3(0.2126, 0.7152, 0.0722));
+  fColor = vec4(c * max(luminance - threshold, 0.0) / max(luminance, 1e-4), 1.0);
+}
@@ -0,0 +1,25 @@
+#version 150
+
+// Caustics at half resolution: where the surface seen at a pixel lies under
+//   the water, the animated caustics texture projected straight down onto
+//   it, fading with depth below the surface
+
+uniform sampler2D halfDepth;	// linear view depth
+uniform sampler2D causticsMap;	// repeating, mipmapped
+uniform mat4 cameraToWorld;
+uniform vec2 tanHalf;			// of the field of view, across and up
+uniform float level;			// of the water surface
+uniform float period;			// world units per repeat of the map
+out vec4 fColor;
+
+void main()
+{
+  vec2 size = vec2(textureSize(halfDepth, 0));
+  vec2 ndc = gl_FragCoord.xy / size * 2.0 - 1.0;
+  float d = texelFetch(halfDepth, ivec2(gl_FragCoord.xy), 0).r;
+  vec3 p = (cameraToWorld * vec4(ndc * tanHalf * d, -d, 1.0)).xyz;
+
+  float below = level - p.y;
+  float c = below > 0.0 ? texture(causticsMap, p.xz / period).r * exp(-0.3 * below) * min(below * 4.0, 1.0) : 0.0;
+  fColor = vec4(c);
+}
@@ -0,0 +1,24 @@
+#version 150
+
+// Linear view depth at half resolution: the nearest of each 2x2 block of
+//   the scene's depth buffer
+
+uniform sampler2D sceneDepth;
+uniform vec2 planes;		// near, far
+out vec4 fColor;
+
+float linearDepth(float d)
+{
+  float z = d * 2.0 - 1.0;
+  return 2.0 * planes.x * planes.y / (planes.y + planes.x - z * (planes.y - planes.x));
+}
+
+void main()
+{
+  ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+  ivec2 last = textureSize(sceneDepth, 0) - 1;
+  float nearest = 1.0;
+  for (int k = 0; k < 4; k++)
+    nearest = min(nearest, texelFetch(sceneDepth, min(base + ivec2(k & 1, k >> 1), last), 0).r);
+  fColor = vec4(linearDepth(nearest));
+}
@@ -0,0 +1,24 @@
+#version 150
+
+// The scene plus its bloom, tonemapped into the window with a fitted
+//   filmic curve, or only clamped; a scene smaller than the window is
+//   filtered up
+
+uniform sampler2D sceneColor;
+uniform sampler2D bloom;		// quarter resolution, filtered up
+uniform float bloomStrength;	// 0 for no bloom
+uniform int tonemap;
+in vec2 texCoord;
+out vec4 fColor;
+
+vec3 filmic(vec3 x)
+{
+  return clamp(x * (2.51 * x + 0.03) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main()
+{
+  vec3 c = texture(sceneColor, texCoord).rgb;
+  c += bloomStrength * texture(bloom, texCoord).rgb;
+  fColor = vec4(tonemap != 0 ? filmic(c) : clamp(c, 0.0, 1.0), 1.0);
+}
@@ -0,0 +1,74 @@
+#version 150
+
+// Caustics and fog over the opaque scene.  The half-resolution caustics
+//   are brought up with a bilateral filter: the four nearest samples,
+//   bilinear weights scaled down where their depth strays from the pixel's,
+//   so the pattern does not bleed across silhouettes.  Fog thickens along
+//   the part of the view ray that runs under the surface.
+
+uniform sampler2D sceneColor;
+uniform sampler2D sceneDepth;
+uniform sampler2D halfDepth;	// linear view depth
+uniform sampler2D caustics;
+uniform mat4 cameraToWorld;
+uniform vec2 tanHalf;			// of the field of view, across and up
+uniform vec2 planes;			// near, far
+uniform float level;			// of the water surface
+uniform float fogDensity;		// 0 for no fog
+uniform float causticStrength;	// 0 for no caustics
+out vec4 fColor;
+
+const vec3 FogColor = vec3(0.05, 0.25, 0.35);
+
+float linearDepth(float d)
+{
+  float z = d * 2.0 - 1.0;
+  return 2.0 * planes.x * planes.y / (planes.y + planes.x - z * (planes.y - planes.x));
+}
+
+float upsampleCaustics(float depth)
+{
+  vec2 h = gl_FragCoord.xy * 0.5 - 0.5;
+  ivec2 base = ivec2(floor(h));
+  vec2 f = h - vec2(base);
+  ivec2 last = textureSize(halfDepth, 0) - 1;
+
+  float sum = 0.0, weights = 0.0;
+  for (int k = 0; k < 4; k++) {
+    ivec2 o = ivec2(k & 1, k >> 1);
+    ivec2 p = clamp(base + o, ivec2(0), last);
+    vec2 b = mix(1.0 - f, f, vec2(o));
+    float w = b.x * b.y / (0.01 + abs(texelFetch(halfDepth, p, 0).r - depth) / depth);
+    sum += w * texelFetch(caustics, p, 0).r;
+    weights += w;
+  }
+  return weights > 0.0 ? sum / weights : 0.0;
+}
+
+// length of the segment from e to p below the surface
+float underwaterLength(vec3 e, vec3 p)
+{
+  float a = level - e.y, b = level - p.y;
+  if (a <= 0.0 && b <= 0.0)
+    return 0.0;
+  float len = length(p - e);
+  if (a > 0.0 && b > 0.0)
+    return len;
+  return len * max(a, b) / abs(a - b);
+}
+
+void main()
+{
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  vec3 color = texelFetch(sceneColor, pixel, 0).rgb;
+  float d = linearDepth(texelFetch(sceneDepth, pixel, 0).r);
+
+  vec2 ndc = gl_FragCoord.xy / vec2(textureSize(sceneDepth, 0)) * 2.0 - 1.0;
+  vec3 p = (cameraToWorld * vec4(ndc * tanHalf * d, -d, 1.0)).xyz;
+  vec3 eye = cameraToWorld[3].xyz;
+
+  if (causticStrength > 0.0)
+    color *= 1.0 + causticStrength * upsampleCaustics(d);
+  float fog = 1.0 - exp(-fogDensity * underwaterLength(eye, p));
+  fColor = vec4(mix(color, FogColor, fog), 1.0);
+}
@@ -0,0 +1,223 @@
+//
+// Post-processing, see postfx.h
+//
+
+#include "postfx.h"
+#include "caustics.h"
+#include "fullscreen.h"
+#include "gputimer.h"
+#include "hud.h"
+#include "ocean.h"
+#include "rendertarget.h"
+
+#include <algorithm>
+
+const float FogDensity = 0.12f;			// per unit of underwater path
+const float CausticStrength = 0.8f;		// brightening at the brightest lines
+const float BloomThreshold = 0.8f;		// luminance the bright pass keeps above
+const float BloomStrength = 0.6f;
+
+unsigned postEffects = PostAll;
+
+static int sceneWidth, sceneHeight;
+static int windowWidth, windowHeight;	// postFinish()'s output
+static RenderTexture *sceneColor, *sceneDepth;
+static GpuTimer underwaterTimer, finishTimer;
+
+static GLuint depthProgram, causticsProgram, underwaterProgram, brightProgram, blurProgram, finishProgram;
+static GLint depthPlanesID;
+static GLint causticsCameraID, causticsTanID, causticsLevelID;
+static GLint underwaterCameraID, underwaterTanID, underwaterPlanesID, underwaterLevelID, fogDensityID, causticStrengthID;
+static GLint thresholdID, blurStepID, bloomStrengthID, tonemapID;
+
+//----------------------------------------------------------------------------
+
+// a full-screen program with fragmentFile, its samplers on units 0, 1, ...
+static GLuint
+buildPass(const char* fragmentFile, const char* const* samplers)
+{
+	GLuint program = fullscreenProgram(fragmentFile);
+	glState.useProgram(program);
+	for (int unit = 0; samplers[unit]; unit++)
+		glState.uniform1i(glGetUniformLocation(program, samplers[unit]), unit);
+	return program;
+}
+
+void postInit()
+{
+	const char* const depthSamplers[] = { "sceneDepth", NULL };
+	depthProgram = buildPass("src/post_depth_fshader.glsl", depthSamplers);
+	depthPlanesID = glGetUniformLocation(depthProgram, "planes");
+
+	const char* const causticsSamplers[] = { "halfDepth", "causticsMap", NULL };
+	causticsProgram = buildPass("src/post_caustics_fshader.glsl", causticsSamplers);
+	causticsCameraID = glGetUniformLocation(causticsProgram, "cameraToWorld");
+	causticsTanID = glGetUniformLocation(causticsProgram, "tanHalf");
+	causticsLevelID = glGetUniformLocation(causticsProgram, "level");
+	glState.uniform1f(glGetUniformLocation(causticsProgram, "period"), CausticsPeriod);
+
+	const char* const underwaterSamplers[] = { "sceneColor", "sceneDepth", "halfDepth", "caustics", NULL };
+	underwaterProgram = buildPass("src/post_underwater_fshader.glsl", underwaterSamplers);
+	underwaterCameraID = glGetUniformLocation(underwaterProgram, "cameraToWorld");
+	underwaterTanID = glGetUniformLocation(underwaterProgram, "tanHalf");
+	underwaterPlanesID = glGetUniformLocation(underwaterProgram, "planes");
+	underwaterLevelID = glGetUniformLocation(underwaterProgram, "level");
+	fogDensityID = glGetUniformLocation(underwaterProgram, "fogDensity");
+	causticStrengthID = glGetUniformLocation(underwaterProgram, "causticStrength");
+
+	const char* const sourceSamplers[] = { "source", NULL };
+	brightProgram = buildPass("src/post_bright_fshader.glsl", sourceSamplers);
+	thresholdID = glGetUniformLocation(brightProgram, "threshold");
+	blurProgram = buildPass("src/post_blur_fshader.glsl", sourceSamplers);
+	blurStepID = glGetUniformLocation(blurProgram, "direction");
+
+	const char* const finishSamplers[] = { "sceneColor", "bloom", NULL };
+	finishProgram = buildPass("src/post_finish_fshader.glsl", finishSamplers);
+	bloomStrengthID = glGetUniformLocation(finishProgram, "bloomStrength");
+	tonemapID = glGetUniformLocation(finishProgram, "tonemap");
+}
+
+//----------------------------------------------------------------------------
+
+void postBeginScene(int width, int height)
+{
+	sceneWidth = width;
+	sceneHeight = height;
+	sceneColor = targetPool.acquire(width, height, GL_RGBA16F);
+	sceneDepth = targetPool.acquire(width, height, GL_DEPTH24_STENCIL8);
+	glBindFramebuffer(GL_FRAMEBUFFER, targetPool.framebuffer(sceneColor, sceneDepth));
+	glViewport(0, 0, width, height);
+}
+
+GLuint postSceneFramebuffer()
+{
+	return targetPool.framebuffer(sceneColor, sceneDepth);
+}
+
+// one full-screen triangle of program into target (the window if NULL),
+//   reading textures on units 0, 1, ...
+static void
+pass(GLuint program, const RenderTexture* target, const RenderTexture* const* textures, int count)
+{
+	if (target) {
+		glBindFramebuffer(GL_FRAMEBUFFER, targetPool.framebuffer(target));
+		glViewport(0, 0, target->width, target->height);
+	}
+	else {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, windowWidth, windowHeight);
+	}
+	for (int i = 0; i < count; i++) {
+		glState.activeTexture(GL_TEXTURE0 + i);
+		glState.bindTexture(GL_TEXTURE_2D, textures[i]->tex);
+	}
+	glState.useProgram(program);
+	drawFullscreen();
+}
+
+void postUnderwater(const glm::mat4& view, const glm::mat4& proj, unsigned effects)
+{
+	if (!(effects & (PostFog | PostCaustics)))
+		return;
+	underwaterTimer.begin();
+	glState.disable(GL_DEPTH_TEST);
+
+	// near and far of a glm::perspective, and the view ray's slope
+	float nearZ = proj[3][2] / (proj[2][2] - 1.0f);
+	float farZ = proj[3][2] / (proj[2][2] + 1.0f);
+	glm::mat4 cameraToWorld = glm::inverse(view);
+	int halfWidth = std::max(sceneWidth / 2, 1), halfHeight = std::max(sceneHeight / 2, 1);
+
+	RenderTexture* halfDepth = targetPool.acquire(halfWidth, halfHeight, GL_R32F);
+	glState.useProgram(depthProgram);
+	glState.uniform2f(depthPlanesID, nearZ, farZ);
+	pass(depthProgram, halfDepth, &sceneDepth, 1);
+
+	RenderTexture* caustics = targetPool.acquire(halfWidth, halfHeight, GL_R16F);
+	glState.useProgram(causticsProgram);
+	glState.uniformMatrix4fv(causticsCameraID, &cameraToWorld[0][0]);
+	glState.uniform2f(causticsTanID, 1.0f / proj[0][0], 1.0f / proj[1][1]);
+	glState.uniform1f(causticsLevelID, OceanLevel);
+	glState.activeTexture(GL_TEXTURE1);
+	glState.bindTexture(GL_TEXTURE_2D, causticsTexture());
+	pass(causticsProgram, caustics, &halfDepth, 1);
+
+	RenderTexture* lit = targetPool.acquire(sceneWidth, sceneHeight, GL_RGBA16F);
+	glState.useProgram(underwaterProgram);
+	glState.uniformMatrix4fv(underwaterCameraID, &cameraToWorld[0][0]);
+	glState.uniform2f(underwaterTanID, 1.0f / proj[0][0], 1.0f / proj[1][1]);
+	glState.uniform2f(underwaterPlanesID, nearZ, farZ);
+	glState.uniform1f(underwaterLevelID, OceanLevel);
+	glState.uniform1f(fogDensityID, (effects & PostFog) ? FogDensity : 0.0f);
+	glState.uniform1f(causticStrengthID, (effects & PostCaustics) ? CausticStrength : 0.0f);
+	const RenderTexture* inputs[4] = { sceneColor, sceneDepth, halfDepth, caustics };
+	pass(underwaterProgram, lit, inputs, 4);
+
+	// the lit copy is the scene now, over the same depth
+	targetPool.release(halfDepth);
+	targetPool.release(caustics);
+	targetPool.release(sceneColor);
+	sceneColor = lit;
+	glBindFramebuffer(GL_FRAMEBUFFER, postSceneFramebuffer());
+	glViewport(0, 0, sceneWidth, sceneHeight);
+	glState.enable(GL_DEPTH_TEST);
+	underwaterTimer.end();
+}
+
+void postFinish(int width, int height, unsigned effects)
+{
+	windowWidth = width;
+	windowHeight = height;
+	finishTimer.begin();
+	if (!(effects & (PostBloom | PostTonemap))) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, postSceneFramebuffer());
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, sceneWidth, sceneHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT,
+			width == sceneWidth && height == sceneHeight ? GL_NEAREST : GL_LINEAR);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, width, height);
+	}
+	else {
+		glState.disable(GL_DEPTH_TEST);
+
+		// bright pass at half size, then blurred across and down at quarter size
+		RenderTexture* bloom = NULL;
+		if (effects & PostBloom) {
+			int halfWidth = std::max(sceneWidth / 2, 1), halfHeight = std::max(sceneHeight / 2, 1);
+			int quarterWidth = std::max(sceneWidth / 4, 1), quarterHeight = std::max(sceneHeight / 4, 1);
+			RenderTexture* bright = targetPool.acquire(halfWidth, halfHeight, GL_RGBA16F);
+			glState.useProgram(brightProgram);
+			glState.uniform1f(thresholdID, BloomThreshold);
+			pass(brightProgram, bright, &sceneColor, 1);
+
+			RenderTexture* across = targetPool.acquire(quarterWidth, quarterHeight, GL_RGBA16F);
+			bloom = targetPool.acquire(quarterWidth, quarterHeight, GL_RGBA16F);
+			glState.useProgram(blurProgram);
+			glState.uniform2f(blurStepID, 1.0f / halfWidth, 0.0f);
+			pass(blurProgram, across, &bright, 1);
+			glState.uniform2f(blurStepID, 0.0f, 1.0f / quarterHeight);
+			pass(blurProgram, bloom, &across, 1);
+			targetPool.release(bright);
+			targetPool.release(across);
+		}
+
+		glState.useProgram(finishProgram);
+		glState.uniform1f(bloomStrengthID, bloom ? BloomStrength : 0.0f);
+		glState.uniform1i(tonemapID, (effects & PostTonemap) ? 1 : 0);
+		const RenderTexture* inputs[2] = { sceneColor, bloom ? bloom : sceneColor };
+		pass(finishProgram, NULL, inputs, 2);
+		targetPool.release(bloom);
+		glState.enable(GL_DEPTH_TEST);
+	}
+	finishTimer.end();
+
+	targetPool.release(sceneColor);
+	targetPool.release(sceneDepth);
+	sceneColor = sceneDepth = NULL;
+
+	frameStats.postTargets = targetPool.size();
+	frameStats.postBytes = targetPool.bytes();
+	frameStats.postAllocations = targetPool.allocations();
+	frameStats.postGpuMs = finishTimer.ms() + ((effects & (PostFog | PostCaustics)) ? underwaterTimer.ms() : 0.0f);
+	targetPool.endFrame();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _POSTFX_H_
+#define _POSTFX_H_
+
+#include "cube.h"
+#include "glm/glm.hpp"
+
+//----------------------------------------------------------------------------
+//
+//  Post-processing
+//
+//  The scene is drawn into an offscreen half-float colour target with a
+//    depth-stencil texture, both borrowed from the target pool, and
+//    reaches the window through two stages of full-screen passes:
+//
+//    postUnderwater()  between the opaque and the transparent draws, so
+//                      the water surface is not fogged along with what
+//                      lies under it.  Caustics are looked up in the
+//                      animated caustics texture at half resolution,
+//                      against a half-resolution copy of the linear
+//                      depth, and brought back up with a bilateral
+//                      filter (the four nearest half-resolution samples,
+//                      weighted down where their depth differs from the
+//                      pixel's), then the pixel is fogged along the part
+//                      of its view ray that runs under OceanLevel.  The
+//                      result goes to a second colour target over the
+//                      same depth, which becomes the scene.
+//    postFinish()      after the transparent draws: a bright pass at half
+//                      resolution, a separable blur at quarter resolution
+//                      for the bloom, and a filmic tonemap of the scene
+//                      plus bloom into the window, filtered up to it when
+//                      the scene is smaller (dynamic resolution).
+//
+//  Every intermediate comes from targetPool and goes back to it when the
+//    pass that reads it is done, so a steady window size allocates nothing
+//    after the first frame.  Effects left out of the mask are skipped; with
+//    none the scene is copied to the window unchanged.
+//
+
+enum PostEffect {
+	PostFog = 1,
+	PostCaustics = 2,
+	PostBloom = 4,
+	PostTonemap = 8,
+	PostAll = PostFog | PostCaustics | PostBloom | PostTonemap
+};
+
+extern unsigned postEffects;		// PostAll unless changed
+
+void postInit();
+
+// acquires a width x height scene, binds it and sets the viewport; it may
+//   be smaller than the window
+void postBeginScene(int width, int height);
+
+// the scene's current framebuffer, colour and depth
+GLuint postSceneFramebuffer();
+
+// fog and caustics over the opaque scene; leaves the new scene bound
+void postUnderwater(const glm::mat4& view, const glm::mat4& proj, unsigned effects);
+
+// bloom and tonemapping into the width x height window, which is left bound
+//   with its viewport; the scene's targets go back to the pool
+void postFinish(int width, int height, unsigned effects);
+
+#endif // _POSTFX_H_
@@ -0,0 +1,269 @@
+//
+// Render queue, see renderqueue.h
+//
+
+#include "renderqueue.h"
+#include "hud.h"
+#include "jobs.h"
+
+#include <algorithm>
+
+RenderQueue renderQueue;
+
+const size_t ParallelSortThreshold = 1 << 14;	// below this one thread is faster
+
+//----------------------------------------------------------------------------
+
+SortKey makeSortKey(unsigned pass, unsigned program, unsigned material, float depth)
+{
+	if (depth < 0.0f) depth = 0.0f;
+	if (depth > 1.0f) depth = 1.0f;
+	SortKey d = SortKey(depth * float(0xFFFFFF));
+
+	return (SortKey(pass & 0xF) << 60) | (SortKey(program & 0xFFF) << 48) |
+		(SortKey(material & 0xFFFF) << 32) | (d << 8);
+}
+
+//----------------------------------------------------------------------------
+
+void radixSort(std::vector<SortEntry>& data, std::vector<SortEntry>& scratch)
+{
+	const size_t n = data.size();
+	if (n < 2)
+		return;
+	scratch.resize(n);
+
+	int chunks = n >= ParallelSortThreshold ? jobThreads() : 1;
+
+	// Per-chunk histograms of all 8 key bytes in one read.  They tell which
+	//   bytes every key agrees on (with the key layout, most of them); the
+	//   first pass that does work can use them directly, later passes see
+	//   the data reordered and recount their byte.  Kept between calls so
+	//   steady-state sorting doesn't allocate.
+	static std::vector<unsigned> hist, offsets;
+	hist.assign(size_t(chunks) * 8 * 256, 0);
+	offsets.resize(size_t(chunks) * 256);
+
+	SortEntry* src = &data[0];
+	SortEntry* dst = &scratch[0];
+
+	parallelFor(chunks, 1, [&](int c0, int c1) {
+		for (int c = c0; c < c1; c++) {
+			unsigned* h = &hist[size_t(c) * 8 * 256];
+			size_t begin = n * c / chunks, end = n * (c + 1) / chunks;
+			for (size_t i = begin; i < end; i++) {
+				SortKey k = src[i].key;
+				for (int b = 0; b < 8; b++)
+					h[b * 256 + ((k >> (b * 8)) & 0xFF)]++;
+			}
+		}
+	});
+
+	bool reordered = false;
+	for (int b = 0; b < 8; b++) {
+		unsigned same = 0;
+		for (int c = 0; c < chunks; c++)
+			same += hist[(size_t(c) * 8 + b) * 256 + ((src[0].key >> (b * 8)) & 0xFF)];
+		if (same == n)
+			continue;
+
+		if (reordered && chunks > 1) {
+			parallelFor(chunks, 1, [&](int c0, int c1) {
+				for (int c = c0; c < c1; c++) {
+					unsigned* h = &hist[(size_t(c) * 8 + b) * 256];
+					std::fill(h, h + 256, 0u);
+					size_t begin = n * c / chunks, end = n * (c + 1) / chunks;
+					for (size_t i = begin; i < end; i++)
+						h[(src[i].key >> (b * 8)) & 0xFF]++;
+				}
+			});
+		}
+
+		// chunk c writes bucket v after all smaller buckets and after
+		//   bucket v of the chunks before it, which keeps the sort stable
+		unsigned running = 0;
+		for (int v = 0; v < 256; v++) {
+			for (int c = 0; c < chunks; c++) {
+				offsets[size_t(c) * 256 + v] = running;
+				running += hist[(size_t(c) * 8 + b) * 256 + v];
+			}
+		}
+
+		parallelFor(chunks, 1, [&](int c0, int c1) {
+			for (int c = c0; c < c1; c++) {
+				unsigned* o = &offsets[size_t(c) * 256];
+				size_t begin = n * c / chunks, end = n * (c + 1) / chunks;
+				for (size_t i = begin; i < end; i++)
+					dst[o[(src[i].key >> (b * 8)) & 0xFF]++] = src[i];
+			}
+		});
+
+		SortEntry* t = src; src = dst; dst = t;
+		reordered = true;
+	}
+
+	if (src != &data[0])
+		data.swap(scratch);
+}
+
+//----------------------------------------------------------------------------
+
+void RenderQueue::submit(SortKey key, const DrawItem& item)
+{
+	SortEntry e = { key, unsigned(items.size()) };
+	entries.push_back(e);
+	items.push_back(item);
+}
+
+void RenderQueue::sort()
+{
+	radixSort(entries, scratch);
+}
+
+static long long
+triangleCount(GLenum mode, GLsizei count)
+{
+	switch (mode) {
+	case GL_TRIANGLES:		return count / 3;
+	case GL_TRIANGLE_STRIP:
+	case GL_TRIANGLE_FAN:	return count > 2 ? count - 2 : 0;
+	}
+	return 0;
+}
+
+static size_t
+indexSize(GLenum type)
+{
+	switch (type) {
+	case GL_UNSIGNED_BYTE:	return 1;
+	case GL_UNSIGNED_SHORT:	return 2;
+	}
+	return 4;
+}
+
+// d with program in place of its own; the textures are skipped for a depth-only pass
+static void
+execute(const DrawItem& d, GLuint program, GLint matrixID, bool textures)
+{
+	glState.useProgram(program);
+	glState.bindVertexArray(d.vao);
+	if (d.instanceTex) {
+		glState.activeTexture(GL_TEXTURE0);
+		glState.bindTexture(GL_TEXTURE_BUFFER, d.instanceTex);
+	}
+	if (d.texture && textures) {
+		glState.activeTexture(GL_TEXTURE1);
+		glState.bindTexture(d.textureTarget, d.texture);
+	}
+	if (matrixID >= 0) {
+		glState.uniformMatrix4fv(matrixID, &d.matrix[0][0]);
+		frameStats.bytesUploaded += sizeof(d.matrix);
+	}
+
+	if (d.indexType)
+		glDrawElementsInstancedBaseVertex(d.mode, d.count, d.indexType,
+			BUFFER_OFFSET(size_t(d.first) * indexSize(d.indexType)), d.instances, d.baseVertex);
+	else if (d.instances == 1)
+		glDrawArrays(d.mode, d.first, d.count);
+	else
+		glDrawArraysInstanced(d.mode, d.first, d.count, d.instances);
+
+	frameStats.drawCalls++;
+	frameStats.triangles += triangleCount(d.mode, d.count) * d.instances;
+}
+
+void RenderQueue::setDepthProgram(GLuint program, GLuint depthProgram, GLint depthMatrixID)
+{
+	if (program >= depthPrograms.size()) {
+		DepthProgram none = { 0, -1 };
+		depthPrograms.resize(program + 1, none);
+	}
+	depthPrograms[program].program = depthProgram;
+	depthPrograms[program].matrixID = depthMatrixID;
+}
+
+void RenderQueue::flush()
+{
+	sort();
+
+	// the opaque items come first in key order; a flush of transparent
+	//   items alone leaves the write masks as the caller set them
+	size_t opaque = 0;
+	while (opaque < entries.size() && (entries[opaque].key >> 60) == PassOpaque)
+		opaque++;
+
+	if (prepass && opaque > 0) {
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glStencilMask(0);
+		for (size_t i = 0; i < opaque; i++) {
+			const DrawItem& d = items[entries[i].index];
+			if (d.program < depthPrograms.size() && depthPrograms[d.program].program) {
+				const DepthProgram& dp = depthPrograms[d.program];
+				execute(d, dp.program, dp.matrixID, false);
+				frameStats.prepassDraws++;
+			}
+		}
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glStencilMask(~0u);
+		glState.depthFunc(GL_LEQUAL);
+	}
+
+	for (size_t i = 0; i < entries.size(); i++) {
+		const DrawItem& d = items[entries[i].index];
+		execute(d, d.program, d.matrixID, true);
+	}
+
+	if (prepass && opaque > 0)
+		glState.depthFunc(GL_LESS);
+
+	entries.clear();
+	items.clear();
+}
+
+//----------------------------------------------------------------------------
+
+void createInstanceStream(InstanceStream& stream)
+{
+	glGenBuffers(1, &stream.buffer);
+	glGenTextures(1, &stream.tex);
+	glState.bindBuffer(GL_TEXTURE_BUFFER, stream.buffer);
+	glState.bindTexture(GL_TEXTURE_BUFFER, stream.tex);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, stream.buffer);
+	stream.capacity = 0;
+}
+
+void reserveInstances(InstanceStream& stream, size_t bytes)
+{
+	if (bytes > stream.capacity)
+		stream.capacity = std::max(bytes, stream.capacity * 2);
+	glState.bindBuffer(GL_TEXTURE_BUFFER, stream.buffer);
+	glBufferData(GL_TEXTURE_BUFFER, stream.capacity, NULL, GL_STREAM_DRAW);
+}
+
+void uploadInstances(InstanceStream& stream, const void* data, size_t bytes)
+{
+	reserveInstances(stream, bytes);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+	frameStats.bytesUploaded += bytes;
+}
+
+void submitInstanced(GLuint program, GLuint vao, GLenum mode, GLsizei count, GLsizei instances,
+	GLuint instanceTex, GLuint texture, GLint matrixID, const glm::mat4& matrix, unsigned material,
+	float depth)
+{
+	DrawItem item;
+	item.program = program;
+	item.vao = vao;
+	item.mode = mode;
+	item.first = 0;
+	item.count = count;
+	item.instances = instances;
+	item.indexType = 0;
+	item.baseVertex = 0;
+	item.instanceTex = instanceTex;
+	item.textureTarget = GL_TEXTURE_2D_ARRAY;
+	item.texture = texture;
+	item.matrixID = matrixID;
+	item.matrix = matrix;
+	renderQueue.submit(makeSortKey(PassOpaque, program, material, depth), item);
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _RENDERQUEUE_H_
+#define _RENDERQUEUE_H_
+
+#include "cube.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Render queue
+//
+//  Draws are submitted with a 64-bit sort key and executed after a radix
+//    sort on that key, so items sharing a program and material end up next
+//    to each other and opaque items inside a group go front to back.
+//
+//  With the depth pre-pass on, flush() first lays down depth for every
+//    opaque item whose program has a depth-only counterpart (see
+//    setDepthProgram()), with color and stencil writes off, then draws
+//    everything with GL_LEQUAL, so each pixel is shaded once by the
+//    surface in front.  Items without a counterpart (alpha-tested
+//    billboards, say) only take part in the second pass.
+//
+//  Key layout, most significant first:
+//    63..60  pass
+//    59..48  program
+//    47..32  material
+//    31..8   depth (view distance / far plane, 24 bits)
+//     7..0   unused
+//
+
+typedef unsigned long long SortKey;
+
+enum RenderPass {
+	PassOpaque = 0,
+	PassTransparent = 1
+};
+
+// payload of one queued draw
+struct DrawItem {
+	GLuint    program;
+	GLuint    vao;
+	GLenum    mode;
+	GLint     first;			// first vertex, or first index when indexed
+	GLsizei   count;
+	GLsizei   instances;		// 1 draws with glDrawArrays
+	GLenum    indexType;		// 0 for arrays; else the VAO's element buffer is used
+	GLint     baseVertex;		// added to every index
+	GLuint    instanceTex;		// buffer texture bound on unit 0, 0 for none
+	GLenum    textureTarget;
+	GLuint    texture;			// bound on unit 1, 0 for none
+	GLint     matrixID;			// uniform receiving matrix, -1 for none
+	glm::mat4 matrix;
+};
+
+// key plus the index of what it sorts
+struct SortEntry {
+	SortKey  key;
+	unsigned index;
+};
+
+SortKey makeSortKey(unsigned pass, unsigned program, unsigned material, float depth);
+
+// Stable LSD radix sort by key, 8 bits per pass.  Passes whose byte is the
+//   same for every key are skipped; large inputs split the histogram and
+//   scatter steps across the job threads.  scratch is resized as needed.
+void radixSort(std::vector<SortEntry>& data, std::vector<SortEntry>& scratch);
+
+class RenderQueue {
+public:
+	RenderQueue() : prepass(false) {}
+
+	void submit(SortKey key, const DrawItem& item);
+
+	void sort();
+	void flush();				// sort, execute and clear
+
+	size_t size() const { return items.size(); }
+
+	// Items drawn with program lay their depth in the pre-pass with
+	//   depthProgram, which takes the same vertex and instance data and
+	//   receives the item's matrix in depthMatrixID.
+	void setDepthProgram(GLuint program, GLuint depthProgram, GLint depthMatrixID);
+
+	void setDepthPrepass(bool on) { prepass = on; }
+	bool depthPrepass() const { return prepass; }
+
+private:
+	struct DepthProgram {
+		GLuint program;
+		GLint  matrixID;
+	};
+
+	std::vector<SortEntry> entries, scratch;
+	std::vector<DrawItem> items;
+	std::vector<DepthProgram> depthPrograms;	// by program name, program 0 for none
+	bool prepass;
+};
+
+extern RenderQueue renderQueue;
+
+//----------------------------------------------------------------------------
+//
+//  Instanced drawing helpers
+//
+
+// per-instance data streamed to an RGBA32F buffer texture each frame
+struct InstanceStream {
+	GLuint buffer, tex;
+	size_t capacity;		// bytes allocated in buffer
+};
+
+void createInstanceStream(InstanceStream& stream);
+
+// orphan and refill; grows geometrically so resizing the crowd settles
+void uploadInstances(InstanceStream& stream, const void* data, size_t bytes);
+
+// the orphaning alone, for a stream refilled by a buffer copy
+void reserveInstances(InstanceStream& stream, size_t bytes);
+
+// Queues an opaque instanced draw; texture goes on unit 1 as a 2D array.
+//   depth, 0 nearest to 1 farthest, orders draws sharing a program and
+//   material front to back.
+void submitInstanced(GLuint program, GLuint vao, GLenum mode, GLsizei count, GLsizei instances,
+	GLuint instanceTex, GLuint texture, GLint matrixID, const glm::mat4& matrix, unsigned material,
+	float depth = 0.0f);
+
+#endif // _RENDERQUEUE_H_
@@ -0,0 +1,152 @@
+//
+// Pooled render targets, see rendertarget.h
+//
+
+#include "rendertarget.h"
+
+TargetPool targetPool;
+
+//----------------------------------------------------------------------------
+
+static bool
+isDepth(GLenum format)
+{
+	return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F;
+}
+
+static size_t
+texelBytes(GLenum format)
+{
+	switch (format) {
+	case GL_R8:				return 1;
+	case GL_R16F:			return 2;
+	case GL_RGBA16F:		return 8;
+	case GL_RGBA32F:		return 16;
+	case GL_DEPTH_COMPONENT24:	return 3;
+	}
+	return 4;		// RGBA8, R32F, DEPTH24_STENCIL8, ...
+}
+
+// the client format and type glTexImage2D wants with no data
+static void
+transferFormat(GLenum format, GLenum& clientFormat, GLenum& type)
+{
+	switch (format) {
+	case GL_R8: case GL_R16F: case GL_R32F:
+		clientFormat = GL_RED; type = GL_FLOAT; return;
+	case GL_DEPTH24_STENCIL8:
+		clientFormat = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; return;
+	case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F:
+		clientFormat = GL_DEPTH_COMPONENT; type = GL_FLOAT; return;
+	}
+	clientFormat = GL_RGBA; type = GL_FLOAT;
+}
+
+//----------------------------------------------------------------------------
+
+RenderTexture* TargetPool::acquire(int width, int height, GLenum format)
+{
+	for (size_t i = 0; i < textures.size(); i++) {
+		RenderTexture* t = textures[i];
+		if (!t->busy && t->width == width && t->height == height && t->format == format) {
+			t->busy = true;
+			t->idleFrames = 0;
+			return t;
+		}
+	}
+
+	RenderTexture* t = new RenderTexture;
+	t->width = width;
+	t->height = height;
+	t->format = format;
+	t->busy = true;
+	t->idleFrames = 0;
+
+	// colour filters, so passes can downsample and upsample with one fetch
+	GLenum clientFormat, type;
+	transferFormat(format, clientFormat, type);
+	glGenTextures(1, &t->tex);
+	glState.activeTexture(GL_TEXTURE0);
+	glState.bindTexture(GL_TEXTURE_2D, t->tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, clientFormat, type, NULL);
+	GLint filter = isDepth(format) ? GL_NEAREST : GL_LINEAR;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	textures.push_back(t);
+	allocated++;
+	return t;
+}
+
+void TargetPool::release(RenderTexture* t)
+{
+	if (t)
+		t->busy = false;
+}
+
+GLuint TargetPool::framebuffer(const RenderTexture* color, const RenderTexture* depth)
+{
+	GLuint c = color ? color->tex : 0, d = depth ? depth->tex : 0;
+	for (size_t i = 0; i < framebuffers.size(); i++) {
+		if (framebuffers[i].color == c && framebuffers[i].depth == d)
+			return framebuffers[i].fbo;
+	}
+
+	Framebuffer f = { 0, c, d };
+	glGenFramebuffers(1, &f.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, f.fbo);
+	if (color) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, c, 0);
+	}
+	else {
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	if (depth) {
+		GLenum attachment = depth->format == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, d, 0);
+	}
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "render target framebuffer incomplete" << std::endl;
+
+	framebuffers.push_back(f);
+	return f.fbo;
+}
+
+// frees texture index and every framebuffer using it
+void TargetPool::destroy(size_t index)
+{
+	GLuint tex = textures[index]->tex;
+	for (size_t i = framebuffers.size(); i-- > 0; ) {
+		if (framebuffers[i].color == tex || framebuffers[i].depth == tex) {
+			glDeleteFramebuffers(1, &framebuffers[i].fbo);
+			framebuffers[i] = framebuffers.back();
+			framebuffers.pop_back();
+		}
+	}
+	glState.forgetTexture(tex);
+	glDeleteTextures(1, &tex);
+	delete textures[index];
+	textures[index] = textures.back();
+	textures.pop_back();
+}
+
+void TargetPool::endFrame()
+{
+	for (size_t i = textures.size(); i-- > 0; ) {
+		RenderTexture* t = textures[i];
+		if (!t->busy && ++t->idleFrames > PoolIdleFrames)
+			destroy(i);
+	}
+	allocated = 0;
+}
+
+size_t TargetPool::bytes() const
+{
+	size_t total = 0;
+	for (size_t i = 0; i < textures.size(); i++)
+		total += size_t(textures[i]->width) * textures[i]->height * texelBytes(textures[i]->format);
+	return total;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _RENDERTARGET_H_
+#define _RENDERTARGET_H_
+
+#include "cube.h"
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Pooled render targets
+//
+//  Offscreen passes borrow textures from the pool by size and format and
+//    hand them back when done, so once a frame has run the next one finds
+//    everything it needs and allocates nothing.  Framebuffers are kept per
+//    combination of colour and depth texture, which lets two targets share
+//    one depth buffer and ping-pong over it.  A texture nobody has asked for
+//    in PoolIdleFrames frames (after a resize, say) is freed.
+//
+
+const int PoolIdleFrames = 30;
+
+struct RenderTexture {
+	GLuint tex;
+	int    width, height;
+	GLenum format;			// sized internal format
+	bool   busy;			// handed out
+	int    idleFrames;		// since it was last handed out
+};
+
+class TargetPool {
+public:
+	TargetPool() : allocated(0) {}
+
+	// a free texture of this size and format, made if there is none
+	RenderTexture* acquire(int width, int height, GLenum format);
+	void release(RenderTexture* t);
+
+	// A framebuffer drawing into color (which may be NULL) with depth (which
+	//   may be NULL, and must be a depth format); made on first use.
+	GLuint framebuffer(const RenderTexture* color, const RenderTexture* depth = NULL);
+
+	// ages the idle textures and frees the old ones; call once a frame
+	void endFrame();
+
+	int size() const { return int(textures.size()); }
+	size_t bytes() const;
+	int allocations() const { return allocated; }	// textures made since the last endFrame()
+
+private:
+	struct Framebuffer {
+		GLuint fbo, color, depth;
+	};
+
+	void destroy(size_t index);
+
+	std::vector<RenderTexture*> textures;
+	std::vector<Framebuffer> framebuffers;
+	int allocated;
+};
+
+extern TargetPool targetPool;
+
+#endif // _RENDERTARGET_H_
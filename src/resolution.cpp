@@ -0,0 +1,109 @@
+//
+// Dynamic resolution, see resolution.h
+//
+
+#include "resolution.h"
+#include "gputimer.h"
+#include "hud.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int MeasureLag = 4;		// frames before the timer reports on a new size
+const int SettleFrames = 8;		// frames between changes, so the smoothed time catches up
+const float Smoothing = 0.2f;	// of each new measurement
+
+static float minScale = 0.5f, maxScale = 1.0f;
+static float budget = DefaultFrameBudgetMs;
+static bool enabled = true;
+static float scale = 1.0f;
+static float smoothed;			// frame time at the current scale, 0 until measured
+static int framesSinceChange;
+static GpuTimer frameTimer;
+static Clock::time_point lastEnd;
+static bool started;
+
+//----------------------------------------------------------------------------
+
+void resolutionSetBounds(float lo, float hi)
+{
+	maxScale = std::min(std::max(hi, ScaleStep), 1.0f);
+	minScale = std::min(std::max(lo, ScaleStep), maxScale);
+	scale = std::min(std::max(scale, minScale), maxScale);
+}
+
+void resolutionSetBudget(float ms)
+{
+	budget = std::max(ms, 1.0f);
+}
+
+float resolutionBudget()
+{
+	return budget;
+}
+
+void resolutionSetEnabled(bool on)
+{
+	enabled = on;
+	scale = maxScale;
+	smoothed = 0.0f;
+	framesSinceChange = 0;
+}
+
+bool resolutionEnabled()
+{
+	return enabled;
+}
+
+float renderScale()
+{
+	return scale;
+}
+
+void renderSize(int windowWidth, int windowHeight, int& width, int& height)
+{
+	width = std::max(int(windowWidth * scale + 0.5f), 1);
+	height = std::max(int(windowHeight * scale + 0.5f), 1);
+}
+
+//----------------------------------------------------------------------------
+
+void resolutionBeginFrame()
+{
+	frameTimer.begin();
+}
+
+void resolutionEndFrame()
+{
+	frameTimer.end();
+
+	Clock::time_point now = Clock::now();
+	float wallMs = started ? float(msBetween(lastEnd, now)) : 0.0f;
+	lastEnd = now;
+	started = true;
+	float ms = GpuTimer::supported() ? frameTimer.ms() : wallMs;
+
+	frameStats.renderScale = scale;
+	frameStats.frameGpuMs = ms;
+	if (!enabled || ms <= 0.0f)
+		return;
+
+	// measurements still from the previous size are dropped
+	if (++framesSinceChange <= MeasureLag)
+		return;
+	smoothed = smoothed > 0.0f ? smoothed + (ms - smoothed) * Smoothing : ms;
+	if (framesSinceChange < SettleFrames)
+		return;
+
+	float target = scale * std::sqrt(budget / smoothed);
+	target = std::floor(target / ScaleStep + 0.5f) * ScaleStep;
+	target = std::min(std::max(target, minScale), maxScale);
+	if (target > scale && smoothed > budget * Headroom)
+		return;
+	if (std::fabs(target - scale) >= ScaleStep * 0.5f) {
+		scale = target;
+		smoothed = 0.0f;
+		framesSinceChange = 0;
+	}
+}
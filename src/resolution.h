@@ -0,0 +1,53 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _RESOLUTION_H_
+#define _RESOLUTION_H_
+
+#include "cube.h"
+
+//----------------------------------------------------------------------------
+//
+//  Dynamic resolution
+//
+//  The scene renders offscreen at a fraction of the window's size and is
+//    filtered up to it by the last post-processing pass.  The fraction is
+//    steered to hold the frame inside a time budget: GPU time from timer
+//    queries around the frame where they are supported, the wall-clock
+//    time between frames where they are not (a software renderer, whose
+//    frame time is all rasterising anyway).  Shading time goes with the
+//    pixel count, so the scale moves by the square root of budget over
+//    measured time, in ScaleStep steps so the target pool sees few sizes,
+//    and only once the timer results reflect the previous step; it only
+//    grows back when the frame has Headroom to spare.
+//
+//  The timestamps bracket the whole frame, so a frame bound by the CPU
+//    reads as slow too and drives the scale to its lower bound without
+//    getting faster; set the budget above the CPU time.
+//
+
+const float DefaultFrameBudgetMs = 16.6f;
+const float ScaleStep = 0.05f;				// of the window's width and height
+const float Headroom = 0.85f;				// of the budget, to grow again
+
+// both in (0, 1]; 0.5 and 1 unless set
+void resolutionSetBounds(float minScale, float maxScale);
+void resolutionSetBudget(float ms);
+float resolutionBudget();
+
+// off renders at the upper bound
+void resolutionSetEnabled(bool on);
+bool resolutionEnabled();
+
+float renderScale();
+
+// the render size for a window, at the current scale
+void renderSize(int windowWidth, int windowHeight, int& width, int& height);
+
+// around everything the GPU draws at the render size; the end measures the
+//   frame and picks the scale the next one renders at
+void resolutionBeginFrame();
+void resolutionEndFrame();
+
+#endif // _RESOLUTION_H_
@@ -0,0 +1,488 @@
+//
+// Rig files, see rig.h
+//
+
+#include "rig.h"
+#include "timing.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+//----------------------------------------------------------------------------
+
+namespace {
+
+// a word of the text, in place
+struct Token {
+	const char* text;
+	int         length;
+
+	bool is(const char* word) const
+	{
+		return int(strlen(word)) == length && strncmp(text, word, length) == 0;
+	}
+};
+
+class Lexer {
+public:
+	Lexer(const char* text, size_t length) : p(text), end(text + length), line(1) {}
+
+	// false at the end of the text
+	bool next(Token& t)
+	{
+		for (;;) {
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+				if (*p == '\n')
+					line++;
+				p++;
+			}
+			if (p < end && *p == '#') {
+				while (p < end && *p != '\n')
+					p++;
+				continue;
+			}
+			break;
+		}
+		if (p == end)
+			return false;
+
+		t.text = p;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#')
+			p++;
+		t.length = int(p - t.text);
+		return true;
+	}
+
+	bool peek(Token& t) const
+	{
+		Lexer copy(*this);
+		return copy.next(t);
+	}
+
+	int lineNumber() const { return line; }
+
+private:
+	const char *p, *end;
+	int line;
+};
+
+// [+-]digits[.digits][(e|E)[+-]digits], the whole token
+bool
+parseNumber(const Token& t, float& value)
+{
+	const char *p = t.text, *end = t.text + t.length;
+	double sign = 1.0, v = 0.0;
+	if (p < end && (*p == '-' || *p == '+'))
+		sign = *p++ == '-' ? -1.0 : 1.0;
+
+	bool digits = false;
+	while (p < end && *p >= '0' && *p <= '9') {
+		v = v * 10.0 + (*p++ - '0');
+		digits = true;
+	}
+	if (p < end && *p == '.') {
+		double scale = 0.1;
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, scale *= 0.1) {
+			v += (*p - '0') * scale;
+			digits = true;
+		}
+	}
+	if (!digits)
+		return false;
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		int e = 0, esign = 1;
+		p++;
+		if (p < end && (*p == '-' || *p == '+'))
+			esign = *p++ == '-' ? -1 : 1;
+		if (p == end)
+			return false;
+		while (p < end && *p >= '0' && *p <= '9')
+			e = e * 10 + (*p++ - '0');
+		v *= std::pow(10.0, esign * e);
+	}
+	value = float(sign * v);
+	return p == end;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+
+static int
+fail(char* error, size_t errorSize, int line, const char* what, const Token* t)
+{
+	if (t)
+		snprintf(error, errorSize, "line %d: %s '%.*s'", line, what, t->length, t->text);
+	else
+		snprintf(error, errorSize, "line %d: %s", line, what);
+	return -1;
+}
+
+int parseRigText(const char* text, size_t length, RigDef* out, int maxRigs, char* error, size_t errorSize)
+{
+	Lexer lex(text, length);
+	Token t;
+	int rigs = 0;
+
+	while (lex.next(t)) {
+		if (!t.is("rig"))
+			return fail(error, errorSize, lex.lineNumber(), "expected 'rig', found", &t);
+		if (rigs == maxRigs)
+			return fail(error, errorSize, lex.lineNumber(), "more rigs than room for them", NULL);
+		if (!lex.next(t))
+			return fail(error, errorSize, lex.lineNumber(), "rig without a name", NULL);
+
+		RigDef& r = out[rigs];
+		memset(&r, 0, sizeof(r));
+		int n = t.length < RigNameLength - 1 ? t.length : RigNameLength - 1;
+		memcpy(r.name, t.text, n);
+
+		Token names[MaxJoints];		// part names, pointing into the text
+		for (;;) {
+			if (!lex.next(t))
+				return fail(error, errorSize, lex.lineNumber(), "rig not closed with 'end'", NULL);
+			if (t.is("end"))
+				break;
+			if (!t.is("part"))
+				return fail(error, errorSize, lex.lineNumber(), "expected 'part' or 'end', found", &t);
+			if (r.count == MaxJoints)
+				return fail(error, errorSize, lex.lineNumber(), "too many parts", NULL);
+
+			int j = r.count;
+			Token parent;
+			if (!lex.next(names[j]) || !lex.next(parent))
+				return fail(error, errorSize, lex.lineNumber(), "part needs a name and a parent", NULL);
+			r.parent[j] = -1;
+			if (!parent.is("-")) {
+				for (int p = 0; p < j && r.parent[j] < 0; p++) {
+					if (names[p].length == parent.length && strncmp(names[p].text, parent.text, parent.length) == 0)
+						r.parent[j] = p;
+				}
+				if (r.parent[j] < 0)
+					return fail(error, errorSize, lex.lineNumber(), "unknown parent", &parent);
+			}
+
+			r.axis[2][j] = 1.0f;
+			r.driver[j] = DriveNone;
+			bool hasScale = false, hasSign = false;
+
+			// keys until the next part or the end of the rig
+			while (lex.peek(t) && !t.is("part") && !t.is("end")) {
+				lex.next(t);
+				float (*vec)[MaxJoints] = t.is("pivot") ? r.pivot : t.is("center") ? r.center :
+					t.is("scale") ? r.scale : t.is("axis") ? r.axis : NULL;
+				if (vec) {
+					hasScale |= t.is("scale");
+					for (int a = 0; a < 3; a++) {
+						Token v;
+						if (!lex.next(v) || !parseNumber(v, vec[a][j]))
+							return fail(error, errorSize, lex.lineNumber(), "expected three numbers after", &t);
+					}
+				}
+				else if (t.is("sign")) {
+					Token v;
+					if (!lex.next(v) || !parseNumber(v, r.sign[j]))
+						return fail(error, errorSize, lex.lineNumber(), "expected a number after", &t);
+					hasSign = true;
+				}
+				else if (t.is("drive")) {
+					Token v;
+					if (!lex.next(v))
+						return fail(error, errorSize, lex.lineNumber(), "expected a driver after", &t);
+					r.driver[j] = v.is("arm") ? DriveArm : v.is("leg") ? DriveLeg : v.is("none") ? DriveNone : -1;
+					if (r.driver[j] < 0)
+						return fail(error, errorSize, lex.lineNumber(), "unknown driver", &v);
+				}
+				else {
+					return fail(error, errorSize, lex.lineNumber(), "unknown key", &t);
+				}
+			}
+
+			if (!hasScale)
+				return fail(error, errorSize, lex.lineNumber(), "part has no scale:", &names[j]);
+			if (!hasSign)
+				r.sign[j] = r.driver[j] == DriveNone ? 0.0f : 1.0f;
+			r.count++;
+		}
+		rigs++;
+	}
+	return rigs;
+}
+
+int countRigText(const char* text, size_t length)
+{
+	Lexer lex(text, length);
+	Token t;
+	int rigs = 0;
+	while (lex.next(t)) {
+		if (t.is("rig"))
+			rigs++;
+	}
+	return rigs;
+}
+
+bool writeRigBinary(const char* path, const RigDef* rigs, int count)
+{
+	FILE* f = fopen(path, "wb");
+	if (!f)
+		return false;
+	RigFileHeader h = { RigMagic, RigVersion, unsigned(count), unsigned(sizeof(RigDef)) };
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+		(count == 0 || fwrite(rigs, sizeof(RigDef), count, f) == size_t(count));
+	return fclose(f) == 0 && ok;
+}
+
+//----------------------------------------------------------------------------
+
+void rigFromParts(const PartDef* parts, int count, const char* name, RigDef& rig)
+{
+	memset(&rig, 0, sizeof(rig));
+	strncpy(rig.name, name, RigNameLength - 1);
+	rig.count = count;
+	for (int j = 0; j < count; j++) {
+		const PartDef& p = parts[j];
+		rig.parent[j] = p.parent;
+		rig.driver[j] = p.driver;
+		rig.sign[j] = p.sign;
+		const Float3* fields[4] = { &p.pivot, &p.center, &p.scale, &p.axis };
+		float (*rows[4])[MaxJoints] = { rig.pivot, rig.center, rig.scale, rig.axis };
+		for (int f = 0; f < 4; f++) {
+			rows[f][0][j] = fields[f]->x;
+			rows[f][1][j] = fields[f]->y;
+			rows[f][2][j] = fields[f]->z;
+		}
+	}
+}
+
+glm::vec3 rigOrigin(const RigDef& rig, int j)
+{
+	glm::vec3 o(0.0f);
+	for (int p = j; p >= 0; p = rig.parent[p])
+		o += glm::vec3(rig.pivot[0][p], rig.pivot[1][p], rig.pivot[2][p]);
+	return o;
+}
+
+void rigPalette(const RigDef& rig, const float drive[NumDrivers], glm::mat4* palette)
+{
+	glm::mat4 world[MaxJoints];
+	for (int j = 0; j < rig.count; j++) {
+		glm::mat4 m = rig.parent[j] < 0 ? glm::mat4(1.0f) : world[rig.parent[j]];
+		m = glm::translate(m, glm::vec3(rig.pivot[0][j], rig.pivot[1][j], rig.pivot[2][j]));
+		if (rig.driver[j] != DriveNone)
+			m = glm::rotate(m, rig.sign[j] * drive[rig.driver[j]], glm::vec3(rig.axis[0][j], rig.axis[1][j], rig.axis[2][j]));
+		world[j] = m;
+		palette[j] = glm::translate(m, -rigOrigin(rig, j));
+	}
+}
+
+//----------------------------------------------------------------------------
+
+MappedFile::MappedFile()
+	: base(NULL), length(0)
+#ifdef _WIN32
+	, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#else
+	, fd(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char* path)
+{
+	close();
+#ifdef _WIN32
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER size;
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		close();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	base = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	length = size_t(size.QuadPart);
+#else
+	fd = ::open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+		close();
+		return false;
+	}
+	void* p = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	base = p == MAP_FAILED ? NULL : (const char*)p;
+	length = size_t(st.st_size);
+#endif
+	if (!base) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (base)
+		UnmapViewOfFile(base);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (base)
+		munmap((void*)base, length);
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+	base = NULL;
+	length = 0;
+}
+
+//----------------------------------------------------------------------------
+
+// parents must come first, so a bad file cannot send a walk off the end
+static bool
+validRig(const RigDef& r)
+{
+	if (r.count < 1 || r.count > MaxJoints)
+		return false;
+	for (int j = 0; j < r.count; j++) {
+		if (r.parent[j] >= j || r.parent[j] < -1 || r.driver[j] < 0 || r.driver[j] >= NumDrivers)
+			return false;
+	}
+	return true;
+}
+
+bool RigLibrary::load(const char* path)
+{
+	list = NULL;
+	numRigs = 0;
+	if (!file.open(path)) {
+		std::cerr << path << ": cannot open" << std::endl;
+		return false;
+	}
+
+	const RigFileHeader* h = (const RigFileHeader*)file.data();
+	if (file.size() >= sizeof(RigFileHeader) && h->magic == RigMagic) {
+		if (h->version != RigVersion || h->rigSize != sizeof(RigDef) ||
+			file.size() < sizeof(RigFileHeader) + size_t(h->count) * sizeof(RigDef)) {
+			std::cerr << path << ": compiled for a different version, recompile it" << std::endl;
+			file.close();
+			return false;
+		}
+		list = (const RigDef*)(file.data() + sizeof(RigFileHeader));
+		numRigs = int(h->count);
+	}
+	else {
+		char error[128];
+		parsed.resize(countRigText(file.data(), file.size()));
+		int n = parseRigText(file.data(), file.size(), parsed.empty() ? NULL : &parsed[0], int(parsed.size()),
+			error, sizeof(error));
+		file.close();		// everything is copied out
+		if (n < 0) {
+			std::cerr << path << ": " << error << std::endl;
+			return false;
+		}
+		list = parsed.empty() ? NULL : &parsed[0];
+		numRigs = n;
+	}
+
+	for (int r = 0; r < numRigs; r++) {
+		if (!validRig(list[r])) {
+			std::cerr << path << ": rig " << r << " is malformed" << std::endl;
+			list = NULL;
+			numRigs = 0;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool compileRigFile(const char* textPath, const char* binaryPath)
+{
+	RigLibrary lib;
+	if (!lib.load(textPath))
+		return false;
+	if (!writeRigBinary(binaryPath, lib.rigs(), lib.count())) {
+		std::cerr << binaryPath << ": cannot write" << std::endl;
+		return false;
+	}
+	std::cout << lib.count() << " rigs from " << textPath << " to " << binaryPath << std::endl;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+
+void rigBenchmark()
+{
+	const int Variants[] = { 10, 100, 500, 2000 };
+	const char* BinaryPath = "rig_bench.rigb";
+
+	printf("%8s %10s %12s %12s %12s %10s\n", "rigs", "text KB", "parse ms", "write ms", "map ms", "identical");
+	for (int v = 0; v < 4; v++) {
+		int n = Variants[v];
+
+		// ten-part trees with every number varied
+		std::string text;
+		char line[256];
+		for (int r = 0; r < n; r++) {
+			float k = 1.0f + 0.001f * r;
+			snprintf(line, sizeof(line), "rig variant%d\n", r);
+			text += line;
+			for (int j = 0; j < 10; j++) {
+				snprintf(line, sizeof(line), "  part p%d %s%s pivot %.3f 0 %.3f center %.3f 0 0 scale %.3f %.3f %.3f drive %s sign %d\n",
+					j, j ? "p" : "-", j ? std::to_string((j - 1) / 2).c_str() : "", 0.5f * k * j, -0.1f * j,
+					0.25f * k, 0.5f * k, 0.4f, 0.1f * k, j % 3 == 1 ? "arm" : j % 3 == 2 ? "leg" : "none", j % 2 ? -1 : 1);
+				text += line;
+			}
+			text += "end\n";
+		}
+
+		std::vector<RigDef> rigs(n);
+		char error[128];
+		Clock::time_point start = Clock::now();
+		int parsed = parseRigText(text.data(), text.size(), &rigs[0], n, error, sizeof(error));
+		double parseMs = msSince(start);
+		if (parsed != n) {
+			printf("parse failed: %s\n", parsed < 0 ? error : "short");
+			return;
+		}
+
+		start = Clock::now();
+		writeRigBinary(BinaryPath, &rigs[0], n);
+		double writeMs = msSince(start);
+
+		start = Clock::now();
+		RigLibrary lib;
+		lib.load(BinaryPath);
+		double mapMs = msSince(start);
+
+		bool same = lib.count() == n && memcmp(lib.rigs(), &rigs[0], n * sizeof(RigDef)) == 0;
+		printf("%8d %10.1f %12.3f %12.3f %12.3f %10s\n", n, text.size() / 1024.0, parseMs, writeMs, mapMs,
+			same ? "yes" : "NO");
+	}
+	remove(BinaryPath);
+}
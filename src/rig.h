@@ -0,0 +1,130 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _RIG_H_
+#define _RIG_H_
+
+#include "bodydef.h"
+#include "skin.h"
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Rig files
+//
+//  A rig is the run-time form of a part table: the same fields, one array
+//    per field over the joints.  Rigs are written by hand as text
+//
+//      # comment
+//      rig <name>
+//        part <name> <parent name, or - for the root>
+//             pivot x y z  center x y z  scale x y z
+//             [axis x y z]  [drive none|arm|leg]  [sign s]
+//        ...
+//      end
+//
+//    (line breaks are free), and compiled with "cube --compile-rig in out"
+//    into a binary file: a RigFileHeader followed by RigDefs exactly as they
+//    sit in memory.  A binary file is mapped and used in place; nothing is
+//    copied or converted.  The text parser writes straight into the caller's
+//    RigDefs and never allocates.
+//
+
+const unsigned RigMagic = 0x42474952;		// "RIGB"
+const unsigned RigVersion = 1;
+const int RigNameLength = 32;
+
+struct RigDef {
+	char  name[RigNameLength];
+	int   count;
+	int   parent[MaxJoints];
+	int   driver[MaxJoints];			// PartDriver
+	float pivot[3][MaxJoints];			// x, y, z rows
+	float center[3][MaxJoints];
+	float scale[3][MaxJoints];
+	float axis[3][MaxJoints];
+	float sign[MaxJoints];
+};
+
+struct RigFileHeader {
+	unsigned magic;
+	unsigned version;
+	unsigned count;			// rigs that follow
+	unsigned rigSize;		// sizeof(RigDef) when written
+};
+
+// Parses up to maxRigs rigs from text (need not be NUL-terminated).
+//   Returns how many were parsed, or -1 with a message in error.
+int parseRigText(const char* text, size_t length, RigDef* out, int maxRigs, char* error, size_t errorSize);
+
+// counts "rig" blocks in text without parsing them, for sizing the output
+int countRigText(const char* text, size_t length);
+
+bool writeRigBinary(const char* path, const RigDef* rigs, int count);
+
+// a part table as a rig
+void rigFromParts(const PartDef* parts, int count, const char* name, RigDef& rig);
+
+// palette[j] = world(j) * inverseBind(j), as bodyPalette() for a table
+void rigPalette(const RigDef& rig, const float drive[NumDrivers], glm::mat4* palette);
+
+// bind-pose position of joint j
+glm::vec3 rigOrigin(const RigDef& rig, int j);
+
+//----------------------------------------------------------------------------
+
+// a file mapped read-only
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char* path);
+	void close();
+
+	const char* data() const { return base; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const char* base;
+	size_t length;
+#ifdef _WIN32
+	void *file, *mapping;
+#else
+	int fd;
+#endif
+};
+
+// Rigs from a file: a compiled one is used where it is mapped, a text one is
+//   parsed into storage sized once up front.
+class RigLibrary {
+public:
+	RigLibrary() : list(NULL), numRigs(0) {}
+
+	// false (with a message on stderr) if the file is missing or bad
+	bool load(const char* path);
+
+	int count() const { return numRigs; }
+	const RigDef* rigs() const { return list; }
+
+private:
+	MappedFile file;
+	std::vector<RigDef> parsed;
+	const RigDef* list;
+	int numRigs;
+};
+
+// "cube --compile-rig in out": text rigs to a binary file
+bool compileRigFile(const char* textPath, const char* binaryPath);
+
+// text parse vs binary map for hundreds of rigs, for --bench rig
+void rigBenchmark();
+
+#endif // _RIG_H_
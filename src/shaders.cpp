@@ -0,0 +1,319 @@
+//
+// Scene shader permutations, see shaders.h
+//
+
+#include "shaders.h"
+#include "lights.h"
+#include "renderqueue.h"
+#include "rig.h"
+#include "shadows.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+unsigned shaderLighting = ShaderLit | ShaderPointLights | ShaderShadows;
+
+static const char* VertexFile = "src/vshader.glsl";
+static const char* FragmentFile = "src/fshader.glsl";
+static const char* CacheFile = "shadercache.bin";
+
+// one per ShaderFeature bit
+static const char* featureDefines[NumShaderFeatures] = { "SKINNED", "LIT", "POINT_LIGHTS", "SHADOWS" };
+
+const unsigned CacheMagic = 0x43444853;		// "SHDC"
+const unsigned CacheVersion = 1;
+
+struct CacheHeader {
+	unsigned           magic;
+	unsigned           version;
+	unsigned long long sourceHash;		// of both sources and the driver strings
+	unsigned           count;			// entries that follow
+	unsigned           pad;
+};
+
+// followed by length bytes of program binary, padded to 4
+struct CacheEntry {
+	unsigned features;
+	unsigned format;
+	unsigned length;
+};
+
+static ShaderVariant variants[NumShaderVariants];
+static char *vertexSource, *fragmentSource;
+static unsigned long long sourceHash;
+
+//----------------------------------------------------------------------------
+
+// point lights and shadows are meaningless unlit, so those masks name the
+//   unlit program
+static unsigned
+canonical(unsigned features)
+{
+	if (!(features & ShaderLit))
+		features &= ~unsigned(ShaderPointLights | ShaderShadows);
+	return features & (NumShaderVariants - 1);
+}
+
+static unsigned long long
+fnv1a(unsigned long long h, const char* s)
+{
+	for (; s && *s; s++)
+		h = (h ^ (unsigned char)*s) * 1099511628211ull;
+	return h;
+}
+
+static void
+loadSources()
+{
+	if (vertexSource)
+		return;
+	vertexSource = readShaderSource(VertexFile);
+	fragmentSource = readShaderSource(FragmentFile);
+	if (!vertexSource || !fragmentSource) {
+		std::cerr << "Failed to read " << (vertexSource ? FragmentFile : VertexFile) << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// a driver update invalidates the binaries as surely as an edit
+	unsigned long long h = 14695981039346656037ull;
+	h = fnv1a(h, vertexSource);
+	h = fnv1a(h, fragmentSource);
+	h = fnv1a(h, (const char*)glGetString(GL_VENDOR));
+	h = fnv1a(h, (const char*)glGetString(GL_RENDERER));
+	h = fnv1a(h, (const char*)glGetString(GL_VERSION));
+	sourceHash = h;
+}
+
+// Compiles source with the defines of features after its #version, which
+//   must stay first; #line keeps the compiler's line numbers those of the file
+static GLuint
+compileVariant(GLenum type, const char* source, unsigned features)
+{
+	const char* body = shaderBody(source);
+	std::string version(source, body), defines;
+	for (int f = 0; f < NumShaderFeatures; f++) {
+		if (features & (1u << f)) {
+			defines += "#define ";
+			defines += featureDefines[f];
+			defines += "\n";
+		}
+	}
+	const char* parts[4] = { version.c_str(), defines.c_str(), body == source ? "#line 1\n" : "#line 2\n", body };
+	return compileShaderSource(type, parts, 4);
+}
+
+static bool
+binariesSupported()
+{
+	if (!GLEW_ARB_get_program_binary && !GLEW_VERSION_4_1)
+		return false;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+// uniforms and samplers that never change
+static void
+finish(unsigned features, GLuint program)
+{
+	ShaderVariant& v = variants[features];
+	v.program = program;
+	glState.useProgram(program);
+	v.vpID = glGetUniformLocation(program, "mVP");
+	glState.uniform1i(glGetUniformLocation(program, (features & ShaderSkinned) ? "jointPalettes" : "partMatrices"), 0);
+	if (features & ShaderLit)
+		lightsBindProgram(program);
+	if (features & ShaderShadows)
+		shadowsBindProgram(program);
+}
+
+//----------------------------------------------------------------------------
+
+// Programs for wanted from the cache file, where it has them for these
+//   sources; the rest are left in missing.
+static int
+loadCache(const std::vector<unsigned>& wanted, std::vector<unsigned>& missing)
+{
+	missing = wanted;
+	MappedFile file;
+	if (!binariesSupported() || !file.open(CacheFile))
+		return 0;
+
+	const char* p = file.data();
+	const char* end = p + file.size();
+	const CacheHeader* h = (const CacheHeader*)p;
+	if (file.size() < sizeof(CacheHeader) || h->magic != CacheMagic || h->version != CacheVersion ||
+		h->sourceHash != sourceHash)
+		return 0;
+
+	int loaded = 0;
+	p += sizeof(CacheHeader);
+	for (unsigned e = 0; e < h->count && p + sizeof(CacheEntry) <= end; e++) {
+		const CacheEntry* entry = (const CacheEntry*)p;
+		const char* binary = p + sizeof(CacheEntry);
+		p = binary + ((entry->length + 3) & ~3u);
+		if (p > end)
+			break;
+
+		std::vector<unsigned>::iterator it = std::find(missing.begin(), missing.end(), entry->features);
+		if (it == missing.end())
+			continue;
+
+		// a binary the driver no longer takes just fails to link; compile it instead
+		GLuint program = glCreateProgram();
+		glProgramBinary(program, entry->format, binary, GLsizei(entry->length));
+		GLint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked) {
+			glDeleteProgram(program);
+			continue;
+		}
+		finish(entry->features, program);
+		missing.erase(it);
+		loaded++;
+	}
+	return loaded;
+}
+
+static void
+saveCache()
+{
+	if (!binariesSupported())
+		return;
+	FILE* f = fopen(CacheFile, "wb");
+	if (!f)
+		return;
+
+	CacheHeader h = { CacheMagic, CacheVersion, sourceHash, 0, 0 };
+	for (int v = 0; v < NumShaderVariants; v++)
+		h.count += variants[v].program != 0;
+	fwrite(&h, sizeof(h), 1, f);
+
+	std::vector<char> binary;
+	for (int v = 0; v < NumShaderVariants; v++) {
+		GLuint program = variants[v].program;
+		if (!program)
+			continue;
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		binary.assign(size_t((length + 3) & ~3), 0);
+		GLenum format = 0;
+		if (length > 0)
+			glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+		CacheEntry entry = { unsigned(v), unsigned(format), unsigned(length) };
+		fwrite(&entry, sizeof(entry), 1, f);
+		if (!binary.empty())
+			fwrite(&binary[0], 1, binary.size(), f);
+	}
+	fclose(f);
+}
+
+//----------------------------------------------------------------------------
+
+// Issues every compile and link before reading any status back, so the
+//   driver is free to work on them all at once.
+static void
+compileAll(const std::vector<unsigned>& list, bool retrievable)
+{
+	struct Pending {
+		unsigned features;
+		GLuint   shaders[2];
+		GLuint   program;
+	};
+	std::vector<Pending> pending(list.size());
+
+	if (GLEW_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xffffffffu);		// as many as the driver likes
+
+	static const char* attributes[5] = { "vPosition", "vColor", "vNormal", "vJoints", "vWeights" };
+	for (size_t i = 0; i < list.size(); i++) {
+		Pending& p = pending[i];
+		p.features = list[i];
+		const char* sources[2] = { vertexSource, fragmentSource };
+		const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+		for (int s = 0; s < 2; s++)
+			p.shaders[s] = compileVariant(types[s], sources[s], p.features);
+	}
+
+	for (size_t i = 0; i < pending.size(); i++) {
+		Pending& p = pending[i];
+		p.program = glCreateProgram();
+		glAttachShader(p.program, p.shaders[0]);
+		glAttachShader(p.program, p.shaders[1]);
+		for (GLuint a = 0; a < 5; a++)
+			glBindAttribLocation(p.program, a, attributes[a]);
+		if (retrievable)
+			glProgramParameteri(p.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(p.program);
+	}
+
+	for (size_t i = 0; i < pending.size(); i++) {
+		Pending& p = pending[i];
+		std::string variant = " (features " + std::to_string(p.features) + ")";
+		if (!shaderCompiled(p.shaders[0], (VertexFile + variant).c_str()) ||
+			!shaderCompiled(p.shaders[1], (FragmentFile + variant).c_str()) ||
+			!programLinked(p.program, ("Shader program" + variant).c_str()))
+			exit(EXIT_FAILURE);
+
+		glDetachShader(p.program, p.shaders[0]);
+		glDetachShader(p.program, p.shaders[1]);
+		glDeleteShader(p.shaders[0]);
+		glDeleteShader(p.shaders[1]);
+		finish(p.features, p.program);
+	}
+}
+
+// every built variant lays its depth in the pre-pass with the unlit one of
+//   the same vertex path, once that is built too
+static void
+registerDepthPrograms()
+{
+	for (unsigned f = 0; f < unsigned(NumShaderVariants); f++) {
+		const ShaderVariant& depth = variants[f & ShaderSkinned];
+		if (variants[f].program && depth.program)
+			renderQueue.setDepthProgram(variants[f].program, depth.program, depth.vpID);
+	}
+}
+
+static void
+build(const std::vector<unsigned>& wanted)
+{
+	Clock::time_point start = Clock::now();
+	loadSources();
+
+	std::vector<unsigned> missing;
+	int cached = loadCache(wanted, missing);
+	if (!missing.empty()) {
+		bool binaries = binariesSupported();
+		compileAll(missing, binaries);
+		if (binaries)
+			saveCache();
+	}
+	registerDepthPrograms();
+	printf("shaders: %d variant%s, %d from the cache, %d compiled, %.1f ms\n", int(wanted.size()),
+		wanted.size() == 1 ? "" : "s", cached, int(missing.size()), msSince(start));
+}
+
+//----------------------------------------------------------------------------
+
+void shadersInit()
+{
+	std::vector<unsigned> wanted;
+	for (unsigned f = 0; f < unsigned(NumShaderVariants); f++) {
+		if (canonical(f) == f && !variants[f].program)
+			wanted.push_back(f);
+	}
+	build(wanted);
+}
+
+const ShaderVariant& shaderVariant(unsigned features)
+{
+	features = canonical(features);
+	if (!variants[features].program)
+		build(std::vector<unsigned>(1, features));
+	return variants[features];
+}
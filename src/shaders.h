@@ -0,0 +1,59 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SHADERS_H_
+#define _SHADERS_H_
+
+#include "cube.h"
+
+//----------------------------------------------------------------------------
+//
+//  Scene shader permutations
+//
+//  vshader.glsl and fshader.glsl hold every variant of the swimmer shaders
+//    behind #ifdefs; a variant is a bitmask of ShaderFeatures, and its
+//    program is built by injecting one #define per feature after the
+//    #version line.  Programs sit in a table indexed by the mask, so the
+//    draw path finds one with a single lookup.
+//
+//  shadersInit() builds the variants the scene needs up front: programs
+//    whose binary is in the cache file (ARB_get_program_binary) load
+//    without compiling; the rest have all their compiles and links issued
+//    before any status is read, so a driver that compiles on its own
+//    threads (ARB_parallel_shader_compile) overlaps them.  Any other
+//    variant is built the first time it is asked for.
+//
+//  Every variant takes part in the render queue's depth pre-pass through
+//    the unlit variant with the same vertex path.
+//
+
+enum ShaderFeature {
+	ShaderSkinned = 1 << 0,		// joint palettes instead of a model matrix per instance
+	ShaderLit = 1 << 1,			// Blinn-Phong with ambient and the sun, else vertex color
+	ShaderPointLights = 1 << 2,	// and the tiled pool lights; needs ShaderLit
+	ShaderShadows = 1 << 3,		// the sun through the cascaded shadow maps; needs ShaderLit
+	NumShaderFeatures = 4
+};
+
+const int NumShaderVariants = 1 << NumShaderFeatures;
+
+// attribute locations bound in every variant, so one VAO serves them all
+enum ShaderAttribute { AttribPosition, AttribColor, AttribNormal, AttribJoints, AttribWeights };
+
+struct ShaderVariant {
+	GLuint program;		// 0 until built
+	GLint  vpID;		// mVP
+};
+
+// lighting features the scene draws with; ShaderLit | ShaderPointLights | ShaderShadows
+//   unless changed
+extern unsigned shaderLighting;
+
+// builds every variant the scene uses, from the cache where it can
+void shadersInit();
+
+// the program for a feature mask, built on first use
+const ShaderVariant& shaderVariant(unsigned features);
+
+#endif // _SHADERS_H_
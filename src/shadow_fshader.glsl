@@ -0,0 +1,7 @@
+#version 150
+
+// Depth only; the framebuffer has no color attachment
+
+void main()
+{
+}
@@ -0,0 +1,18 @@
+#version 150
+
+// Depth-only pass into one shadow cascade: the merged swimmer mesh, one
+//   model matrix per instance as in vshader.glsl, through the cascade's
+//   light view-projection
+
+in  vec4 vPosition;
+
+uniform mat4 mVP;
+uniform samplerBuffer partMatrices;	// model matrix per instance, one column per texel
+
+void main()
+{
+  int base = gl_InstanceID * 4;
+  mat4 model = mat4(texelFetch(partMatrices, base), texelFetch(partMatrices, base + 1),
+                    texelFetch(partMatrices, base + 2), texelFetch(partMatrices, base + 3));
+  gl_Position = mVP * (model * vPosition);
+}
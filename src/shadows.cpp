@@ -0,0 +1,201 @@
+//
+// Cascaded sun shadows, see shadows.h
+//
+
+#include "shadows.h"
+#include "crowd.h"
+#include "gputimer.h"
+#include "hud.h"
+#include "renderqueue.h"
+#include "shaders.h"
+#include "timing.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+const float SplitBlend = 0.75f;			// 1 all logarithmic, 0 all even
+const float CasterDistance = 20.0f;		// toward the sun past a slice, for casters outside it
+const float SlopeBias = 2.0f, ConstantBias = 4.0f;		// glPolygonOffset during the pass
+
+//----------------------------------------------------------------------------
+
+static GLuint depthProgram, shadowTex, shadowFbo, shadowsUbo;
+static GLint depthVPID;
+static ShadowBlock block;
+static InstanceStream casterStream;
+static std::vector<int> hits;
+static std::vector<unsigned char> results;
+static std::vector<glm::mat4> casterBases;
+static GpuTimer passTimer;
+
+bool shadowsInit()
+{
+	// positions only; the same locations as the scene variants, so the merged mesh's VAO serves
+	depthProgram = InitShader("src/shadow_vshader.glsl", "src/shadow_fshader.glsl");
+	glBindAttribLocation(depthProgram, AttribPosition, "vPosition");
+	glLinkProgram(depthProgram);
+	depthVPID = glGetUniformLocation(depthProgram, "mVP");
+	glState.useProgram(depthProgram);
+	glState.uniform1i(glGetUniformLocation(depthProgram, "partMatrices"), 0);
+	createInstanceStream(casterStream);
+
+	// compared on lookup, so a bilinear fetch filters four depth tests
+	glGenTextures(1, &shadowTex);
+	glState.activeTexture(GL_TEXTURE0 + ShadowUnit);
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, shadowTex);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, ShadowMapSize, ShadowMapSize, NumCascades, 0,
+		GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	// nothing is shadowed until the first pass
+	block = ShadowBlock();
+	glGenBuffers(1, &shadowsUbo);
+	glState.bindBuffer(GL_UNIFORM_BUFFER, shadowsUbo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(block), &block, GL_STREAM_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, ShadowsBinding, shadowsUbo);
+
+	glGenFramebuffers(1, &shadowFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, shadowFbo);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowTex, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!complete) {
+		std::cerr << "shadow framebuffer incomplete, shadows off" << std::endl;
+		glDeleteFramebuffers(1, &shadowFbo);
+		shadowFbo = 0;
+		shaderLighting &= ~unsigned(ShaderShadows);
+	}
+	return complete;
+}
+
+bool shadowsAvailable()
+{
+	return shadowFbo != 0;
+}
+
+void shadowsBindProgram(GLuint program)
+{
+	GLuint index = glGetUniformBlockIndex(program, "Shadows");
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, index, ShadowsBinding);
+	glState.useProgram(program);
+	glState.uniform1i(glGetUniformLocation(program, "shadowMaps"), ShadowUnit);
+}
+
+//----------------------------------------------------------------------------
+
+// Light view-projection of the slice of the view between view depths d0
+//   and d1.  Sized by the slice's bounding sphere, which does not turn with
+//   the camera, and moved in whole texels.
+static glm::mat4
+fitCascade(const glm::mat4& cameraToWorld, const glm::mat4& proj, const glm::mat4& lightRotation,
+	float d0, float d1)
+{
+	float tanX = 1.0f / proj[0][0], tanY = 1.0f / proj[1][1];
+	glm::vec3 corners[8];
+	for (int k = 0; k < 8; k++) {
+		float d = k < 4 ? d0 : d1;
+		float sx = (k & 1) ? 1.0f : -1.0f, sy = (k & 2) ? 1.0f : -1.0f;
+		corners[k] = glm::vec3(cameraToWorld * glm::vec4(sx * d * tanX, sy * d * tanY, -d, 1.0f));
+	}
+
+	glm::vec3 center(0.0f);
+	for (int k = 0; k < 8; k++)
+		center += corners[k];
+	center /= 8.0f;
+	float radius = 0.0f;
+	for (int k = 0; k < 8; k++)
+		radius = std::max(radius, glm::length(corners[k] - center));
+	radius = std::ceil(radius * 16.0f) / 16.0f;		// stable under rounding as the camera turns
+
+	glm::vec3 c = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+	float texel = 2.0f * radius / ShadowMapSize;
+	c.x = std::floor(c.x / texel) * texel;
+	c.y = std::floor(c.y / texel) * texel;
+
+	// the light looks down -z, so casters between the sun and the slice have larger z
+	glm::mat4 ortho = glm::ortho(c.x - radius, c.x + radius, c.y - radius, c.y + radius,
+		-(c.z + radius + CasterDistance), -(c.z - radius));
+	return ortho * lightRotation;
+}
+
+void drawShadows(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& sunDirection,
+	const BVH& casters, GLuint vao, GLsizei count, int width, int height)
+{
+	if (!shadowFbo)
+		return;
+	Clock::time_point start = Clock::now();
+	passTimer.begin();
+
+	// near and far of a glm::perspective
+	float nearZ = proj[3][2] / (proj[2][2] - 1.0f);
+	float farZ = proj[3][2] / (proj[2][2] + 1.0f);
+	float range = std::min(farZ, ShadowDistance);
+
+	glm::vec3 up = std::fabs(sunDirection.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+	glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), -sunDirection, up);
+	glm::mat4 cameraToWorld = glm::inverse(view);
+	const glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+
+	glBindFramebuffer(GL_FRAMEBUFFER, shadowFbo);
+	glViewport(0, 0, ShadowMapSize, ShadowMapSize);
+	glState.enable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(SlopeBias, ConstantBias);
+
+	float d0 = nearZ;
+	int drawn = 0;
+	for (int c = 0; c < NumCascades; c++) {
+		float s = float(c + 1) / NumCascades;
+		float d1 = SplitBlend * nearZ * std::pow(range / nearZ, s) + (1.0f - SplitBlend) * (nearZ + (range - nearZ) * s);
+		glm::mat4 lightVP = fitCascade(cameraToWorld, proj, lightRotation, d0, d1);
+		block.shadowMatrices[c] = bias * lightVP;
+		block.cascadeEnds[c] = d1;
+		d0 = d1;
+
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowTex, 0, c);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		hits.clear();
+		results.clear();
+		casters.queryFrustum(frustumFromMatrix(lightVP), hits, results);
+		casterBases.clear();
+		for (size_t h = 0; h < hits.size(); h++) {
+			if (results[h] != CullOutside)
+				casterBases.push_back(swimmerBasis(hits[h]));
+		}
+		if (casterBases.empty())
+			continue;
+
+		uploadInstances(casterStream, &casterBases[0], casterBases.size() * sizeof(glm::mat4));
+		submitInstanced(depthProgram, vao, GL_TRIANGLES, count, GLsizei(casterBases.size()),
+			casterStream.tex, 0, depthVPID, lightVP, 0);
+		renderQueue.flush();
+		drawn += int(casterBases.size());
+	}
+
+	glState.disable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+
+	block.cameraForward = glm::vec4(-glm::vec3(cameraToWorld[2]), 0.0f);
+	glState.bindBuffer(GL_UNIFORM_BUFFER, shadowsUbo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+	glState.activeTexture(GL_TEXTURE0 + ShadowUnit);
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, shadowTex);
+
+	passTimer.end();
+	frameStats.bytesUploaded += sizeof(block);
+	frameStats.shadowCasters = drawn;
+	frameStats.shadowMs = float(msSince(start));
+	frameStats.shadowGpuMs = passTimer.ms();
+}
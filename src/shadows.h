@@ -0,0 +1,58 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SHADOWS_H_
+#define _SHADOWS_H_
+
+#include "cube.h"
+#include "bvh.h"
+#include "glm/glm.hpp"
+
+//----------------------------------------------------------------------------
+//
+//  Cascaded sun shadows
+//
+//  The view frustum out to ShadowDistance is cut into NumCascades slices,
+//    nearer ones shorter (a blend of logarithmic and even splits), and each
+//    slice gets its own layer of a depth texture array, rendered from the
+//    sun with an orthographic projection around the slice's bounding
+//    sphere.  The projection keeps its size and only moves in whole texels,
+//    so the shadow edges do not crawl as the camera moves.
+//
+//  The depth pass has its own program and reuses the merged swimmer mesh
+//    and its per-instance model matrices: the swimmers the BVH finds inside
+//    a cascade's light volume are drawn with one instanced call, so the
+//    pass costs one draw per cascade whatever the crowd size.
+//
+//  Lit programs with ShaderShadows read the matrices and split distances
+//    from the Shadows uniform block and the maps from ShadowUnit.
+//
+
+const int NumCascades = 3;				// as in fshader.glsl
+const int ShadowMapSize = 1024;			// texels per side of every cascade
+const float ShadowDistance = 60.0f;		// from the eye, beyond it nothing is shadowed
+const int ShadowsBinding = 1;			// uniform buffer binding point
+const int ShadowUnit = 3;				// texture unit of the maps
+
+// std140 layout of the Shadows block
+struct ShadowBlock {
+	glm::mat4 shadowMatrices[NumCascades];	// world to [0,1] map coordinates and depth
+	glm::vec4 cascadeEnds;					// view depth where each cascade stops
+	glm::vec4 cameraForward;				// view depth is along this from the eye
+};
+
+// false if the depth framebuffer could not be made; nothing is shadowed then
+bool shadowsInit();
+bool shadowsAvailable();
+
+// attaches program's Shadows block and shadowMaps sampler
+void shadowsBindProgram(GLuint program);
+
+// Fits the cascades to this frame's camera and renders the swimmers found
+//   in casters into them, as instances of the count vertices in vao.
+//   Leaves the window's framebuffer and a width x height viewport bound.
+void drawShadows(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& sunDirection,
+	const BVH& casters, GLuint vao, GLsizei count, int width, int height);
+
+#endif // _SHADOWS_H_
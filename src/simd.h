@@ -0,0 +1,28 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+//----------------------------------------------------------------------------
+//
+//  SSE availability
+//
+//  Every x86 target we build for has SSE2 (MSVC enables it by default), so
+//    the batched loops use 4-wide SSE and keep a scalar path for anything
+//    else.  Defines USE_SSE when the intrinsics can be used.
+//
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#  define USE_SSE
+#  include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#  define SIMD_ALIGN(n) __declspec(align(n))
+#else
+#  define SIMD_ALIGN(n) __attribute__((aligned(n)))
+#endif
+
+#endif // _SIMD_H_
@@ -0,0 +1,102 @@
+//
+// Skeletons and linear blend skinning, see skin.h
+//
+
+#include "skin.h"
+#include "simd.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+//----------------------------------------------------------------------------
+
+int addJoint(Skeleton& s, int parent, const glm::vec3& offset)
+{
+	int j = s.count++;
+	s.parent[j] = parent;
+	s.offset[j] = offset;
+
+	// with no rotation in the bind pose, a joint sits at its parent plus offset
+	glm::vec3 origin = offset;
+	for (int p = parent; p >= 0; p = s.parent[p])
+		origin += s.offset[p];
+	s.inverseBind[j] = glm::translate(glm::mat4(1.0f), -origin);
+	return j;
+}
+
+//----------------------------------------------------------------------------
+
+void skeletonPalette(const Skeleton& s, const glm::mat4& root, const glm::mat4* local, glm::mat4* palette)
+{
+	glm::mat4 world[MaxJoints];
+	for (int j = 0; j < s.count; j++) {
+		const glm::mat4& parent = s.parent[j] < 0 ? root : world[s.parent[j]];
+		world[j] = glm::translate(parent, s.offset[j]) * local[j];
+		palette[j] = world[j] * s.inverseBind[j];
+	}
+}
+
+//----------------------------------------------------------------------------
+
+void skinVertices(const SkinVertex* in, int n, const glm::mat4* palette, glm::vec4* out)
+{
+#ifdef USE_SSE
+	// one vertex per iteration, a matrix column per register: blend the two
+	//   joints' columns by weight, then sum columns scaled by x, y, z (w is 1)
+	for (int i = 0; i < n; i++) {
+		const SkinVertex& v = in[i];
+		const float* a = &palette[int(v.joints[0])][0][0];
+		const float* b = &palette[int(v.joints[1])][0][0];
+		__m128 wa = _mm_set1_ps(v.weights[0]), wb = _mm_set1_ps(v.weights[1]);
+
+		__m128 c0 = _mm_add_ps(_mm_mul_ps(wa, _mm_loadu_ps(a)), _mm_mul_ps(wb, _mm_loadu_ps(b)));
+		__m128 c1 = _mm_add_ps(_mm_mul_ps(wa, _mm_loadu_ps(a + 4)), _mm_mul_ps(wb, _mm_loadu_ps(b + 4)));
+		__m128 c2 = _mm_add_ps(_mm_mul_ps(wa, _mm_loadu_ps(a + 8)), _mm_mul_ps(wb, _mm_loadu_ps(b + 8)));
+		__m128 c3 = _mm_add_ps(_mm_mul_ps(wa, _mm_loadu_ps(a + 12)), _mm_mul_ps(wb, _mm_loadu_ps(b + 12)));
+
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.position.x)),
+			_mm_mul_ps(c1, _mm_set1_ps(v.position.y))),
+			_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(v.position.z)), c3));
+		_mm_storeu_ps(&out[i].x, r);
+	}
+#else
+	skinVerticesScalar(in, n, palette, out);
+#endif
+}
+
+void skinNormals(const SkinVertex* in, int n, const glm::mat4* palette, glm::vec4* out)
+{
+#ifdef USE_SSE
+	for (int i = 0; i < n; i++) {
+		const SkinVertex& v = in[i];
+		const float* a = &palette[int(v.joints[0])][0][0];
+		const float* b = &palette[int(v.joints[1])][0][0];
+		__m128 wa = _mm_set1_ps(v.weights[0]), wb = _mm_set1_ps(v.weights[1]);
+
+		__m128 c0 = _mm_add_ps(_mm_mul_ps(wa, _mm_loadu_ps(a)), _mm_mul_ps(wb, _mm_loadu_ps(b)));
+		__m128 c1 = _mm_add_ps(_mm_mul_ps(wa, _mm_loadu_ps(a + 4)), _mm_mul_ps(wb, _mm_loadu_ps(b + 4)));
+		__m128 c2 = _mm_add_ps(_mm_mul_ps(wa, _mm_loadu_ps(a + 8)), _mm_mul_ps(wb, _mm_loadu_ps(b + 8)));
+
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.normal.x)),
+			_mm_mul_ps(c1, _mm_set1_ps(v.normal.y))), _mm_mul_ps(c2, _mm_set1_ps(v.normal.z)));
+		_mm_storeu_ps(&out[i].x, r);
+	}
+#else
+	for (int i = 0; i < n; i++) {
+		const SkinVertex& v = in[i];
+		glm::vec4 d(0.0f);
+		for (int k = 0; k < MaxInfluences; k++)
+			d += v.weights[k] * (palette[int(v.joints[k])] * v.normal);
+		out[i] = d;
+	}
+#endif
+}
+
+void skinVerticesScalar(const SkinVertex* in, int n, const glm::mat4* palette, glm::vec4* out)
+{
+	for (int i = 0; i < n; i++) {
+		const SkinVertex& v = in[i];
+		glm::vec4 p(0.0f);
+		for (int k = 0; k < MaxInfluences; k++)
+			p += v.weights[k] * (palette[int(v.joints[k])] * v.position);
+		out[i] = p;
+	}
+}
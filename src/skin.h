@@ -0,0 +1,57 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SKIN_H_
+#define _SKIN_H_
+
+#include "glm/glm.hpp"
+
+//----------------------------------------------------------------------------
+//
+//  Skeletons and linear blend skinning
+//
+//  A skeleton is a list of joints, parents first.  Posing it gives a palette:
+//    one matrix per joint taking bind-pose (model space) positions to where
+//    that joint has moved them.  Each mesh vertex blends up to two palette
+//    entries by weight; normals take the same blend without the translation.
+//    The vertex shader does the same from a buffer
+//    texture; skinVertices() is the CPU reference.
+//
+
+const int MaxJoints = 16;
+const int MaxInfluences = 2;
+
+struct Skeleton {
+	int       count;
+	int       parent[MaxJoints];		// -1 for the root
+	glm::vec3 offset[MaxJoints];		// from the parent joint, in its frame
+	glm::mat4 inverseBind[MaxJoints];	// model space to joint space, bind pose
+};
+
+// interleaved as uploaded to the GPU
+struct SkinVertex {
+	glm::vec4 position;					// bind pose, model space
+	glm::vec4 color;
+	glm::vec4 normal;					// bind pose, w 0
+	float     joints[MaxInfluences];	// palette indices, as floats for the attribute
+	float     weights[MaxInfluences];	// summing to one
+};
+
+// appends a joint in its bind pose (no rotation) and returns its index
+int addJoint(Skeleton& s, int parent, const glm::vec3& offset);
+
+// palette[j] = root * world(j) * inverseBind[j], with
+//   world(j) = world(parent) * translate(offset[j]) * local[j]
+void skeletonPalette(const Skeleton& s, const glm::mat4& root, const glm::mat4* local, glm::mat4* palette);
+
+// bind-pose positions of n vertices through palette, SSE where available
+void skinVertices(const SkinVertex* in, int n, const glm::mat4* palette, glm::vec4* out);
+
+// plain scalar version, for comparison
+void skinVerticesScalar(const SkinVertex* in, int n, const glm::mat4* palette, glm::vec4* out);
+
+// bind-pose normals through the same blend, w 0 and not renormalized
+void skinNormals(const SkinVertex* in, int n, const glm::mat4* palette, glm::vec4* out);
+
+#endif // _SKIN_H_
@@ -0,0 +1,242 @@
+//
+// Crowd steering, see steering.h
+//
+
+#include "steering.h"
+#include "crowd.h"
+#include "jobs.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+// swimmers keep out of an ellipse a body long and a little under a lane wide,
+//   so they queue nose to tail in a lane without pushing on the next lane
+const float BodyLength = 5.5f;			// along x, the lanes
+const float BodyWidth = 2.0f;			// along z
+const float NeighborRadius = BodyLength;
+const int MaxNeighbors = 32;			// considered per agent
+const float SeparationGain = 6.0f;
+const float AlignGain = 0.5f;			// towards the neighbours' mean velocity
+const float LaneGain = 2.0f;			// spring to the lane centre
+const float LaneDamping = 1.5f;
+const float HeadingGain = 1.5f;			// turn back along the lane
+const float HeadingDamping = 2.0f;
+const float MaxSteer = 4.0f;			// acceleration, units per second^2
+const int SteerBatch = 256;				// agents per job
+
+//----------------------------------------------------------------------------
+
+unsigned SpatialHash::bucket(int cx, int cz) const
+{
+	// neighbouring cells along x land in neighbouring buckets, so a query's
+	//   nine cells are three runs of memory rather than nine
+	return (unsigned(cx) + unsigned(cz) * 92837111u) & mask;
+}
+
+void SpatialHash::build(const float* x, const float* z, int n, float size)
+{
+	cellSize = size;
+	count = n;
+
+	// about two buckets per agent keeps collisions rare
+	unsigned buckets = 1024;
+	while (buckets < unsigned(n) * 2)
+		buckets *= 2;
+	mask = buckets - 1;
+
+	keys.resize(n);
+	order.resize(n);
+	sx.resize(n);
+	sz.resize(n);
+	cellStart.assign(buckets + 1, 0);
+	cursor.resize(buckets);
+
+	float inv = 1.0f / cellSize;
+	parallelFor(n, 4096, [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			keys[i] = bucket(int(std::floor(x[i] * inv)), int(std::floor(z[i] * inv)));
+	});
+
+	// counting sort by bucket
+	for (int i = 0; i < n; i++)
+		cellStart[keys[i] + 1]++;
+	for (unsigned b = 0; b < buckets; b++) {
+		cellStart[b + 1] += cellStart[b];
+		cursor[b] = cellStart[b];
+	}
+	for (int i = 0; i < n; i++) {
+		unsigned slot = cursor[keys[i]]++;
+		order[slot] = i;
+		sx[slot] = x[i];
+		sz[slot] = z[i];
+	}
+}
+
+int SpatialHash::neighbors(float px, float pz, float radius, int* out, int maxOut) const
+{
+	float inv = 1.0f / cellSize;
+	int cx = int(std::floor(px * inv)), cz = int(std::floor(pz * inv));
+	float r2 = radius * radius;
+	unsigned seen[9];
+	int numSeen = 0, found = 0;
+
+	for (int dz = -1; dz <= 1; dz++) {
+		for (int dx = -1; dx <= 1; dx++) {
+			// neighbouring cells may land in the same bucket; visit it once
+			unsigned b = bucket(cx + dx, cz + dz);
+			if (std::find(seen, seen + numSeen, b) != seen + numSeen)
+				continue;
+			seen[numSeen++] = b;
+
+			for (unsigned s = cellStart[b]; s < cellStart[b + 1]; s++) {
+				float ex = sx[s] - px, ez = sz[s] - pz;
+				if (ex * ex + ez * ez > r2)
+					continue;
+				out[found++] = order[s];
+				if (found == maxOut)
+					return found;
+			}
+		}
+	}
+	return found;
+}
+
+//----------------------------------------------------------------------------
+
+static std::vector<float> steerX, steerZ, steerYaw;		// accelerations, applied after every agent is seen
+
+void steerAgents(const SteeringAgents& a, SpatialHash& hash, float dt)
+{
+	hash.build(a.x, a.z, a.count, NeighborRadius);
+	steerX.resize(a.count);
+	steerZ.resize(a.count);
+	steerYaw.resize(a.count);
+
+	// in bucket order, so consecutive queries touch the same memory
+	parallelFor(a.count, SteerBatch, [&](int begin, int end) {
+		int nearby[MaxNeighbors];
+		for (int slot = begin; slot < end; slot++) {
+			int i = hash.agents()[slot];
+			int n = hash.neighbors(a.x[i], a.z[i], NeighborRadius, nearby, MaxNeighbors);
+
+			float sepX = 0.0f, sepZ = 0.0f, meanX = 0.0f, meanZ = 0.0f;
+			int others = 0;
+			for (int k = 0; k < n; k++) {
+				int j = nearby[k];
+				if (j == i)
+					continue;
+				float ex = (a.x[i] - a.x[j]) / BodyLength, ez = (a.z[i] - a.z[j]) / BodyWidth;
+				float d = std::max(std::sqrt(ex * ex + ez * ez), 0.01f);
+				if (d < 1.0f) {
+					// grows from nothing at the ellipse as they close in
+					float push = (1.0f / d - 1.0f) / d;
+					sepX += ex * push;
+					sepZ += ez * push;
+				}
+				meanX += a.vx[j];
+				meanZ += a.vz[j];
+				others++;
+			}
+
+			float ax = SeparationGain * sepX, az = SeparationGain * sepZ;
+			if (others) {
+				ax += AlignGain * (meanX / others - a.vx[i]);
+				az += AlignGain * (meanZ / others - a.vz[i]);
+			}
+
+			// lanes are LaneWidth apart from z = 0 going -z
+			float lane = std::floor(a.z[i] / LaneWidth + 0.5f) * LaneWidth;
+			az += -LaneGain * (a.z[i] - lane) - LaneDamping * a.vz[i];
+
+			float mag = std::sqrt(ax * ax + az * az);
+			if (mag > MaxSteer) {
+				ax *= MaxSteer / mag;
+				az *= MaxSteer / mag;
+			}
+			steerX[i] = ax;
+			steerZ[i] = az;
+			steerYaw[i] = -HeadingGain * a.heading[i] - HeadingDamping * a.yawRate[i];
+		}
+	});
+
+	parallelFor(a.count, SteerBatch * 16, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			a.vx[i] += steerX[i] * dt;
+			a.vz[i] += steerZ[i] * dt;
+			a.yawRate[i] += steerYaw[i] * dt;
+		}
+	});
+}
+
+static SpatialHash crowdHash;
+
+void steerCrowd(float dt)
+{
+	if (crowd.size() == 0)
+		return;
+	SteeringAgents a = { &crowd.x[0], &crowd.z[0], &crowd.vx[0], &crowd.vz[0],
+		&crowd.heading[0], &crowd.yawRate[0], crowd.size() };
+	steerAgents(a, crowdHash, dt);
+}
+
+//----------------------------------------------------------------------------
+
+void steeringBenchmark()
+{
+	const int Reps = 3;
+
+	printf("%8s %10s %10s %14s %12s %12s\n", "agents", "build ms", "query ms", "queries/ms",
+		"neighbors", "steer ms");
+
+	int sizes[] = { 10000, 100000, 1000000 };
+	for (int s = 0; s < 3; s++) {
+		int n = sizes[s];
+
+		// about one swimmer per 8 square units, like the crowd's lanes
+		float side = std::sqrt(n * 8.0f);
+		std::vector<float> x(n), z(n), vx(n, 0.0f), vz(n, 0.0f), heading(n, 0.0f), yaw(n, 0.0f);
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> across(0.0f, side);
+		for (int i = 0; i < n; i++) {
+			x[i] = across(rng);
+			z[i] = -across(rng);
+		}
+
+		SpatialHash hash;
+		double build = 0.0, query = 0.0;
+		long long found = 0;
+		for (int r = 0; r < Reps; r++) {
+			Clock::time_point start = Clock::now();
+			hash.build(&x[0], &z[0], n, NeighborRadius);
+			build += msSince(start);
+
+			start = Clock::now();
+			std::atomic<long long> total(0);
+			parallelFor(n, 4096, [&](int begin, int end) {
+				int nearby[MaxNeighbors];
+				long long sum = 0;
+				for (int slot = begin; slot < end; slot++) {
+					int i = hash.agents()[slot];
+					sum += hash.neighbors(x[i], z[i], NeighborRadius, nearby, MaxNeighbors);
+				}
+				total += sum;
+			});
+			query += msSince(start);
+			found += total;
+		}
+		build /= Reps;
+		query /= Reps;
+
+		SteeringAgents a = { &x[0], &z[0], &vx[0], &vz[0], &heading[0], &yaw[0], n };
+		Clock::time_point start = Clock::now();
+		steerAgents(a, hash, 1.0f / 60.0f);
+		double steer = msSince(start);
+
+		printf("%8d %10.2f %10.2f %14.0f %12.1f %12.2f\n", n, build, query, n / query,
+			double(found) / Reps / n, steer);
+	}
+}
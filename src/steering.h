@@ -0,0 +1,71 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _STEERING_H_
+#define _STEERING_H_
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Crowd steering over a uniform spatial hash
+//
+//  The hash is rebuilt every step: each agent's cell is hashed into a
+//    power-of-two table and a counting sort lays the agents out bucket by
+//    bucket, with their positions copied alongside, so a neighbour query
+//    reads a few short contiguous runs.  Cells that collide in the table
+//    share a bucket; the distance test sorts them out.
+//
+//  Steering keeps each swimmer in its lane, away from its neighbours and
+//    roughly level with their speed, and turns it back to face along the
+//    lane.  It only changes velocities; the physics moves the swimmers, and
+//    swimmerBasis() picks the result up for drawing.
+//
+
+class SpatialHash {
+public:
+	SpatialHash() : cellSize(1.0f), mask(0), count(0) {}
+
+	// cellSize should be at least the largest query radius
+	void build(const float* x, const float* z, int n, float cellSize);
+
+	// agents within radius of (px, pz), at most maxOut of them into out;
+	//   returns how many were written
+	int neighbors(float px, float pz, float radius, int* out, int maxOut) const;
+
+	int size() const { return count; }
+
+	// agents in bucket order; walking queries in this order keeps them in cache
+	const int* agents() const { return &order[0]; }
+
+private:
+	unsigned bucket(int cx, int cz) const;
+
+	float cellSize;
+	unsigned mask;						// buckets - 1
+	int count;
+	std::vector<unsigned> keys;			// bucket of each agent
+	std::vector<unsigned> cellStart;	// first slot of each bucket, plus an end
+	std::vector<unsigned> cursor;		// scatter positions while building
+	std::vector<int> order;				// agent in each slot
+	std::vector<float> sx, sz;			// its position
+};
+
+// the steering's view of the agents, as kept by Crowd
+struct SteeringAgents {
+	const float *x, *z;
+	float *vx, *vz, *heading, *yawRate;
+	int count;
+};
+
+// one steering update of dt seconds
+void steerAgents(const SteeringAgents& agents, SpatialHash& hash, float dt);
+
+// steers the crowd; call before the physics moves it
+void steerCrowd(float dt);
+
+// hash build and neighbour query throughput from 10k to 1M agents, for --bench steering
+void steeringBenchmark();
+
+#endif // _STEERING_H_
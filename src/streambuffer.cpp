@@ -0,0 +1,281 @@
+//
+// Streaming vertex buffers, see streambuffer.h
+//
+
+#include "streambuffer.h"
+#include "hud.h"
+#include "jobs.h"
+#include "timing.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+const char* streamModeNames[NumStreamModes] = { "persistent", "unsynchronized", "orphan" };
+
+// every buffer ever created, for streamEndFrame()
+static std::vector<StreamBuffer*>&
+streams()
+{
+	static std::vector<StreamBuffer*> all;
+	return all;
+}
+
+static size_t streamedBytes;
+static double stallMs;
+static int behind;					// begin() calls on a region the GPU still read
+
+bool streamSupported(StreamMode mode)
+{
+	return mode != StreamPersistent || GLEW_ARB_buffer_storage;
+}
+
+StreamMode streamBestMode()
+{
+	return streamSupported(StreamPersistent) ? StreamPersistent : StreamUnsynchronized;
+}
+
+//----------------------------------------------------------------------------
+
+StreamBuffer::StreamBuffer()
+	: object(0), mode_(StreamOrphan), regions(1), regionSize(0), region(0), mapped(NULL), persistent(NULL),
+	mappedBytes(0), written(false), redrawable(false), registered(false)
+{
+	for (int r = 0; r < StreamRegions; r++)
+		fences[r] = 0;
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	if (registered) {
+		std::vector<StreamBuffer*>& all = streams();
+		all.erase(std::remove(all.begin(), all.end(), this), all.end());
+	}
+}
+
+void StreamBuffer::destroy()
+{
+	for (int r = 0; r < StreamRegions; r++) {
+		if (fences[r])
+			glDeleteSync(fences[r]);
+		fences[r] = 0;
+	}
+	if (object) {
+		glState.bindBuffer(GL_COPY_WRITE_BUFFER, object);
+		if (mapped || persistent)
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glState.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glState.forgetBuffer(object);
+		glDeleteBuffers(1, &object);
+		object = 0;
+	}
+	mapped = persistent = NULL;
+	written = redrawable = false;
+}
+
+void StreamBuffer::create(size_t regionBytes, StreamMode mode)
+{
+	destroy();
+	if (!registered) {
+		streams().push_back(this);
+		registered = true;
+	}
+
+	mode_ = streamSupported(mode) ? mode : StreamUnsynchronized;
+	regions = mode_ == StreamOrphan ? 1 : StreamRegions;
+	regionSize = regionBytes;
+	region = regions - 1;		// so the first begin() takes region 0
+	GLsizeiptr bytes = GLsizeiptr(regionSize * regions);
+
+	glGenBuffers(1, &object);
+	glState.bindBuffer(GL_COPY_WRITE_BUFFER, object);
+	if (mode_ == StreamPersistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, bytes, NULL, flags);
+		persistent = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bytes, flags);
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+	}
+	glState.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void* StreamBuffer::begin(size_t bytes)
+{
+	if (!object || bytes > regionSize)
+		return NULL;
+
+	// a second begin() in one frame (benchmarks) still fences what the first wrote
+	if (written)
+		fence();
+
+	// never wait on the fence, nor write over a region still in flight
+	Clock::time_point start = Clock::now();
+	int next = (region + 1) % regions;
+	if (fences[next]) {
+		GLenum status = glClientWaitSync(fences[next], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			behind++;
+			if (mode_ == StreamPersistent) {
+				// immutable storage: the last region is drawn again, so it needs a new fence
+				written = redrawable;
+				stallMs += msSince(start);
+				return NULL;
+			}
+			// orphaned: the draws in flight keep the old storage, every region of the new one is free
+			glState.bindBuffer(GL_COPY_WRITE_BUFFER, object);
+			glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(regionSize * regions), NULL, GL_STREAM_DRAW);
+			for (int r = 0; r < StreamRegions; r++) {
+				if (fences[r])
+					glDeleteSync(fences[r]);
+				fences[r] = 0;
+			}
+		}
+		else {
+			glDeleteSync(fences[next]);
+			fences[next] = 0;
+		}
+	}
+	region = next;
+
+	if (persistent) {
+		mapped = persistent + offset();
+	}
+	else {
+		glState.bindBuffer(GL_COPY_WRITE_BUFFER, object);
+		if (mode_ == StreamOrphan) {
+			glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(regionSize), NULL, GL_STREAM_DRAW);
+			mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, GLsizeiptr(bytes),
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		}
+		else {
+			mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, GLintptr(offset()), GLsizeiptr(bytes),
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		}
+	}
+	stallMs += msSince(start);
+	mappedBytes = mapped ? bytes : 0;
+	if (!mapped)
+		redrawable = false;		// the region is begun but holds nothing
+	return mapped;
+}
+
+void StreamBuffer::end()
+{
+	if (!mapped)
+		return;
+	if (!persistent) {
+		Clock::time_point start = Clock::now();
+		glState.bindBuffer(GL_COPY_WRITE_BUFFER, object);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		stallMs += msSince(start);
+	}
+	mapped = NULL;
+	written = redrawable = true;
+	streamedBytes += mappedBytes;
+	frameStats.bytesUploaded += mappedBytes;
+}
+
+void StreamBuffer::fence()
+{
+	if (written && mode_ != StreamOrphan) {
+		if (fences[region])
+			glDeleteSync(fences[region]);
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	written = false;
+}
+
+void streamEndFrame()
+{
+	std::vector<StreamBuffer*>& all = streams();
+	for (size_t i = 0; i < all.size(); i++)
+		all[i]->fence();
+
+	frameStats.streamBytes = streamedBytes;
+	frameStats.streamStallMs = float(stallMs);
+	frameStats.streamBehind = behind;
+	streamedBytes = 0;
+	stallMs = 0.0;
+	behind = 0;
+}
+
+//----------------------------------------------------------------------------
+
+void streamBenchmark()
+{
+	const int Frames = 60;
+
+	printf("%8s %15s %10s %10s %8s\n", "MB", "mode", "frame ms", "stall ms", "GB/s");
+
+	GLuint sink, source;
+	glGenBuffers(1, &sink);
+	glGenBuffers(1, &source);
+	std::vector<glm::vec4> staging;
+
+	for (size_t mb = 1; mb <= 16; mb *= 4) {
+		size_t bytes = mb << 20;
+		int count = int(bytes / sizeof(glm::vec4));
+		glState.bindBuffer(GL_COPY_WRITE_BUFFER, sink);
+		glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(bytes), NULL, GL_STREAM_COPY);
+
+		// the GPU reads every frame's vertices, as a draw would, so the fences mean something
+		for (int m = 0; m <= NumStreamModes; m++) {
+			bool copy = m == NumStreamModes;
+			if (!copy && !streamSupported(StreamMode(m)))
+				continue;
+
+			StreamBuffer stream;
+			if (!copy)
+				stream.create(bytes, StreamMode(m));
+			else
+				staging.resize(count);
+			stallMs = 0.0;
+			glFinish();
+
+			Clock::time_point start = Clock::now();
+			for (int f = 0; f < Frames; f++) {
+				glm::vec4* dst = copy ? &staging[0] : (glm::vec4*)stream.begin(bytes);
+				if (!dst)
+					continue;
+				parallelFor(count, 4096, [&](int begin, int end) {
+					for (int i = begin; i < end; i++)
+						dst[i] = glm::vec4(float(i), float(f), 0.0f, 1.0f);
+				});
+
+				size_t offset = 0;
+				if (copy) {
+					glState.bindBuffer(GL_COPY_READ_BUFFER, source);
+					glBufferData(GL_COPY_READ_BUFFER, GLsizeiptr(bytes), NULL, GL_STREAM_DRAW);
+					glBufferSubData(GL_COPY_READ_BUFFER, 0, GLsizeiptr(bytes), dst);
+				}
+				else {
+					stream.end();
+					offset = stream.offset();
+					glState.bindBuffer(GL_COPY_READ_BUFFER, stream.buffer());
+				}
+				glState.bindBuffer(GL_COPY_WRITE_BUFFER, sink);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(offset), 0, GLsizeiptr(bytes));
+				if (!copy)
+					stream.fence();
+			}
+			glFinish();
+			double frameMs = msSince(start) / Frames;
+			stream.destroy();
+
+			printf("%8d %15s %10.3f %10.3f %8.2f\n", int(mb), copy ? "buffersubdata" : streamModeNames[m],
+				frameMs, stallMs / Frames, double(bytes) / (frameMs * 1e6));
+		}
+	}
+
+	glState.bindBuffer(GL_COPY_READ_BUFFER, 0);
+	glState.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glState.forgetBuffer(sink);
+	glState.forgetBuffer(source);
+	glDeleteBuffers(1, &sink);
+	glDeleteBuffers(1, &source);
+	stallMs = 0.0;
+	streamedBytes = 0;
+	behind = 0;
+}
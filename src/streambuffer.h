@@ -0,0 +1,111 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _STREAMBUFFER_H_
+#define _STREAMBUFFER_H_
+
+#include "cube.h"
+
+//----------------------------------------------------------------------------
+//
+//  Streaming vertex buffers for geometry rewritten every frame
+//
+//  A StreamBuffer is one buffer object cut into StreamRegions regions of
+//    the same size.  Each frame's vertices go to the next region, so the CPU
+//    writes one while the GPU still reads the frames before it.  begin()
+//    hands out the region's memory itself, for the caller or the job
+//    threads to write the vertices into in place; end() publishes them and
+//    offset() says where the draws find them.  streamEndFrame() fences every
+//    region written in the frame.
+//
+//  How the memory is mapped depends on what the driver offers:
+//
+//    StreamPersistent      ARB_buffer_storage: the whole buffer is mapped
+//                          once, persistent and coherent, and begin() and
+//                          end() are only pointer arithmetic
+//    StreamUnsynchronized  GL 3.2: the region is mapped unsynchronized and
+//                          invalidated each frame; its fence already said
+//                          the GPU is done with it
+//    StreamOrphan          one region: its storage is orphaned and the new
+//                          storage mapped, the driver keeping the old one
+//                          alive for the draws still reading it.  No fences
+//
+//  Nothing waits.  If a region's fence has not signalled when its turn
+//    comes round (the GPU is StreamRegions frames behind) the buffer is
+//    orphaned instead, which frees every region at once.  Persistent
+//    storage cannot be: begin() fails for the frame and the caller draws
+//    the last region again, which is fenced anew.  Either is counted, and
+//    the time in fence checks, maps and unmaps is reported as stall time.
+//
+
+enum StreamMode {
+	StreamPersistent,
+	StreamUnsynchronized,
+	StreamOrphan,
+	NumStreamModes
+};
+
+extern const char* streamModeNames[NumStreamModes];
+
+const int StreamRegions = 3;
+
+bool streamSupported(StreamMode mode);
+StreamMode streamBestMode();		// the first supported one
+
+class StreamBuffer {
+public:
+	StreamBuffer();
+	~StreamBuffer();		// leaves the GL objects to destroy(), the context may be gone
+
+	// (Re)creates the buffer with regions of regionBytes.  The old buffer's
+	//   regions that are still being drawn from stay alive in GL.
+	void create(size_t regionBytes, StreamMode mode = streamBestMode());
+	void destroy();
+
+	// The first bytes of the next region, mapped for writing.  NULL if the
+	//   GPU still reads it and the storage is persistent, or it could not be
+	//   mapped; offset() then stays on the last region, to be drawn again
+	//   while canRedraw().
+	void* begin(size_t bytes);
+
+	// unmaps what begin() returned; the draws reading it can be submitted
+	void end();
+
+	// fences the region last written or drawn again, if it has not been; see streamEndFrame()
+	void fence();
+
+	// the region at offset() holds a whole frame's vertices
+	bool canRedraw() const { return redrawable; }
+
+	GLuint buffer() const { return object; }
+	size_t offset() const { return size_t(region) * regionSize; }	// of the region last begun
+	size_t regionBytes() const { return regionSize; }
+	StreamMode mode() const { return mode_; }
+
+private:
+	StreamBuffer(const StreamBuffer&);
+	StreamBuffer& operator=(const StreamBuffer&);
+
+	GLuint object;
+	StreamMode mode_;
+	int regions;
+	size_t regionSize;
+	int region;
+	unsigned char* mapped;			// between begin() and end()
+	unsigned char* persistent;		// the whole buffer in StreamPersistent, else NULL
+	size_t mappedBytes;
+	GLsync fences[StreamRegions];
+	bool written;					// or drawn again, since the last fence
+	bool redrawable;
+	bool registered;
+};
+
+// Fences the regions every stream buffer wrote this frame; call after the
+//   render queue is flushed.  Also reports the bytes and stall time.
+void streamEndFrame();
+
+// map, write and unmap cost per mode vs a copy through glBufferSubData, for --bench stream
+void streamBenchmark();
+
+#endif // _STREAMBUFFER_H_
@@ -0,0 +1,413 @@
+//
+// The swimmer rig and its skinned draw, see swimmer.h
+//
+
+#include "swimmer.h"
+#include "bodydef.h"
+#include "rig.h"
+#include "shaders.h"
+#include "renderqueue.h"
+#include "hud.h"
+#include "jobs.h"
+#include "streambuffer.h"
+#include "timing.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+
+Skeleton swimmerSkeleton;
+std::vector<SkinVertex> swimmerMesh;
+SkinPath skinPath = SkinGpu;
+
+//Component Scale
+constexpr Float3 bodyScale = { 1.8f, 1.0f, 0.6f };
+constexpr Float3 headScale = { 0.5f, 0.6f, 0.2f };
+constexpr Float3 armScale = { 0.8f, 0.5f, 0.1f };
+constexpr Float3 forearmScale = { 0.6f, 0.5f, 0.1f };
+constexpr Float3 upperlegScale = { 1.0f, 0.5f, 0.1f };
+constexpr Float3 lowerlegScale = { 1.0f, 0.5f, 0.1f };
+
+constexpr float gap = 0.1f;			// between the body and the limbs, and at the knees
+constexpr float elbow = 0.9f;		// shoulder to elbow, leaving a gap after the upper arm
+
+constexpr Float3 origin = { 0.0f, 0.0f, 0.0f };
+constexpr Float3 strokeAxis = { 0.0f, 0.0f, 1.0f };
+
+// the stroke turns the shoulders together and the hips against each other
+struct SwimmerBody {
+	static const int Count = NumJoints;
+	static constexpr PartDef parts[Count] = {
+		//parent              pivot                                                    box centre                                    scale          axis        sign   driver
+		{ -1,                 origin,                                                  origin,                                       bodyScale,     strokeAxis,  0.0f, DriveNone },
+		{ JointBody,          { -bodyScale.x + headScale.x, 0.0f, 0.0f },              origin,                                       headScale,     strokeAxis,  0.0f, DriveNone },
+		{ JointBody,          { -armScale.x / 2, 0.0f, bodyScale.z / 2 + gap },        { armScale.x * armScale.x / 2, 0.0f, 0.0f },  armScale,      strokeAxis,  1.0f, DriveArm },
+		{ JointRightShoulder, { elbow, 0.0f, 0.0f },                                   { forearmScale.x / 2, 0.0f, 0.0f },           forearmScale,  strokeAxis,  0.0f, DriveNone },
+		{ JointBody,          { -armScale.x / 2, 0.0f, -(bodyScale.z / 2 + gap) },     { -armScale.x * armScale.x / 2, 0.0f, 0.0f }, armScale,      strokeAxis,  1.0f, DriveArm },
+		{ JointLeftShoulder,  { -elbow, 0.0f, 0.0f },                                  { -forearmScale.x / 2, 0.0f, 0.0f },          forearmScale,  strokeAxis,  0.0f, DriveNone },
+		{ JointBody,          { upperlegScale.x, 0.0f, upperlegScale.z + gap },        { upperlegScale.x / 2, 0.0f, 0.0f },          upperlegScale, strokeAxis,  1.0f, DriveLeg },
+		{ JointRightHip,      { upperlegScale.x + gap, 0.0f, 0.0f },                   { lowerlegScale.x / 2, 0.0f, 0.0f },          lowerlegScale, strokeAxis,  0.0f, DriveNone },
+		{ JointBody,          { upperlegScale.x, 0.0f, -(upperlegScale.z + gap) },     { upperlegScale.x / 2, 0.0f, 0.0f },          upperlegScale, strokeAxis, -1.0f, DriveLeg },
+		{ JointLeftHip,       { upperlegScale.x + gap, 0.0f, 0.0f },                   { lowerlegScale.x / 2, 0.0f, 0.0f },          lowerlegScale, strokeAxis,  0.0f, DriveNone },
+	};
+};
+
+constexpr PartDef SwimmerBody::parts[];
+
+// GPU path: palettes in a buffer texture, skinned by the SKINNED shader variant
+static GLuint skinVao;
+static InstanceStream paletteStream;
+static std::vector<glm::mat4> palettes;		// NumJoints per swimmer
+
+// Rig variants, all skinning the reference mesh: rigFit takes each reference
+//   box to where and how big the variant's box is in its bind pose, so a
+//   variant's palette is its own pose times the fit.
+static RigLibrary rigLibrary;
+static std::vector<const RigDef*> rigVariants;
+static std::vector<glm::mat4> rigFit;		// NumJoints per variant
+static RigDef referenceRig;
+
+// CPU path: skinned positions, then normals, streamed straight from the job
+//   threads; drawn as one instance of the scene shader
+static GLuint cpuVao, cpuColors;
+static StreamBuffer cpuSkinned;
+static int cpuSkinnedSwimmers;				// swimmers' worth of vertices in a region
+static int cpuSkinnedCount;					// swimmers in the region last written
+static int cpuColorSwimmers;				// swimmers' worth of colors in cpuColors
+static InstanceStream identityStream;
+
+//----------------------------------------------------------------------------
+
+void swimmerInit(const glm::vec4* cube, const glm::vec4* cubeNormals, const glm::vec4* cubeColors, int cubeVertices)
+{
+	bodySkeleton<SwimmerBody>(swimmerSkeleton);
+	bodyMesh<SwimmerBody>(cube, cubeNormals, cubeColors, cubeVertices, swimmerMesh);
+
+	createInstanceStream(paletteStream);
+
+	glGenVertexArrays(1, &skinVao);
+	glState.bindVertexArray(skinVao);
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, swimmerMesh.size() * sizeof(SkinVertex), &swimmerMesh[0], GL_STATIC_DRAW);
+
+	// every shader variant binds the same attribute locations
+	const GLuint locations[5] = { AttribPosition, AttribColor, AttribNormal, AttribJoints, AttribWeights };
+	const GLint sizes[5] = { 4, 4, 4, MaxInfluences, MaxInfluences };
+	const size_t offsets[5] = { offsetof(SkinVertex, position), offsetof(SkinVertex, color),
+		offsetof(SkinVertex, normal), offsetof(SkinVertex, joints), offsetof(SkinVertex, weights) };
+	for (int a = 0; a < 5; a++) {
+		glEnableVertexAttribArray(locations[a]);
+		glVertexAttribPointer(locations[a], sizes[a], GL_FLOAT, GL_FALSE, sizeof(SkinVertex), BUFFER_OFFSET(offsets[a]));
+	}
+
+	// positions and normals are pointed at each frame's region when it is written
+	glGenVertexArrays(1, &cpuVao);
+	glState.bindVertexArray(cpuVao);
+	glGenBuffers(1, &cpuColors);
+	glEnableVertexAttribArray(AttribPosition);
+	glEnableVertexAttribArray(AttribNormal);
+	glState.bindBuffer(GL_ARRAY_BUFFER, cpuColors);
+	glEnableVertexAttribArray(AttribColor);
+	glVertexAttribPointer(AttribColor, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+	cpuSkinnedSwimmers = 0;
+	cpuSkinnedCount = 0;
+	cpuColorSwimmers = 0;
+
+	glm::mat4 identity(1.0f);
+	createInstanceStream(identityStream);
+	uploadInstances(identityStream, &identity, sizeof(identity));
+
+	// a compiled rig file when there is one, else the text
+	FILE* compiled = fopen("src/swimmers.rigb", "rb");
+	if (compiled)
+		fclose(compiled);
+	swimmerLoadRigs(compiled ? "src/swimmers.rigb" : "src/swimmers.rig");
+}
+
+//----------------------------------------------------------------------------
+
+// same joints with the same parents as the reference, so the mesh fits
+static bool
+sameTopology(const RigDef& rig)
+{
+	if (rig.count != NumJoints)
+		return false;
+	for (int j = 0; j < NumJoints; j++) {
+		if (rig.parent[j] != SwimmerBody::parts[j].parent)
+			return false;
+	}
+	return true;
+}
+
+int swimmerLoadRigs(const char* path)
+{
+	rigFromParts(SwimmerBody::parts, NumJoints, "reference", referenceRig);
+	rigVariants.assign(1, &referenceRig);
+
+	if (rigLibrary.load(path)) {
+		rigVariants.clear();
+		for (int r = 0; r < rigLibrary.count(); r++) {
+			if (sameTopology(rigLibrary.rigs()[r]))
+				rigVariants.push_back(&rigLibrary.rigs()[r]);
+			else
+				std::cerr << path << ": rig " << rigLibrary.rigs()[r].name << " does not match the swimmer's joints" << std::endl;
+		}
+		if (rigVariants.empty())
+			rigVariants.assign(1, &referenceRig);
+	}
+
+	rigFit.resize(rigVariants.size() * NumJoints);
+	for (size_t v = 0; v < rigVariants.size(); v++) {
+		const RigDef& rig = *rigVariants[v];
+		for (int j = 0; j < NumJoints; j++) {
+			const PartDef& ref = SwimmerBody::parts[j];
+			glm::vec3 refBase = toVec3(bindOrigin(SwimmerBody::parts, j)) + toVec3(ref.center);
+			glm::vec3 base = rigOrigin(rig, j) + glm::vec3(rig.center[0][j], rig.center[1][j], rig.center[2][j]);
+			glm::vec3 scale = glm::vec3(rig.scale[0][j], rig.scale[1][j], rig.scale[2][j]) / toVec3(ref.scale);
+
+			glm::mat4 fit = glm::translate(glm::mat4(1.0f), base);
+			fit = glm::scale(fit, scale);
+			rigFit[v * NumJoints + j] = glm::translate(fit, -refBase);
+		}
+	}
+	return int(rigVariants.size());
+}
+
+int swimmerRigCount()
+{
+	return int(rigVariants.size());
+}
+
+void swimmerRigPalettes(float armAngle, float legAngle, std::vector<glm::mat4>& local)
+{
+	const float drive[NumDrivers] = { 0.0f, armAngle, legAngle };
+	local.resize(rigVariants.size() * NumJoints);
+	for (size_t v = 0; v < rigVariants.size(); v++) {
+		glm::mat4* palette = &local[v * NumJoints];
+		rigPalette(*rigVariants[v], drive, palette);
+		for (int j = 0; j < NumJoints; j++)
+			palette[j] *= rigFit[v * NumJoints + j];
+	}
+}
+
+//----------------------------------------------------------------------------
+
+void swimmerPalette(float armAngle, float legAngle, glm::mat4 palette[NumJoints])
+{
+	const float drive[NumDrivers] = { 0.0f, armAngle, legAngle };
+	bodyPalette<SwimmerBody>(drive, glm::mat4(1.0f), palette);
+}
+
+//----------------------------------------------------------------------------
+
+void swimmerLimbTips(const glm::mat4 palette[NumJoints], glm::vec3 tips[NumLimbTips])
+{
+	static const int tipJoints[NumLimbTips] = { JointRightElbow, JointLeftElbow, JointRightKnee, JointLeftKnee };
+
+	for (int t = 0; t < NumLimbTips; t++) {
+		// far end of the box, away from the joint, in bind pose
+		const PartDef& b = SwimmerBody::parts[tipJoints[t]];
+		glm::vec3 end = toVec3(bindOrigin(SwimmerBody::parts, tipJoints[t])) + toVec3(b.center) +
+			glm::vec3(b.center.x < 0.0f ? -b.scale.x : b.scale.x, 0.0f, 0.0f) * 0.5f;
+		tips[t] = glm::vec3(palette[tipJoints[t]] * glm::vec4(end, 1.0f));
+	}
+}
+
+void swimmerPartBoxes(const glm::mat4 palette[NumJoints], glm::vec3 centers[NumJoints],
+	glm::vec3 extents[NumJoints])
+{
+	for (int j = 0; j < NumJoints; j++) {
+		const PartDef& b = SwimmerBody::parts[j];
+		glm::vec3 bindCenter = toVec3(bindOrigin(SwimmerBody::parts, j)) + toVec3(b.center);
+		centers[j] = glm::vec3(palette[j] * glm::vec4(bindCenter, 1.0f));
+
+		// a rotated box reaches |R| * half size along each axis
+		glm::mat3 r(palette[j]);
+		glm::vec3 half = toVec3(b.scale) * 0.5f;
+		for (int a = 0; a < 3; a++)
+			extents[j][a] = std::fabs(r[0][a]) * half.x + std::fabs(r[1][a]) * half.y + std::fabs(r[2][a]) * half.z;
+	}
+}
+
+//----------------------------------------------------------------------------
+
+void drawSkinnedSwimmers(const glm::mat4* bases, int count, const glm::mat4* local,
+	const glm::mat4& vp, unsigned material, const unsigned short* variants)
+{
+	if (count <= 0)
+		return;
+
+	int verts = int(swimmerMesh.size());
+	palettes.resize(size_t(count) * NumJoints);
+	parallelFor(count, 512, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			const glm::mat4* pose = variants ? &local[variants[i] * NumJoints] : local;
+			for (int j = 0; j < NumJoints; j++)
+				palettes[i * NumJoints + j] = bases[i] * pose[j];
+		}
+	});
+
+	if (skinPath == SkinGpu) {
+		uploadInstances(paletteStream, &palettes[0], palettes.size() * sizeof(glm::mat4));
+		const ShaderVariant& skin = shaderVariant(ShaderSkinned | shaderLighting);
+		submitInstanced(skin.program, skinVao, GL_TRIANGLES, verts, count,
+			paletteStream.tex, 0, skin.vpID, vp, material);
+		return;
+	}
+
+	if (count > cpuSkinnedSwimmers) {
+		cpuSkinnedSwimmers = std::max(count, cpuSkinnedSwimmers * 2);
+		cpuSkinned.create(size_t(cpuSkinnedSwimmers) * verts * 2 * sizeof(glm::vec4));
+	}
+
+	// the job threads skin into the mapped region itself, no copy after;
+	//   with the GPU too far behind for that, the last frame is drawn again
+	size_t bytes = size_t(count) * verts * sizeof(glm::vec4);
+	glm::vec4* positions = (glm::vec4*)cpuSkinned.begin(2 * bytes);
+	if (positions) {
+		glm::vec4* normals = positions + size_t(count) * verts;
+		parallelFor(count, 16, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				skinVertices(&swimmerMesh[0], verts, &palettes[i * NumJoints], &positions[size_t(i) * verts]);
+				skinNormals(&swimmerMesh[0], verts, &palettes[i * NumJoints], &normals[size_t(i) * verts]);
+			}
+		});
+		cpuSkinned.end();
+		cpuSkinnedCount = count;
+	}
+	else if (cpuSkinned.canRedraw()) {
+		count = cpuSkinnedCount;
+		bytes = size_t(count) * verts * sizeof(glm::vec4);
+	}
+	else {
+		return;
+	}
+
+	// colors repeat per swimmer, so they are only rewritten when the crowd outgrows them
+	if (count > cpuColorSwimmers) {
+		cpuColorSwimmers = std::max(count, cpuColorSwimmers * 2);
+		std::vector<glm::vec4> colors(size_t(cpuColorSwimmers) * verts);
+		for (size_t v = 0; v < colors.size(); v++)
+			colors[v] = swimmerMesh[v % verts].color;
+		glState.bindBuffer(GL_ARRAY_BUFFER, cpuColors);
+		glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(glm::vec4), &colors[0], GL_STATIC_DRAW);
+		frameStats.bytesUploaded += colors.size() * sizeof(glm::vec4);
+	}
+
+	size_t offset = cpuSkinned.offset();
+	glState.bindVertexArray(cpuVao);
+	glState.bindBuffer(GL_ARRAY_BUFFER, cpuSkinned.buffer());
+	glVertexAttribPointer(AttribPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(offset));
+	glVertexAttribPointer(AttribNormal, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(offset + bytes));
+
+	const ShaderVariant& scene = shaderVariant(shaderLighting);
+	submitInstanced(scene.program, cpuVao, GL_TRIANGLES, count * verts, 1,
+		identityStream.tex, 0, scene.vpID, vp, material);
+}
+
+//----------------------------------------------------------------------------
+
+// the same pose by walking the part table at run time, as a reference
+static void
+interpretedPalette(float armAngle, float legAngle, glm::mat4 palette[NumJoints])
+{
+	const float drive[NumDrivers] = { 0.0f, armAngle, legAngle };
+	glm::mat4 local[NumJoints];
+	for (int j = 0; j < NumJoints; j++) {
+		const PartDef& p = SwimmerBody::parts[j];
+		local[j] = glm::mat4(1.0f);
+		if (p.driver != DriveNone)
+			local[j] = glm::rotate(local[j], p.sign * drive[p.driver], toVec3(p.axis));
+	}
+	skeletonPalette(swimmerSkeleton, glm::mat4(1.0f), local, palette);
+}
+
+void skinBenchmark()
+{
+	const int Poses = 100000;
+	glm::mat4 a[NumJoints], b[NumJoints];
+	volatile float sink = 0.0f;		// keeps the loops from being dropped
+	float diff = 0.0f;
+	Clock::time_point t0 = Clock::now();
+	for (int p = 0; p < Poses; p++) {
+		interpretedPalette(p * 1e-4f, 0.3f, a);
+		sink = sink + a[NumJoints - 1][3][0];
+	}
+	double interpreted = msSince(t0);
+	t0 = Clock::now();
+	for (int p = 0; p < Poses; p++) {
+		swimmerPalette(p * 1e-4f, 0.3f, b);
+		sink = sink - b[NumJoints - 1][3][0];
+	}
+	double unrolled = msSince(t0);
+	for (int j = 0; j < NumJoints; j++)
+		for (int c = 0; c < 4; c++)
+			diff = std::max(diff, glm::length(a[j][c] - b[j][c]));
+	printf("pose: table walked %.0f ns, unrolled %.0f ns, max difference %g\n",
+		interpreted * 1e6 / Poses, unrolled * 1e6 / Poses, diff);
+
+	glm::mat4 vp = glm::perspective(glm::radians(65.0f), 1.0f, 0.1f, 100.0f) *
+		glm::lookAt(glm::vec3(0, 0, 6), glm::vec3(0.2, 0, 0), glm::vec3(0, 1, 0));
+	glm::mat4 local[NumJoints];
+	swimmerPalette(0.7f, 0.3f, local);
+
+	const int Reps = 5;
+	int verts = int(swimmerMesh.size());
+	SkinPath savedPath = skinPath;
+
+	printf("%8s %10s %10s %10s %10s %11s %11s %10s\n", "swimmers", "vertices", "scalar ms",
+		"sse ms", "sse mt ms", "cpu draw ms", "gpu draw ms", "gpu Mv/s");
+
+	for (int n = 64; n <= (1 << 14); n *= 4) {
+		std::vector<glm::mat4> bases(n), pal(size_t(n) * NumJoints);
+		int lanes = int(std::ceil(std::sqrt(float(n))));
+		for (int i = 0; i < n; i++) {
+			bases[i] = glm::translate(glm::mat4(1.0f), glm::vec3((i / lanes) * 7.0f, 0.0f, -(i % lanes) * 3.0f));
+			for (int j = 0; j < NumJoints; j++)
+				pal[i * NumJoints + j] = bases[i] * local[j];
+		}
+		std::vector<glm::vec4> out(size_t(n) * verts);
+
+		Clock::time_point t = Clock::now();
+		for (int i = 0; i < n; i++)
+			skinVerticesScalar(&swimmerMesh[0], verts, &pal[i * NumJoints], &out[size_t(i) * verts]);
+		double scalarMs = msSince(t);
+
+		t = Clock::now();
+		for (int i = 0; i < n; i++)
+			skinVertices(&swimmerMesh[0], verts, &pal[i * NumJoints], &out[size_t(i) * verts]);
+		double sseMs = msSince(t);
+
+		t = Clock::now();
+		parallelFor(n, 16, [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				skinVertices(&swimmerMesh[0], verts, &pal[i * NumJoints], &out[size_t(i) * verts]);
+		});
+		double mtMs = msSince(t);
+
+		// whole frames: palettes, upload, draw, and wait for the GPU
+		double drawMs[2];
+		for (int path = SkinGpu; path <= SkinCpu; path++) {
+			skinPath = SkinPath(path);
+			glFinish();
+			t = Clock::now();
+			for (int r = 0; r < Reps; r++) {
+				drawSkinnedSwimmers(&bases[0], n, local, vp, 0);
+				renderQueue.flush();
+				glFinish();
+			}
+			drawMs[path] = msSince(t) / Reps;
+		}
+
+		double gpuMvs = double(n) * verts / (drawMs[SkinGpu] * 1000.0);
+		printf("%8d %10d %10.2f %10.2f %10.2f %11.2f %11.2f %10.1f\n", n, n * verts,
+			scalarMs, sseMs, mtMs, drawMs[SkinCpu], drawMs[SkinGpu], gpuMvs);
+	}
+
+	skinPath = savedPath;
+}
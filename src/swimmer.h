@@ -0,0 +1,86 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _SWIMMER_H_
+#define _SWIMMER_H_
+
+#include "cube.h"
+#include "skin.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  The swimmer rig
+//
+//  Ten joints (body, head, shoulders, elbows, hips, knees), each carrying one
+//    box of a single skinned mesh, laid out in a compile-time part table
+//    (see bodydef.h).  The stroke turns the shoulders and hips; elbows and
+//    knees follow their parents.
+//
+//  Full-detail swimmers are drawn with one instanced call: a palette of
+//    NumJoints matrices per swimmer in a buffer texture, skinned in the
+//    vertex shader.  The CPU path skins on the job threads instead, straight
+//    into a StreamBuffer; it is the reference the GPU path is measured
+//    against.
+//
+//  Rig variants loaded from a rig file all skin the same mesh: each joint's
+//    matrices carry a fit from the reference box to the variant's box.
+//
+
+enum SwimmerJoint {
+	JointBody, JointHead,
+	JointRightShoulder, JointRightElbow, JointLeftShoulder, JointLeftElbow,
+	JointRightHip, JointRightKnee, JointLeftHip, JointLeftKnee,
+	NumJoints
+};
+
+enum SkinPath { SkinGpu, SkinCpu };
+
+// hands and feet, the points that stir the water
+enum SwimmerLimbTip { TipRightHand, TipLeftHand, TipRightFoot, TipLeftFoot, NumLimbTips };
+
+extern Skeleton swimmerSkeleton;
+extern std::vector<SkinVertex> swimmerMesh;		// bind pose, NumJoints boxes
+extern SkinPath skinPath;
+
+// builds the rig from a 36-vertex cube (with face normals) and sets up both
+//   skinning paths, which draw with the shader variants of shaders.h
+void swimmerInit(const glm::vec4* cube, const glm::vec4* cubeNormals, const glm::vec4* cubeColors, int cubeVertices);
+
+// swimmer-space palette for a stroke
+void swimmerPalette(float armAngle, float legAngle, glm::mat4 palette[NumJoints]);
+
+// swimmer-space positions of the limb tips for a palette from swimmerPalette()
+void swimmerLimbTips(const glm::mat4 palette[NumJoints], glm::vec3 tips[NumLimbTips]);
+
+// posed box of every joint in swimmer space: centre and half extents along
+//   the swimmer axes, for a palette from swimmerPalette()
+void swimmerPartBoxes(const glm::mat4 palette[NumJoints], glm::vec3 centers[NumJoints],
+	glm::vec3 extents[NumJoints]);
+
+// Loads rig variants from a rig file (see rig.h), keeping those with the
+//   swimmer's joints; without any, the built-in body is the only variant.
+//   swimmerInit() loads src/swimmers.rigb, or src/swimmers.rig without it.
+//   Returns the variant count.
+int swimmerLoadRigs(const char* path);
+int swimmerRigCount();
+
+// NumJoints palette matrices per variant for a stroke, each fitting the
+//   shared mesh to that variant's proportions
+void swimmerRigPalettes(float armAngle, float legAngle, std::vector<glm::mat4>& local);
+
+// Queues one draw of count swimmers, each placed by bases[i] and posed by
+//   local: NumJoints matrices, or with variants, NumJoints per variant as
+//   from swimmerRigPalettes() and swimmer i posed by variant variants[i].
+//   On the CPU path the queue must be flushed before the next call, which
+//   reuses the VAO for the next region of streamed vertices.
+void drawSkinnedSwimmers(const glm::mat4* bases, int count, const glm::mat4* local,
+	const glm::mat4& vp, unsigned material, const unsigned short* variants = NULL);
+
+// CPU vs GPU skinning throughput over growing crowds, for --bench skin
+void skinBenchmark();
+
+#endif // _SWIMMER_H_
@@ -6,12 +6,44 @@
 //   as the default projetion.
 
 #include "cube.h"
+#include "hud.h"
+#include "renderqueue.h"
+#include "crowd.h"
+#include "frustum.h"
+#include "bvh.h"
+#include "bench.h"
+#include "lod.h"
+#include "swimmer.h"
+#include "ocean.h"
+#include "water.h"
+#include "particles.h"
+#include "physics.h"
+#include "steering.h"
+#include "rig.h"
+#include "lights.h"
+#include "shaders.h"
+#include "shadows.h"
+#include "overdraw.h"
+#include "oit.h"
+#include "postfx.h"
+#include "caustics.h"
+#include "resolution.h"
+#include "streambuffer.h"
+#include "uploads.h"
 #include "glm/glm.hpp"		//must be to use glm
 
 //for matrix transformation
 #include "glm/gtc/matrix_transform.hpp"	
 #include "glm/gtx/transform.hpp"
 
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <vector>
+
+
+const float NearPlane = 0.1f;
+const float FarPlane = 100.0f;
 
 //declaration of 4X4 mat
 glm::mat4 projectMat;
@@ -19,7 +51,50 @@ glm::mat4 viewMat;
 //declaration of 4X4 vector
 //glm::vec4
 
-GLuint pvmMatrixID;		//vertex shader uniform ID
+GLuint vao;				//merged swimmer mesh vertex array
+GLuint mergedBuffer;
+
+//full detail: a skinned mesh per swimmer, palettes built from these bases
+//  and the pose of each one's rig variant
+std::vector<glm::mat4> fullInstances;
+std::vector<unsigned short> fullVariants;
+std::vector<glm::mat4> rigPalettes;
+
+//mid range: the current pose skinned once into one mesh, drawn once per swimmer basis
+std::vector<glm::mat4> swimmerInstances;
+InstanceStream swimmerStream;
+
+//far: billboards showing one of the stroke poses baked at startup
+const int ImpostorWidth = 128, ImpostorHeight = 64;		//texels per frame
+const int ArmFrames = 12, LegFrames = 5;					//baked poses, arm angle x leg angle
+GLuint impostorProgram, impostorVao, impostorTex;
+GLint impostorVPID, cameraRightID, cameraUpID;
+glm::vec3 impostorCenter;		//of the baked frames, swimmer space
+glm::vec2 impostorHalfSize;
+std::vector<glm::vec4> impostorInstances;		//centre and frame
+InstanceStream impostorStream;
+
+Frustum viewFrustum;
+std::vector<unsigned char> swimmerVisibility;
+
+//how drawCrowd() finds visible swimmers
+enum CullMode { CullNone, CullLinear, CullHierarchy };
+const char* cullModeNames[3] = { "off", "linear SSE", "BVH" };
+CullMode cullMode = CullHierarchy;
+
+std::vector<int> visibleSwimmers;
+std::vector<int> drawnSwimmers;			//visible ones that survived culling
+
+//drawn swimmers in order of distance, nearest first, so the depth test
+//  rejects the ones behind before they are shaded
+bool frontToBack = true;
+std::vector<SortEntry> distanceOrder, distanceScratch;
+
+//pool floor under the crowd, the colour cube flattened into one tile-coloured slab
+const float FloorDepth = 3.0f;			//below the swimmers' base
+const float FloorMargin = 10.0f;		//past the crowd on every side
+GLuint floorVao, floorBuffer;
+InstanceStream floorStream;
 
 
 ////////////////////////////////////////////////////////////
@@ -29,30 +104,7 @@ float legMaxAngle = 0.6f;
 float legMinAngle = -0.6f;
 bool isLegUp = true;
 
-float gap = 0.1f;
-float armRotGap = 0.9f;
-float legRotGap = 0.1f;
-
-//Component Scale
-glm::vec3 bodyScale = glm::vec3(1.8, 1, 0.6);
-glm::vec3 headScale = glm::vec3(0.5, 0.6, 0.2);
-glm::vec3 armScale = glm::vec3(0.8, 0.5, 0.1);
-glm::vec3 forearmScale = glm::vec3(0.6, 0.5, 0.1);
-glm::vec3 upperlegScale = glm::vec3(1, 0.5, 0.1);
-glm::vec3 lowerlegScale = glm::vec3(1, 0.5, 0.1);
-
-//Component Position with matching parent to make Hierachy
-glm::vec3 bodyPos = glm::vec3(0, 0, 0);		// highest parent
-glm::vec3 headPos = glm::vec3(bodyPos.x - bodyScale.x + headScale.x, bodyPos.y, bodyPos.z);
-glm::vec3 rightArmPos = glm::vec3(bodyPos.x - (armScale.x / 2), bodyPos.y, bodyPos.z + (bodyScale.z / 2) + gap);
-glm::vec3 rightForearmPos = glm::vec3(rightArmPos.x, rightArmPos.y, rightArmPos.z);
-glm::vec3 leftArmPos = glm::vec3(bodyPos.x - (armScale.x / 2), bodyPos.y, bodyPos.z - (bodyScale.z / 2) - gap);
-glm::vec3 leftForearmPos = glm::vec3(leftArmPos.x, leftArmPos.y, leftArmPos.z);
-glm::vec3 rightUpperlegPos = glm::vec3(bodyPos.x + upperlegScale.x, bodyPos.y, bodyPos.z + upperlegScale.z + gap);
-glm::vec3 rightLowerlegPos = glm::vec3(rightUpperlegPos.x, rightUpperlegPos.y, rightUpperlegPos.z);
-glm::vec3 leftUpperlegPos = glm::vec3(bodyPos.x + upperlegScale.x, bodyPos.y, bodyPos.z - upperlegScale.z - gap);
-glm::vec3 leftLowerLegPos = glm::vec3(leftUpperlegPos.x, leftUpperlegPos.y, leftUpperlegPos.z);
-
+glm::mat4 strokePalette[NumJoints];		//swimmer-space joint palette of the current stroke
 
 ////////////////////////////////////////////////////////////
 
@@ -63,6 +115,12 @@ const int NumVertices = 36; //(6 faces)(2 triangles/face)(3 vertices/triangle)
 
 point4 points[NumVertices];
 color4 colors[NumVertices];
+glm::vec4 normals[NumVertices];		// per face, w 0
+
+const int NumMergedVertices = NumJoints * NumVertices;
+point4 mergedPoints[NumMergedVertices];
+color4 mergedColors[NumMergedVertices];
+glm::vec4 mergedNormals[NumMergedVertices];
 
 // Vertices of a unit cube centered at origin, sides aligned with axes
 point4 vertices[8] = {
@@ -91,11 +149,18 @@ color4 vertex_colors[8] = {
 //----------------------------------------------------------------------------
 
 // quad generates two triangles for each face and assigns colors
-//    to the vertices
+//    and the face normal to the vertices
 int Index = 0;
 void
 quad(int a, int b, int c, int d)
 {
+	// the cube is centred on the origin, so the outward normal points away from it
+	glm::vec3 n = glm::normalize(glm::cross(glm::vec3(vertices[b] - vertices[a]), glm::vec3(vertices[c] - vertices[b])));
+	if (glm::dot(n, glm::vec3(vertices[a])) < 0.0f)
+		n = -n;
+	for (int i = 0; i < 6; i++)
+		normals[Index + i] = glm::vec4(n, 0.0f);
+
 	colors[Index] = vertex_colors[a]; points[Index] = vertices[a];  Index++;
 	colors[Index] = vertex_colors[b]; points[Index] = vertices[b];  Index++;
 	colors[Index] = vertex_colors[c]; points[Index] = vertices[c];  Index++;
@@ -120,6 +185,8 @@ colorcube()
 
 //----------------------------------------------------------------------------
 
+void bakeImpostors();
+
 // OpenGL initialization
 void
 init()
@@ -129,158 +196,415 @@ init()
 	//Create Buffer and send to GPU once at a time
 	
 	// Create a vertex array object
-	GLuint vao;
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-
-	// Create and initialize a buffer object
-	GLuint buffer;
-	glGenBuffers(1, &buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(points) + sizeof(colors),
-		NULL, GL_STATIC_DRAW);
+	glState.bindVertexArray(vao);
+
+	// Create and initialize a buffer object; the merged pose's positions
+	//   and normals are rewritten each frame, its colors never change
+	for (int i = 0; i < NumMergedVertices; i++)
+		mergedColors[i] = colors[i % NumVertices];
+	glGenBuffers(1, &mergedBuffer);
+	glState.bindBuffer(GL_ARRAY_BUFFER, mergedBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(mergedPoints) + sizeof(mergedColors) + sizeof(mergedNormals),
+		NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(mergedPoints), sizeof(mergedColors), mergedColors);
+
+	// set up vertex arrays; every shader variant binds the same locations
+	glEnableVertexAttribArray(AttribPosition);
+	glVertexAttribPointer(AttribPosition, 4, GL_FLOAT, GL_FALSE, 0,
+		BUFFER_OFFSET(0));
+
+	glEnableVertexAttribArray(AttribColor);
+	glVertexAttribPointer(AttribColor, 4, GL_FLOAT, GL_FALSE, 0,
+		BUFFER_OFFSET(sizeof(mergedPoints)));
+
+	glEnableVertexAttribArray(AttribNormal);
+	glVertexAttribPointer(AttribNormal, 4, GL_FLOAT, GL_FALSE, 0,
+		BUFFER_OFFSET(sizeof(mergedPoints) + sizeof(mergedColors)));
+
+	projectMat = glm::perspective(glm::radians(65.0f), 1.0f, NearPlane, FarPlane);
+	viewMat = glm::lookAt(glm::vec3(0, 0, 6), glm::vec3(0.2, 0, 0), glm::vec3(0, 1, 0));	//Camera pos
+
+	// per-instance model matrices, four texels (columns) each
+	createInstanceStream(swimmerStream);
+
+	// the floor: the cube's faces in one colour, scaled to the pool each frame
+	color4 floorColors[NumVertices];
+	for (int i = 0; i < NumVertices; i++)
+		floorColors[i] = color4(0.55, 0.75, 0.8, 1.0);
+	glGenVertexArrays(1, &floorVao);
+	glState.bindVertexArray(floorVao);
+	glGenBuffers(1, &floorBuffer);
+	glState.bindBuffer(GL_ARRAY_BUFFER, floorBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(points) + sizeof(floorColors) + sizeof(normals), NULL, GL_STATIC_DRAW);
 	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(points), points);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(points), sizeof(colors), colors);
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(points), sizeof(floorColors), floorColors);
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(points) + sizeof(floorColors), sizeof(normals), normals);
+	glEnableVertexAttribArray(AttribPosition);
+	glVertexAttribPointer(AttribPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+	glEnableVertexAttribArray(AttribColor);
+	glVertexAttribPointer(AttribColor, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(sizeof(points)));
+	glEnableVertexAttribArray(AttribNormal);
+	glVertexAttribPointer(AttribNormal, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(sizeof(points) + sizeof(floorColors)));
+	createInstanceStream(floorStream);
+
+	// staging for the water, caustics and particle streams
+	uploadRing.init();
+
+	// pool lights and shadow maps, then every variant of the scene shaders, which share them
+	lightsInit(64);
+	shadowsInit();
+	shadersInit();
+
+	// skeleton and skinned mesh, one box per joint
+	swimmerInit(points, normals, colors, NumVertices);
+
+	// impostors: a centre and frame per instance, quad corners from gl_VertexID
+	impostorProgram = InitShader("src/impostor_vshader.glsl", "src/impostor_fshader.glsl");
+	impostorVPID = glGetUniformLocation(impostorProgram, "mVP");
+	cameraRightID = glGetUniformLocation(impostorProgram, "cameraRight");
+	cameraUpID = glGetUniformLocation(impostorProgram, "cameraUp");
+	glState.uniform1i(glGetUniformLocation(impostorProgram, "impostors"), 0);
+	glState.uniform1i(glGetUniformLocation(impostorProgram, "frames"), 1);
+	glGenVertexArrays(1, &impostorVao);
+	createInstanceStream(impostorStream);
+
+	crowdLayout(1);
+
+	glState.enable(GL_DEPTH_TEST);
+	bakeImpostors();
+	glClearColor(0.55, 0.7, 0.85, 1.0);		// sky, matching the ocean's reflection
+
+	// the water surface and the particles build a program per transparency mode
+	oitInit();
+	waterInit(256);
+	particlesInit(1 << 18);
+	oceanInit(256);
+
+	overdrawInit();
+	causticsInit();
+	postInit();
+	hudInit();
+}
 
-	// Load shaders and use the resulting shader program
-	GLuint program = InitShader("src/vshader.glsl", "src/fshader.glsl");	
-	glUseProgram(program);
+//----------------------------------------------------------------------------
 
-	// set up vertex arrays
-	GLuint vPosition = glGetAttribLocation(program, "vPosition");
-	glEnableVertexAttribArray(vPosition);
-	glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0,
-		BUFFER_OFFSET(0));
+// skins the current stroke's palette into the merged mesh
+void mergePose()
+{
+	skinVertices(&swimmerMesh[0], NumMergedVertices, strokePalette, mergedPoints);
+	skinNormals(&swimmerMesh[0], NumMergedVertices, strokePalette, mergedNormals);
+}
+
+// swimmer-space bounds of the merged mesh
+void poseBounds(glm::vec3& lo, glm::vec3& hi)
+{
+	lo = hi = glm::vec3(mergedPoints[0]);
+	for (int i = 1; i < NumMergedVertices; i++) {
+		lo = glm::min(lo, glm::vec3(mergedPoints[i]));
+		hi = glm::max(hi, glm::vec3(mergedPoints[i]));
+	}
+}
 
-	GLuint vColor = glGetAttribLocation(program, "vColor");
-	glEnableVertexAttribArray(vColor);
-	glVertexAttribPointer(vColor, 4, GL_FLOAT, GL_FALSE, 0,
-		BUFFER_OFFSET(sizeof(points)));
+//----------------------------------------------------------------------------
 
-	pvmMatrixID = glGetUniformLocation(program, "mPVM");		//uniform ǵ mPVM,  vertex   ۾  <-> in/out
+// baked frame closest to the current stroke
+int impostorFrame()
+{
+	float arm = fmod(armRotAngle, glm::two_pi<float>()) / glm::two_pi<float>();
+	float leg = (legRotAngle - legMinAngle) / (legMaxAngle - legMinAngle);
+	int a = int(arm * ArmFrames + 0.5f) % ArmFrames;
+	int l = std::min(std::max(int(leg * (LegFrames - 1) + 0.5f), 0), LegFrames - 1);
+	return a * LegFrames + l;
+}
 
-	projectMat = glm::perspective(glm::radians(65.0f), 1.0f, 0.1f, 100.0f);
-	viewMat = glm::lookAt(glm::vec3(0, 0, 6), glm::vec3(0.2, 0, 0), glm::vec3(0, 1, 0));	//Camera pos
+// Renders every baked pose from the side (looking down -z in swimmer space,
+//   as the default camera sees the crowd) into one layer each of impostorTex.
+//   Leaves impostorTex 0 if the framebuffer cannot be used.
+void bakeImpostors()
+{
+	float savedArm = armRotAngle, savedLeg = legRotAngle;
+	unsigned savedLighting = shaderLighting;
+	const int Layers = ArmFrames * LegFrames;
+	shaderLighting = ShaderLit;		// screen tiles mean nothing in the bake target
+
+	// one box around every pose, so all frames share a scale
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+	for (int f = 0; f < Layers; f++) {
+		armRotAngle = glm::two_pi<float>() * (f / LegFrames) / ArmFrames;
+		legRotAngle = legMinAngle + (legMaxAngle - legMinAngle) * (f % LegFrames) / (LegFrames - 1);
+		swimmerPalette(armRotAngle, legRotAngle, strokePalette);
+		mergePose();
+		glm::vec3 plo, phi;
+		poseBounds(plo, phi);
+		lo = glm::min(lo, plo);
+		hi = glm::max(hi, phi);
+	}
+	impostorCenter = (lo + hi) * 0.5f;
+	impostorHalfSize = glm::vec2(hi - lo) * 0.5f;
+
+	glGenTextures(1, &impostorTex);
+	glState.activeTexture(GL_TEXTURE1);
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, impostorTex);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, ImpostorWidth, ImpostorHeight, Layers, 0,
+		GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	GLuint fbo, depth;
+	glGenFramebuffers(1, &fbo);
+	glGenRenderbuffers(1, &depth);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, ImpostorWidth, ImpostorHeight);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, impostorTex, 0, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "impostor framebuffer incomplete, far swimmers use the merged mesh" << std::endl;
+		glDeleteTextures(1, &impostorTex);
+		impostorTex = 0;
+	}
+	else {
+		// clear to transparent so the billboards can cut the swimmer out
+		glm::mat4 ortho = glm::ortho(lo.x, hi.x, lo.y, hi.y, -hi.z - 1.0f, -lo.z + 1.0f);
+		glViewport(0, 0, ImpostorWidth, ImpostorHeight);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+		glm::mat4 identity(1.0f);
+
+		for (int f = 0; f < Layers; f++) {
+			armRotAngle = glm::two_pi<float>() * (f / LegFrames) / ArmFrames;
+			legRotAngle = legMinAngle + (legMaxAngle - legMinAngle) * (f % LegFrames) / (LegFrames - 1);
+			swimmerPalette(armRotAngle, legRotAngle, strokePalette);
+
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, impostorTex, 0, f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			drawSkinnedSwimmers(&identity, 1, strokePalette, ortho, 0);
+			renderQueue.flush();
+		}
+
+		glState.activeTexture(GL_TEXTURE1);
+		glState.bindTexture(GL_TEXTURE_2D_ARRAY, impostorTex);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteRenderbuffers(1, &depth);
+	glDeleteFramebuffers(1, &fbo);
+	glViewport(0, 0, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
 
-	glEnable(GL_DEPTH_TEST);
-	glClearColor(0.0, 0.0, 0.0, 1.0);
+	armRotAngle = savedArm;
+	legRotAngle = savedLeg;
+	shaderLighting = savedLighting;
+	swimmerPalette(armRotAngle, legRotAngle, strokePalette);
 }
 
 //----------------------------------------------------------------------------
 
-void drawSwimmingMan(glm::mat4 basis)
+// Poses the merged mesh and uploads it, then brings the crowd's bounds and
+//   BVH up to date; the shadow pass and drawCrowd() both read them.
+void updateCrowd()
 {
-	glm::mat4 modelMat, pvmMat;
+	// every swimmer shares the stroke, so one pose gives the local bounds
+	swimmerPalette(armRotAngle, legRotAngle, strokePalette);
+	mergePose();
+	glm::vec3 lo, hi;
+	poseBounds(lo, hi);
+	crowdUpdateBounds(lo, hi);
+
+	glState.bindBuffer(GL_ARRAY_BUFFER, mergedBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(mergedPoints), mergedPoints);
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(mergedPoints) + sizeof(mergedColors), sizeof(mergedNormals), mergedNormals);
+	frameStats.bytesUploaded += sizeof(mergedPoints) + sizeof(mergedNormals);
+
+	int n = crowd.size();
+	BVH::Boxes boxes = { &crowd.minX[0], &crowd.minY[0], &crowd.minZ[0],
+		&crowd.maxX[0], &crowd.maxY[0], &crowd.maxZ[0] };
+
+	// the tree is kept for picking and spatial queries whatever the cull mode
+	if (crowdBvh.size() != n || crowdBvh.degraded())
+		crowdBvh.build(boxes, n);
+	else
+		crowdBvh.refit(boxes);
+}
 
-	
-	//body
-	modelMat = glm::translate(basis, bodyPos);
-	modelMat = glm::scale(modelMat, bodyScale);
-	pvmMat = projectMat * viewMat * modelMat;
-	glUniformMatrix4fv(pvmMatrixID, 1, GL_FALSE, &pvmMat[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	//head
-	modelMat = glm::translate(basis, headPos);  
-	modelMat = glm::scale(modelMat, headScale);
-	pvmMat = projectMat * viewMat * modelMat;
-	glUniformMatrix4fv(pvmMatrixID, 1, GL_FALSE, &pvmMat[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-
-	//right_arm
-	//TRST
-	modelMat = glm::translate(basis, rightArmPos);										// body  ġ 
-	modelMat = glm::rotate(modelMat, armRotAngle, glm::vec3(0, 0, 1));		//ȸ
-	modelMat = glm::scale(modelMat, armScale);										//ϸ
-	modelMat = glm::translate(modelMat, glm::vec3(armScale.x/2, 0, 0));		// ȸ ȸŰ   ȸ   ̵
-	pvmMat = projectMat * viewMat * modelMat;
-	glUniformMatrix4fv(pvmMatrixID, 1, GL_FALSE, &pvmMat[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	//right_forearm
-	//TRST
-	modelMat = glm::translate(basis, rightForearmPos);			
-	modelMat = glm::rotate(modelMat, armRotAngle, glm::vec3(0, 0, 1));	
-	modelMat = glm::scale(modelMat, forearmScale);				
-	modelMat = glm::translate(modelMat, glm::vec3(armScale.x+(forearmScale.x/2)+ armRotGap, 0, 0));		
-	pvmMat = projectMat * viewMat * modelMat;
-	glUniformMatrix4fv(pvmMatrixID, 1, GL_FALSE, &pvmMat[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	//left_arm
-	//TRST
-	modelMat = glm::translate(basis, leftArmPos);				
-	modelMat = glm::rotate(modelMat, armRotAngle, glm::vec3(0, 0, 1));	
-	modelMat = glm::scale(modelMat, armScale);				
-	modelMat = glm::translate(modelMat, glm::vec3(-armScale.x / 2, 0, 0));		
-	pvmMat = projectMat * viewMat * modelMat;
-	glUniformMatrix4fv(pvmMatrixID, 1, GL_FALSE, &pvmMat[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	//left_forearm
-	//TRST
-	modelMat = glm::translate(basis, leftForearmPos);				
-	modelMat = glm::rotate(modelMat, armRotAngle, glm::vec3(0, 0, 1));	
-	modelMat = glm::scale(modelMat, forearmScale);			
-	modelMat = glm::translate(modelMat, glm::vec3(-(armScale.x + (forearmScale.x / 2) + armRotGap), 0, 0));		
-	pvmMat = projectMat * viewMat * modelMat;
-	glUniformMatrix4fv(pvmMatrixID, 1, GL_FALSE, &pvmMat[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-	 
-	
-	// right_upperLeg
-	// TRST
-	modelMat = glm::translate(basis, rightUpperlegPos);
-	modelMat = glm::rotate(modelMat, legRotAngle,glm::vec3(0, 0, 1));
-	modelMat = glm::scale(modelMat,upperlegScale);
-	modelMat = glm::translate(modelMat, glm::vec3(upperlegScale.x/2, 0, 0));
-	pvmMat = projectMat * viewMat * modelMat;
-	glUniformMatrix4fv(pvmMatrixID, 1, GL_FALSE, &pvmMat[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	// right_lowerLeg
-	// TRST
-	modelMat = glm::translate(basis, rightLowerlegPos);
-	modelMat = glm::rotate(modelMat, legRotAngle, glm::vec3(0, 0, 1));
-	modelMat = glm::scale(modelMat, lowerlegScale);
-	modelMat = glm::translate(modelMat, glm::vec3(upperlegScale.x + (lowerlegScale.x / 2) + legRotGap, 0, 0));
-	pvmMat = projectMat * viewMat * modelMat;
-	glUniformMatrix4fv(pvmMatrixID, 1, GL_FALSE, &pvmMat[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-
-	// left_upperLeg
-	// TRST
-	modelMat = glm::translate(basis, leftUpperlegPos);
-	modelMat = glm::rotate(modelMat, -legRotAngle, glm::vec3(0, 0, 1));
-	modelMat = glm::scale(modelMat, upperlegScale);
-	modelMat = glm::translate(modelMat, glm::vec3(upperlegScale.x/2, 0, 0));
-	pvmMat = projectMat * viewMat * modelMat;
-	glUniformMatrix4fv(pvmMatrixID, 1, GL_FALSE, &pvmMat[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
-
-	// left_lowerLeg
-	// TRST
-	modelMat = glm::translate(basis, leftLowerLegPos);
-	modelMat = glm::rotate(modelMat, -legRotAngle, glm::vec3(0, 0, 1));
-	modelMat = glm::scale(modelMat, lowerlegScale);
-	modelMat = glm::translate(modelMat, glm::vec3(upperlegScale.x + (lowerlegScale.x / 2) + legRotGap, 0, 0));
-	pvmMat = projectMat * viewMat * modelMat;
-	glUniformMatrix4fv(pvmMatrixID, 1, GL_FALSE, &pvmMat[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
+// Culls the crowd against the view frustum by AABB, picks a level of detail
+//   for each swimmer left and queues one instanced draw per level.
+void drawCrowd()
+{
+	glm::mat4 vpMat = projectMat * viewMat;
+	viewFrustum = frustumFromMatrix(vpMat);
+
+	int n = crowd.size();
+	BVH::Boxes boxes = { &crowd.minX[0], &crowd.minY[0], &crowd.minZ[0],
+		&crowd.maxX[0], &crowd.maxY[0], &crowd.maxZ[0] };
+
+	visibleSwimmers.clear();
+	swimmerVisibility.clear();
+	if (cullMode == CullHierarchy) {
+		crowdBvh.queryFrustum(viewFrustum, visibleSwimmers, swimmerVisibility);
+	}
+	else {
+		swimmerVisibility.resize(n, (unsigned char)CullInside);
+		if (cullMode == CullLinear)
+			cullBoxes(viewFrustum, boxes.minX, boxes.minY, boxes.minZ,
+				boxes.maxX, boxes.maxY, boxes.maxZ, n, &swimmerVisibility[0]);
+		for (int i = 0; i < n; i++)
+			visibleSwimmers.push_back(i);
+	}
+	frameStats.swimmersTotal += n;
+
+	drawnSwimmers.clear();
+	for (size_t v = 0; v < visibleSwimmers.size(); v++) {
+		if (swimmerVisibility[v] != CullOutside)
+			drawnSwimmers.push_back(visibleSwimmers[v]);
+	}
+	if (drawnSwimmers.empty())
+		return;
+
+	glm::vec3 eye(glm::inverse(viewMat)[3]);
+	if (frontToBack) {
+		// squared distances are positive, so their bits sort as the floats do
+		distanceOrder.resize(drawnSwimmers.size());
+		for (size_t d = 0; d < drawnSwimmers.size(); d++) {
+			int i = drawnSwimmers[d];
+			glm::vec3 offset = glm::vec3(crowd.x[i], crowd.y[i], crowd.z[i]) - eye;
+			float distance = glm::dot(offset, offset);
+			unsigned bits;
+			memcpy(&bits, &distance, sizeof(bits));
+			distanceOrder[d].key = bits;
+			distanceOrder[d].index = unsigned(i);
+		}
+		radixSort(distanceOrder, distanceScratch);
+		for (size_t d = 0; d < drawnSwimmers.size(); d++)
+			drawnSwimmers[d] = int(distanceOrder[d].index);
+		frameStats.sortedSwimmers = int(drawnSwimmers.size());
+	}
+
+	int counts[NumLods];
+	lodSelect(&crowd.x[0], &crowd.y[0], &crowd.z[0], &drawnSwimmers[0], int(drawnSwimmers.size()),
+		eye, &crowd.lod[0], counts);
+	lodAdapt(counts);
+
+	float frame = float(impostorFrame());
+	int variants = swimmerRigCount();
+	fullInstances.clear();
+	fullVariants.clear();
+	swimmerInstances.clear();
+	impostorInstances.clear();
+	for (size_t d = 0; d < drawnSwimmers.size(); d++) {
+		int i = drawnSwimmers[d];
+		glm::mat4 basis = swimmerBasis(i);
+		int level = crowd.lod[i];
+		if (level == LodImpostor && !impostorTex)
+			level = LodMerged;		// no baked frames
+		frameStats.lodCounts[level]++;
+		frameStats.swimmers++;
+
+		if (level == LodFull) {
+			fullInstances.push_back(basis);
+			fullVariants.push_back((unsigned short)(crowd.rig[i] % variants));
+		}
+		else if (level == LodMerged)
+			swimmerInstances.push_back(basis);
+		else
+			impostorInstances.push_back(glm::vec4(glm::vec3(basis * glm::vec4(impostorCenter, 1.0f)), frame));
+	}
+
+	if (!fullInstances.empty()) {
+		swimmerRigPalettes(armRotAngle, legRotAngle, rigPalettes);
+		drawSkinnedSwimmers(&fullInstances[0], int(fullInstances.size()), &rigPalettes[0], vpMat, LodFull,
+			&fullVariants[0]);
+	}
+
+	if (!swimmerInstances.empty()) {
+		uploadInstances(swimmerStream, &swimmerInstances[0], swimmerInstances.size() * sizeof(glm::mat4));
+		const ShaderVariant& scene = shaderVariant(shaderLighting);
+		submitInstanced(scene.program, vao, GL_TRIANGLES, NumMergedVertices, GLsizei(swimmerInstances.size()),
+			swimmerStream.tex, 0, scene.vpID, vpMat, LodMerged);
+	}
+
+	if (!impostorInstances.empty()) {
+		// camera axes are the rows of the view matrix
+		glm::vec3 right(viewMat[0][0], viewMat[1][0], viewMat[2][0]);
+		glm::vec3 up(viewMat[0][1], viewMat[1][1], viewMat[2][1]);
+		right *= impostorHalfSize.x;
+		up *= impostorHalfSize.y;
+		glState.useProgram(impostorProgram);
+		glState.uniform3f(cameraRightID, right.x, right.y, right.z);
+		glState.uniform3f(cameraUpID, up.x, up.y, up.z);
+
+		uploadInstances(impostorStream, &impostorInstances[0], impostorInstances.size() * sizeof(glm::vec4));
+		submitInstanced(impostorProgram, impostorVao, GL_TRIANGLE_STRIP, 4, GLsizei(impostorInstances.size()),
+			impostorStream.tex, impostorTex, impostorVPID, vpMat, LodImpostor);
+	}
+}
+
+// one slab under the whole crowd, FloorDepth down
+void drawFloor()
+{
+	glm::vec3 lo, hi;
+	crowdBvh.bounds(lo, hi);
+	if (lo.x > hi.x)
+		return;
+	glm::vec3 center((lo.x + hi.x) * 0.5f, lo.y - FloorDepth, (lo.z + hi.z) * 0.5f);
+	glm::vec3 size(hi.x - lo.x + 2.0f * FloorMargin, 0.2f, hi.z - lo.z + 2.0f * FloorMargin);
+	glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), center), size);
+
+	uploadInstances(floorStream, &model, sizeof(model));
+	const ShaderVariant& scene = shaderVariant(shaderLighting);
+	// after the swimmers that share its program; most of it lies behind them
+	submitInstanced(scene.program, floorVao, GL_TRIANGLES, NumVertices, 1, floorStream.tex, 0, scene.vpID,
+		projectMat * viewMat, 0, 1.0f);
 }
 
 
 void display(void)
 {
-	glm::mat4 worldMat, pvmMat;
+	hudBeginFrame();
+	resolutionBeginFrame();
+
+	// the scene renders at the controller's size and is filtered up to the window
+	int windowWidth = glutGet(GLUT_WINDOW_WIDTH), windowHeight = glutGet(GLUT_WINDOW_HEIGHT);
+	int width, height;
+	renderSize(windowWidth, windowHeight, width, height);
+
+	// the shadow pass renders into its own framebuffer, so it goes before the clear
+	lightsUpdate(glutGet(GLUT_ELAPSED_TIME) / 1000.0f, viewMat, projectMat, width, height);
+	updateCrowd();
+	if (shaderLighting & ShaderShadows)
+		drawShadows(viewMat, projectMat, lightsSunDirection(), crowdBvh, vao, NumMergedVertices, width, height);
+
+	// the scene goes offscreen; the heatmap is shown without post-processing
+	float t = glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
+	unsigned effects = overdrawEnabled() ? 0u : postEffects;
+	if (effects & PostCaustics)
+		causticsUpdate(t);
+	postBeginScene(width, height);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	worldMat = glm::rotate(glm::mat4(1.0f), 0.0f, glm::vec3(1.0f, 1.0f, 0.0f));	//for rotation, rotate(,ȸ,ȸ)
-
-	drawSwimmingMan(worldMat);
+	overdrawBegin();
+	drawCrowd();
+	drawFloor();
+	waterUpload();
+	renderQueue.flush();
+	postUnderwater(viewMat, projectMat, effects);
+
+	// the transparent layers over the finished opaque depth
+	oitBegin(postSceneFramebuffer(), width, height);
+	drawOcean(t, projectMat * viewMat, glm::vec3(glm::inverse(viewMat)[3]));
+	drawParticles(projectMat * viewMat, viewMat);
+	oitEnd();
+	streamEndFrame();
+	overdrawEnd(width, height);
+	postFinish(windowWidth, windowHeight, effects);
+	uploadRing.endFrame();
+	resolutionEndFrame();
+	hudDraw();
 	glutSwapBuffers();
+	glcountEndFrame();
+	glState.endFrame();
 
 }
 
@@ -307,6 +631,17 @@ void idle()		//OpenGl
 			legRotAngle -= glm::radians(t * 360.0f / 5000.0f);
 
 		armRotAngle += glm::radians(t*360.0f / 5000.0f);		//5ʿ ѹ
+
+		// the stroke moves the swimmers and the wakes follow it, both in fixed
+		//   steps; the hands throw spray
+		glm::vec3 tips[NumLimbTips];
+		swimmerPalette(armRotAngle, legRotAngle, strokePalette);
+		swimmerLimbTips(strokePalette, tips);
+		if (physicsEnabled)
+			steerCrowd(t / 1000.0f);
+		physicsAdvance(t / 1000.0f, strokePalette);
+		waterAdvance(t / 1000.0f, tips);
+		particlesAdvance(t / 1000.0f, tips);
 		prevTime = currTime;
 		glutPostRedisplay();
 	}
@@ -314,6 +649,14 @@ void idle()		//OpenGl
 
 //----------------------------------------------------------------------------
 
+// what 'l' steps through, starting from shaderLighting's default
+const int NumLightingModes = 4;
+const unsigned lightingModes[NumLightingModes] = {
+	ShaderLit | ShaderPointLights | ShaderShadows, ShaderLit | ShaderShadows, ShaderLit, 0
+};
+const char* lightingModeNames[NumLightingModes] = { "pool lights", "sun with shadows", "sun only", "off" };
+int lightingMode = 0;
+
 void
 keyboard(unsigned char key, int x, int y)	//change mode
 {
@@ -322,18 +665,128 @@ keyboard(unsigned char key, int x, int y)	//change mode
 	case 'q': case 'Q':
 		exit(EXIT_SUCCESS);
 		break;
+	case 'h': case 'H':		// performance HUD on/off
+		hudToggle();
+		glutPostRedisplay();
+		break;
+	case '+': case '=':		// double / halve the crowd
+		crowdLayout(crowd.size() * 2);
+		glutPostRedisplay();
+		break;
+	case '-': case '_':
+		crowdLayout(crowd.size() / 2);
+		glutPostRedisplay();
+		break;
+	case 'c': case 'C':		// cycle frustum culling: off, linear, BVH
+		cullMode = CullMode((cullMode + 1) % 3);
+		std::cout << "culling " << cullModeNames[cullMode] << std::endl;
+		glutPostRedisplay();
+		break;
+	case 'k': case 'K':		// skin full-detail swimmers on the GPU or the CPU
+		skinPath = skinPath == SkinGpu ? SkinCpu : SkinGpu;
+		std::cout << "skinning on the " << (skinPath == SkinGpu ? "GPU" : "CPU") << std::endl;
+		glutPostRedisplay();
+		break;
+	case '[': case ']':		// halve / double the ocean resolution
+		oceanSetSize(key == '[' ? oceanSize() / 2 : oceanSize() * 2);
+		std::cout << "ocean " << oceanSize() << "x" << oceanSize() << std::endl;
+		glutPostRedisplay();
+		break;
+	case ',': case '.':		// halve / double the pool lights
+		lightsSetCount(key == ',' ? lightsCount() / 2 : std::max(lightsCount() * 2, 1));
+		std::cout << lightsCount() << " pool lights" << std::endl;
+		glutPostRedisplay();
+		break;
+	case 'l': case 'L':		// lighting: pool lights, sun with shadows, sun only, flat colors
+		lightingMode = (lightingMode + 1) % NumLightingModes;
+		shaderLighting = lightingModes[lightingMode];
+		if (!shadowsAvailable())
+			shaderLighting &= ~unsigned(ShaderShadows);
+		std::cout << "lighting " << lightingModeNames[lightingMode] << std::endl;
+		glutPostRedisplay();
+		break;
+	case 'z': case 'Z':		// lay depth before shading
+		renderQueue.setDepthPrepass(!renderQueue.depthPrepass());
+		std::cout << "depth pre-pass " << (renderQueue.depthPrepass() ? "on" : "off") << std::endl;
+		glutPostRedisplay();
+		break;
+	case 'f': case 'F':		// draw swimmers nearest first, or in crowd order
+		frontToBack = !frontToBack;
+		std::cout << "front-to-back ordering " << (frontToBack ? "on" : "off") << std::endl;
+		glutPostRedisplay();
+		break;
+	case 'o': case 'O':		// fragments shaded per pixel as a heatmap
+		overdrawToggle();
+		std::cout << "overdraw heatmap " << (overdrawEnabled() ? "on" : "off") << std::endl;
+		glutPostRedisplay();
+		break;
+	case 't': case 'T':		// transparency: weighted OIT, per-pixel lists, sorted blending
+		for (int m = oitMode() + 1; ; m++) {
+			if (oitSupported(TransparencyMode(m % NumTransparencyModes))) {
+				oitSetMode(TransparencyMode(m % NumTransparencyModes));
+				break;
+			}
+		}
+		std::cout << "transparency " << transparencyModeNames[oitMode()] << std::endl;
+		glutPostRedisplay();
+		break;
+	case 'p': case 'P':		// fog, caustics, bloom and tonemapping on/off
+		postEffects = postEffects ? 0u : unsigned(PostAll);
+		std::cout << "post-processing " << (postEffects ? "on" : "off") << std::endl;
+		glutPostRedisplay();
+		break;
+	case 'r': case 'R':		// scale the render resolution to the frame budget, or not
+		resolutionSetEnabled(!resolutionEnabled());
+		std::cout << "dynamic resolution " << (resolutionEnabled() ? "on" : "off") << std::endl;
+		glutPostRedisplay();
+		break;
+	case 'g': case 'G':		// swim under buoyancy and drag, or stay in place
+		physicsEnabled = !physicsEnabled;
+		if (!physicsEnabled)
+			crowdLayout(crowd.size());
+		std::cout << "physics " << (physicsEnabled ? "on" : "off") << std::endl;
+		glutPostRedisplay();
+		break;
+	case 'v': case 'V':		// cross-check the GL state cache every frame
+		glState.setValidation(!glState.validating());
+		std::cout << "GL state validation " << (glState.validating() ? "on" : "off") << std::endl;
+		break;
 	}
 }
 
 //----------------------------------------------------------------------------
 
+void mouse(int button, int state, int x, int y)	//pick a swimmer with the left button
+{
+	if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN)
+		return;
+
+	// ray through the pixel, from the near to the far plane
+	float w = (float)glutGet(GLUT_WINDOW_WIDTH), h = (float)glutGet(GLUT_WINDOW_HEIGHT);
+	float nx = 2.0f * x / w - 1.0f, ny = 1.0f - 2.0f * y / h;
+	glm::mat4 inv = glm::inverse(projectMat * viewMat);
+	glm::vec4 nearPt = inv * glm::vec4(nx, ny, -1.0f, 1.0f);
+	glm::vec4 farPt = inv * glm::vec4(nx, ny, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPt) / nearPt.w;
+	glm::vec3 dir = glm::normalize(glm::vec3(farPt) / farPt.w - origin);
+
+	float t;
+	int hit = crowdBvh.raycast(origin, dir, &t);
+	if (hit >= 0)
+		std::cout << "picked swimmer " << hit << " at distance " << t << std::endl;
+	else
+		std::cout << "no swimmer there" << std::endl;
+}
+
+//----------------------------------------------------------------------------
+
 void resize(int w, int h)	//when window size changed
 {
 	//match with size of window, regular aspect ratio
 	float ratio = (float)w / (float)h;
 	glViewport(0, 0, w, h);
 
-	projectMat = glm::perspective(glm::radians(65.0f), ratio, 0.1f, 100.0f);		// calculate projection transfotmation
+	projectMat = glm::perspective(glm::radians(65.0f), ratio, NearPlane, FarPlane);		// calculate projection transfotmation
 
 	glutPostRedisplay();
 }
@@ -342,8 +795,22 @@ void resize(int w, int h)	//when window size changed
 
 int main(int argc, char **argv)
 {
+	// cube --compile-rig <text> <binary> needs no window
+	for (int i = 1; i + 2 < argc; i++) {
+		if (strcmp(argv[i], "--compile-rig") == 0)
+			return compileRigFile(argv[i + 1], argv[i + 2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// cube --frame-budget <ms> --scale-bounds <min> <max> for dynamic resolution
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--frame-budget") == 0)
+			resolutionSetBudget(float(atof(argv[i + 1])));
+		else if (strcmp(argv[i], "--scale-bounds") == 0 && i + 2 < argc)
+			resolutionSetBounds(float(atof(argv[i + 1])), float(atof(argv[i + 2])));
+	}
+
 	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
+	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH | GLUT_STENCIL);
 	glutInitWindowSize(512, 512);
 	glutInitContextVersion(3, 2);
 	glutInitContextProfile(GLUT_CORE_PROFILE);
@@ -353,8 +820,15 @@ int main(int argc, char **argv)
 
 	init();
 
+	// cube --bench <name> runs a benchmark instead of the scene
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--bench") == 0)
+			return runBenchmark(argv[i + 1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	glutDisplayFunc(display);
 	glutKeyboardFunc(keyboard);
+	glutMouseFunc(mouse);
 	glutReshapeFunc(resize);	//called when window size changed
 	glutIdleFunc(idle);
 
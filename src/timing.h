@@ -0,0 +1,29 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _TIMING_H_
+#define _TIMING_H_
+
+#include <chrono>
+
+//----------------------------------------------------------------------------
+//
+//  Wall-clock timing for the per-frame statistics and the benchmarks
+//
+
+typedef std::chrono::steady_clock Clock;
+
+// milliseconds from a to b
+inline double msBetween(Clock::time_point a, Clock::time_point b)
+{
+	return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+// milliseconds from start to now
+inline double msSince(Clock::time_point start)
+{
+	return msBetween(start, Clock::now());
+}
+
+#endif // _TIMING_H_
@@ -0,0 +1,130 @@
+//
+// Streaming uploads through a ring of staging buffers, see uploads.h
+//
+
+#include "uploads.h"
+#include "hud.h"
+#include "jobs.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <cstring>
+
+UploadRing uploadRing;
+
+const size_t FillBatch = 64 << 10;		// bytes per job in fill()
+
+//----------------------------------------------------------------------------
+
+void UploadRing::init()
+{
+	glGenBuffers(UploadRegions, buffers);
+	for (int r = 0; r < UploadRegions; r++) {
+		glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffers[r]);
+		glBufferData(GL_COPY_WRITE_BUFFER, UploadRegionSize, NULL, GL_STREAM_DRAW);
+		fences[r] = 0;
+	}
+	glState.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+// true if the GPU is done with this frame's region, without waiting for it
+bool UploadRing::claimRegion()
+{
+	if (checked)
+		return available;
+	checked = true;
+
+	Clock::time_point start = Clock::now();
+	available = true;
+	if (fences[region]) {
+		GLenum status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		available = status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+		if (available) {
+			glDeleteSync(fences[region]);
+			fences[region] = 0;
+		}
+	}
+	stallMs += msSince(start);
+	used = 0;
+	return available;
+}
+
+bool UploadRing::stage(size_t bytes, Staging& s)
+{
+	size_t offset = (used + UploadAlignment - 1) & ~(UploadAlignment - 1);
+	if (!claimRegion() || offset + bytes > UploadRegionSize) {
+		deferred++;
+		return false;
+	}
+
+	Clock::time_point start = Clock::now();
+	glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffers[region]);
+	s.data = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, GLintptr(offset), GLsizeiptr(bytes),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	stallMs += msSince(start);
+	if (!s.data) {
+		deferred++;
+		return false;
+	}
+	s.offset = offset;
+	s.bytes = bytes;
+	used = offset + bytes;
+	staged += bytes;
+	return true;
+}
+
+void UploadRing::fill(const Staging& s, size_t offset, const void* src, size_t bytes)
+{
+	unsigned char* dst = s.data + offset;
+	const unsigned char* from = (const unsigned char*)src;
+	int batches = int((bytes + FillBatch - 1) / FillBatch);
+	parallelFor(batches, 4, [&](int begin, int end) {
+		size_t lo = size_t(begin) * FillBatch, hi = std::min(size_t(end) * FillBatch, bytes);
+		memcpy(dst + lo, from + lo, hi - lo);
+	});
+}
+
+void UploadRing::commit(const Staging& s)
+{
+	Clock::time_point start = Clock::now();
+	glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffers[region]);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	stallMs += msSince(start);
+	frameStats.bytesUploaded += s.bytes;
+}
+
+void UploadRing::copyToTexture(const Staging& s, size_t offset, GLuint texture, int level, int width, int height,
+	GLenum format, GLenum type)
+{
+	glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[region]);
+	glState.activeTexture(GL_TEXTURE0);
+	glState.bindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, type, BUFFER_OFFSET(s.offset + offset));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void UploadRing::copyToBuffer(const Staging& s, size_t offset, GLuint buffer, size_t dstOffset, size_t bytes)
+{
+	glState.bindBuffer(GL_COPY_READ_BUFFER, buffers[region]);
+	glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(s.offset + offset), GLintptr(dstOffset),
+		GLsizeiptr(bytes));
+}
+
+void UploadRing::endFrame()
+{
+	// a region that was never claimed keeps the fence it has
+	if (checked && available && used > 0)
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	region = (region + 1) % UploadRegions;
+	checked = false;
+
+	frameStats.uploadStaged = staged;
+	frameStats.uploadDeferred = deferred;
+	frameStats.uploadStallMs = float(stallMs);
+	stallMs = 0.0;
+	deferred = 0;
+	staged = 0;
+}
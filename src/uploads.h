@@ -0,0 +1,80 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _UPLOADS_H_
+#define _UPLOADS_H_
+
+#include "cube.h"
+
+//----------------------------------------------------------------------------
+//
+//  Streaming uploads through a ring of staging buffers
+//
+//  UploadRegions buffer objects of UploadRegionSize bytes take turns, one
+//    per frame.  stage() hands out space in the current one, mapped
+//    unsynchronized (its fence already said the GPU is done with it); the
+//    caller, or the job threads through fill(), write it; commit() unmaps
+//    it and the copy calls turn it into texture or buffer updates that the
+//    GPU carries out in its own time.  endFrame() fences the region and
+//    moves on to the next.
+//
+//  Nothing waits.  If the next region's fence has not signalled (the GPU
+//    is UploadRegions frames behind) or the region is full, stage() fails
+//    and the caller keeps its data for a later frame or sends it some other
+//    way.  The render thread's time in fence checks, maps and unmaps is
+//    reported as stall time, with the uploads that had to be put off.
+//
+
+const int UploadRegions = 3;
+const size_t UploadRegionSize = 8 << 20;
+const size_t UploadAlignment = 64;			// of every staging offset
+
+class UploadRing {
+public:
+	struct Staging {
+		unsigned char* data;		// mapped until commit()
+		size_t offset;				// in the region's buffer
+		size_t bytes;
+	};
+
+	UploadRing() : region(0), used(0), checked(false), available(false), stallMs(0.0), deferred(0), staged(0) {}
+
+	void init();
+
+	// bytes of mapped space in this frame's region; false if there is none
+	bool stage(size_t bytes, Staging& s);
+
+	// copies bytes of src to s.data + offset on the job threads
+	void fill(const Staging& s, size_t offset, const void* src, size_t bytes);
+
+	// unmaps s; it can be copied from now on
+	void commit(const Staging& s);
+
+	// a width x height image at offset into s to level of a 2D texture
+	void copyToTexture(const Staging& s, size_t offset, GLuint texture, int level, int width, int height,
+		GLenum format, GLenum type);
+
+	// bytes at offset into s to dstOffset in buffer
+	void copyToBuffer(const Staging& s, size_t offset, GLuint buffer, size_t dstOffset, size_t bytes);
+
+	// fences this frame's copies and reports the frame's stats
+	void endFrame();
+
+private:
+	bool claimRegion();
+
+	GLuint buffers[UploadRegions];
+	GLsync fences[UploadRegions];
+	int region;
+	size_t used;				// bytes staged in the region this frame
+	bool checked;				// the region's fence has been looked at this frame
+	bool available;				// and it had signalled
+	double stallMs;
+	int deferred;
+	size_t staged;
+};
+
+extern UploadRing uploadRing;
+
+#endif // _UPLOADS_H_
@@ -1,14 +1,58 @@
 #version 150
 
+// Swimmer vertex shader, every variant (see shaders.h):
+//   SKINNED  linear blend skinning, each swimmer (instance) with NumJoints
+//            palette matrices in jointPalettes, four texels (columns) each;
+//            otherwise one model matrix per instance in partMatrices
+//   LIT      world position and normal for the fragment shader's lighting
 
 in  vec4 vPosition;
 in  vec4 vColor;
 out vec4 color;
 
-uniform mat4 mPVM;	 
+#ifdef LIT
+in  vec4 vNormal;
+out vec3 position;		// world space, for lighting
+out vec3 normal;
+#endif
+
+uniform mat4 mVP;	 
+
+// the depth pre-pass draws with the unlit variant, whose depth must match
+invariant gl_Position;
+
+#ifdef SKINNED
+const int NumJoints = 10;	// as in swimmer.h
+
+in  vec2 vJoints;
+in  vec2 vWeights;
+uniform samplerBuffer jointPalettes;
+
+mat4 joint(float j)
+{
+  int base = (gl_InstanceID * NumJoints + int(j)) * 4;
+  return mat4(texelFetch(jointPalettes, base), texelFetch(jointPalettes, base + 1),
+              texelFetch(jointPalettes, base + 2), texelFetch(jointPalettes, base + 3));
+}
+#else
+uniform samplerBuffer partMatrices;	// model matrix per instance, one column per texel
+#endif
 
 void main() 
 {
-  gl_Position = mPVM * vPosition;
+#ifdef SKINNED
+  mat4 model = vWeights.x * joint(vJoints.x) + vWeights.y * joint(vJoints.y);
+#else
+  int base = gl_InstanceID * 4;
+  mat4 model = mat4(texelFetch(partMatrices, base), texelFetch(partMatrices, base + 1),
+                    texelFetch(partMatrices, base + 2), texelFetch(partMatrices, base + 3));
+#endif
+
+  vec4 world = model * vPosition;
+  gl_Position = mVP * world;
   color = vColor;
+#ifdef LIT
+  position = world.xyz;
+  normal = mat3(model) * vNormal.xyz;	// the boxes only scale along their own axes
+#endif
 } 
@@ -0,0 +1,261 @@
+//
+// Swimmer wakes, see water.h
+//
+
+#include "water.h"
+#include "crowd.h"
+#include "ocean.h"
+#include "hud.h"
+#include "jobs.h"
+#include "simd.h"
+#include "uploads.h"
+#include "timing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+WaterGrid water;
+
+const int WaterTile = 64;				// cells per tile side
+const float WaterSpeed = 6.0f;			// wave speed, units per second
+const float WaterDamping = 0.004f;
+const float WakeDepth = 0.5f;			// tips closer than this to the surface stir it
+const float WakeStrength = 0.5f;		// push per second at the surface
+
+//----------------------------------------------------------------------------
+
+void WaterGrid::init(int size, float side, float waveSpeed, float damping)
+{
+	n = size;
+	extent = side;
+	cellSize = side / size;
+	float c = waveSpeed * WaterStep / cellSize;
+	courant2 = std::min(c * c, 0.5f);		// stability limit of the explicit scheme
+	keep = 1.0f - damping;
+	clear();
+}
+
+void WaterGrid::clear()
+{
+	cur.assign(size_t(stride()) * stride(), 0.0f);
+	prev.assign(size_t(stride()) * stride(), 0.0f);
+}
+
+void WaterGrid::disturb(float x, float z, float amount)
+{
+	// cell i's centre is at (i + 0.5) * cellSize - extent / 2
+	float fx = (x + extent * 0.5f) / cellSize - 0.5f;
+	float fz = (z + extent * 0.5f) / cellSize - 0.5f;
+	int ix = int(std::floor(fx)), iz = int(std::floor(fz));
+	float wx = fx - ix, wz = fz - iz;
+
+	for (int dz = 0; dz < 2; dz++) {
+		for (int dx = 0; dx < 2; dx++) {
+			int cx = ix + dx, cz = iz + dz;
+			if (cx < 0 || cx >= n || cz < 0 || cz >= n)
+				continue;
+			float w = (dx ? wx : 1.0f - wx) * (dz ? wz : 1.0f - wz);
+			cur[size_t(cz + 1) * stride() + cx + 1] += amount * w;
+		}
+	}
+}
+
+void WaterGrid::step()
+{
+	update(true);
+}
+
+void WaterGrid::stepScalar()
+{
+	update(false);
+}
+
+//----------------------------------------------------------------------------
+
+// next = h + keep (h - prev) + c2 (left + right + up + down - 4h), written over prev
+static void
+stepRow(const float* up, const float* row, const float* down, float* out, int count,
+	float c2, float keep, bool simd)
+{
+	int x = 0;
+#ifdef USE_SSE
+	if (simd) {
+		__m128 vc2 = _mm_set1_ps(c2), vkeep = _mm_set1_ps(keep), four = _mm_set1_ps(4.0f);
+		for (; x + 4 <= count; x += 4) {
+			__m128 h = _mm_loadu_ps(row + x);
+			__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row + x - 1), _mm_loadu_ps(row + x + 1)),
+				_mm_add_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x)));
+			__m128 lap = _mm_sub_ps(sum, _mm_mul_ps(four, h));
+			__m128 vel = _mm_mul_ps(vkeep, _mm_sub_ps(h, _mm_loadu_ps(out + x)));
+			_mm_storeu_ps(out + x, _mm_add_ps(_mm_add_ps(h, vel), _mm_mul_ps(vc2, lap)));
+		}
+	}
+#endif
+	for (; x < count; x++) {
+		float h = row[x];
+		float lap = row[x - 1] + row[x + 1] + up[x] + down[x] - 4.0f * h;
+		out[x] = h + keep * (h - out[x]) + c2 * lap;
+	}
+}
+
+void WaterGrid::update(bool simd)
+{
+	int s = stride();
+	int tiles = (n + WaterTile - 1) / WaterTile;
+
+	// every cell reads only the current heights, so tiles are independent
+	parallelFor(tiles * tiles, 1, [&](int begin, int end) {
+		for (int t = begin; t < end; t++) {
+			int x0 = (t % tiles) * WaterTile, z0 = (t / tiles) * WaterTile;
+			int width = std::min(WaterTile, n - x0), z1 = std::min(z0 + WaterTile, n);
+			for (int z = z0; z < z1; z++) {
+				size_t row = size_t(z + 1) * s + x0 + 1;
+				stepRow(&cur[row - s], &cur[row], &cur[row + s], &prev[row], width, courant2, keep, simd);
+			}
+		}
+	});
+	cur.swap(prev);
+}
+
+//----------------------------------------------------------------------------
+
+static GLuint heightTex;
+static std::vector<glm::vec3> sources;		// world x, z and the push per step
+static float pendingTime;					// animation time not yet stepped
+static int framesSteps;						// since the last upload
+static float framesMs;
+static bool changed;						// heights the texture does not have yet
+
+void waterInit(int size)
+{
+	water.init(size, OceanPatch, WaterSpeed, WaterDamping);
+
+	glGenTextures(1, &heightTex);
+	glState.activeTexture(GL_TEXTURE1);
+	glState.bindTexture(GL_TEXTURE_2D, heightTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	changed = true;		// upload the flat grid once
+}
+
+void waterAdvance(float dt, const glm::vec3 tips[NumLimbTips])
+{
+	pendingTime += dt;
+	int steps = int(pendingTime / WaterStep);
+	if (steps == 0)
+		return;
+	pendingTime -= steps * WaterStep;
+	if (steps > WaterMaxSteps)
+		steps = WaterMaxSteps;
+
+	Clock::time_point start = Clock::now();
+
+	// the pose is the same for every step of this frame, so the pushes are too
+	sources.clear();
+	float half = waterExtent() * 0.5f;
+	for (int i = 0; i < crowd.size(); i++) {
+		float s = std::sin(crowd.heading[i]), c = std::cos(crowd.heading[i]);
+		for (int t = 0; t < NumLimbTips; t++) {
+			float depth = std::fabs(crowd.y[i] + tips[t].y - OceanLevel);
+			if (depth >= WakeDepth)
+				continue;
+			float x = crowd.x[i] + c * tips[t].x + s * tips[t].z;
+			float z = crowd.z[i] - s * tips[t].x + c * tips[t].z;
+			if (std::fabs(x) < half && std::fabs(z) < half)
+				sources.push_back(glm::vec3(x, z, -WakeStrength * WaterStep * (1.0f - depth / WakeDepth)));
+		}
+	}
+
+	for (int k = 0; k < steps; k++) {
+		for (size_t p = 0; p < sources.size(); p++)
+			water.disturb(sources[p].x, sources[p].y, sources[p].z);
+		water.step();
+	}
+
+	framesSteps += steps;
+	framesMs += float(msSince(start));
+	changed = true;
+}
+
+void waterUpload()
+{
+	frameStats.waterSteps = framesSteps;
+	frameStats.waterMs = framesMs;
+	framesSteps = 0;
+	framesMs = 0.0f;
+	if (!changed)
+		return;
+
+	// packed rows through the upload ring, copied in by the job threads; if
+	//   the ring has no room this frame the grid goes up with the next one
+	int n = water.size();
+	size_t row = size_t(n) * sizeof(float);
+	UploadRing::Staging s;
+	if (!uploadRing.stage(row * n, s))
+		return;
+	parallelFor(n, 32, [&](int begin, int end) {
+		for (int z = begin; z < end; z++)
+			memcpy(s.data + z * row, water.heights() + size_t(z) * water.stride(), row);
+	});
+	uploadRing.commit(s);
+	uploadRing.copyToTexture(s, 0, heightTex, 0, n, n, GL_RED, GL_FLOAT);
+	changed = false;
+}
+
+GLuint waterTexture()
+{
+	return heightTex;
+}
+
+float waterExtent()
+{
+	return OceanPatch;
+}
+
+//----------------------------------------------------------------------------
+
+void waterBenchmark()
+{
+	const long long CellsPerRun = 64 << 20;		// enough steps for a steady rate
+
+	// 1, 2, 4 ... threads and finally all of them
+	std::vector<int> threadCounts;
+	for (int t = 1; t < jobThreads(); t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(jobThreads());
+
+	printf("%6s %10s %7s %10s\n", "size", "threads", "steps", "Mcells/s");
+
+	for (int n = 256; n <= 2048; n *= 2) {
+		WaterGrid g;
+		g.init(n, OceanPatch, WaterSpeed, WaterDamping);
+		g.disturb(0.0f, 0.0f, -1.0f);
+		int steps = int(std::max(CellsPerRun / ((long long)n * n), 4LL));
+
+		// scalar on one thread first, then SSE
+		for (int r = -1; r < int(threadCounts.size()); r++) {
+			setJobThreads(r < 0 ? 1 : threadCounts[r]);
+			Clock::time_point start = Clock::now();
+			for (int s = 0; s < steps; s++) {
+				if (r < 0)
+					g.stepScalar();
+				else
+					g.step();
+			}
+			double ms = msSince(start);
+
+			char label[16];
+			if (r < 0)
+				snprintf(label, sizeof(label), "1 scalar");
+			else
+				snprintf(label, sizeof(label), "%d", threadCounts[r]);
+			printf("%6d %10s %7d %10.1f\n", n, label, steps, double(n) * n * steps / (ms * 1000.0));
+		}
+		setJobThreads(0);
+	}
+}
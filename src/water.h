@@ -0,0 +1,77 @@
+#pragma once
+
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WATER_H_
+#define _WATER_H_
+
+#include "cube.h"
+#include "swimmer.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+//----------------------------------------------------------------------------
+//
+//  Swimmer wakes: a damped wave equation on a square grid
+//
+//  Heights live on a (size + 2)^2 grid whose one-cell border stays at zero.
+//    Each step is a five-point stencil, four cells at a time with SSE, over
+//    64x64 tiles spread across the job threads.  The grid always advances
+//    in fixed WaterStep steps, however long the animation frame was; the
+//    swimmers' hands and feet push the surface down wherever they are near
+//    it.  The result is added to the ocean surface as a height texture.
+//
+
+const float WaterStep = 1.0f / 120.0f;		// seconds per step
+const int WaterMaxSteps = 8;				// per advance; a longer stall drops time
+
+class WaterGrid {
+public:
+	WaterGrid() : n(0) {}
+
+	// size x size cells over a square of side extent centred on the origin;
+	//   waveSpeed in units per second, damping the fraction of velocity lost per step
+	void init(int size, float extent, float waveSpeed, float damping);
+	void clear();
+
+	// adds amount to the height at world (x, z), spread over the nearest four cells
+	void disturb(float x, float z, float amount);
+
+	void step();
+	void stepScalar();		// same step without SSE, for comparison
+
+	int size() const { return n; }
+	int stride() const { return n + 2; }
+	const float* heights() const { return &cur[stride() + 1]; }		// first interior cell
+
+private:
+	void update(bool simd);
+
+	int n;
+	float extent, cellSize;
+	float courant2;			// (c dt / dx)^2
+	float keep;				// 1 - damping
+	std::vector<float> cur, prev;
+};
+
+extern WaterGrid water;
+
+void waterInit(int size);
+
+// steps the grid through dt seconds of animation, stirred by every swimmer's
+//   limb tips (swimmer space, from swimmerLimbTips)
+void waterAdvance(float dt, const glm::vec3 tips[NumLimbTips]);
+
+// uploads the heights if they moved (through the upload ring, so possibly a
+//   frame late) and reports the steps since the last call
+void waterUpload();
+
+// R32F heights over [-extent/2, extent/2]^2, for the ocean shader
+GLuint waterTexture();
+float waterExtent();
+
+// cells per second vs grid size and thread count, for --bench water
+void waterBenchmark();
+
+#endif // _WATER_H_